@@ -0,0 +1,329 @@
+#define _GNU_SOURCE
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void config_defaults(server_config_t *cfg) {
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->port = 8080;
+    cfg->docroot = "www";
+    cfg->logfile = "server.log";
+    cfg->upstream_max_idle = 16;
+    cfg->drain_timeout = 30;
+    cfg->workers = 1;
+    cfg->retry_after = 1;
+    cfg->events_replay = 1024;
+    cfg->events_backlog_kb = 1024;
+    cfg->upload_dir = "uploads";
+    cfg->upload_max_mb = 1024;
+    cfg->io_threads = 4;
+    cfg->cache_entries = 4096;
+}
+
+static int parse_count(const char *s, int *out) {
+    char *end = NULL;
+    long v = strtol(s, &end, 10);
+    if (!*s || *end || v < 0 || v > 1000000) return -1;
+    *out = (int)v;
+    return 0;
+}
+
+static int parse_port(const char *s, unsigned short *out) {
+    char *end = NULL;
+    long v = strtol(s, &end, 10);
+    if (!*s || *end || v <= 0 || v > 65535) return -1;
+    *out = (unsigned short)v;
+    return 0;
+}
+
+int config_parse_route(proxy_route_t *route, const char *spec) {
+    memset(route, 0, sizeof(*route));
+    const char *eq = strchr(spec, '=');
+    if (!eq || eq == spec || spec[0] != '/') return -1;
+    size_t plen = (size_t)(eq - spec);
+    if (plen >= sizeof(route->prefix)) return -1;
+    memcpy(route->prefix, spec, plen);
+    route->prefix[plen] = '\0';
+    route->prefix_len = plen;
+    const char *hostp = eq + 1;
+    const char *colon = strrchr(hostp, ':');
+    if (!colon || colon == hostp) return -1;
+    size_t hlen = (size_t)(colon - hostp);
+    if (hlen >= sizeof(route->host)) return -1;
+    memcpy(route->host, hostp, hlen);
+    route->host[hlen] = '\0';
+    return parse_port(colon + 1, &route->port);
+}
+
+int config_parse_cpus(int *cpus, int max, const char *spec) {
+    int n = 0;
+    const char *p = spec;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if (end == p || lo < 0 || lo > 4095) return -1;
+        long hi = lo;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtol(p, &end, 10);
+            if (end == p || hi < lo || hi > 4095) return -1;
+        }
+        for (long c = lo; c <= hi; ++c) {
+            if (n == max) return -1;
+            cpus[n++] = (int)c;
+        }
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        p = end;
+    }
+    return n ? n : -1;
+}
+
+int config_path_match(const char *prefix, const char *path) {
+    size_t n = strlen(prefix);
+    if (!n || strncmp(path, prefix, n) != 0) return 0;
+    /* "/api" matches "/api", "/api/x" and "/api?q" but not "/apix" */
+    char next = path[n];
+    return prefix[n - 1] == '/' || next == '\0' || next == '/' || next == '?';
+}
+
+const proxy_route_t *config_match_route(const server_config_t *cfg, const char *path) {
+    const proxy_route_t *best = NULL;
+    for (int i = 0; i < cfg->route_count; ++i) {
+        const proxy_route_t *r = &cfg->routes[i];
+        if (!config_path_match(r->prefix, path)) continue;
+        if (!best || r->prefix_len > best->prefix_len) best = r;
+    }
+    return best;
+}
+
+static int invalid(int opt, const char *val) {
+    fprintf(stderr, "invalid value for -%c: %s\n", opt, val);
+    return -1;
+}
+
+/* Apply one option, identified by its command line letter. */
+static int config_set(server_config_t *cfg, int opt, const char *val) {
+    switch (opt) {
+    case 'p':
+        if (parse_port(val, &cfg->port) != 0) {
+            fprintf(stderr, "invalid port: %s\n", val);
+            return -1;
+        }
+        return 0;
+    case 'd':
+        cfg->docroot = val;
+        return 0;
+    case 'D':
+        cfg->docroot_pack = val;
+        return 0;
+    case 'l':
+        cfg->logfile = val;
+        return 0;
+    case 'P':
+        if (cfg->route_count >= CONFIG_MAX_ROUTES) {
+            fprintf(stderr, "too many proxy routes (max %d)\n", CONFIG_MAX_ROUTES);
+            return -1;
+        }
+        if (config_parse_route(&cfg->routes[cfg->route_count], val) != 0) {
+            fprintf(stderr, "invalid proxy route (want /prefix=host:port): %s\n", val);
+            return -1;
+        }
+        cfg->route_count++;
+        return 0;
+    case 'k':
+        cfg->upstream_max_idle = atoi(val);
+        if (cfg->upstream_max_idle < 0) cfg->upstream_max_idle = 0;
+        return 0;
+    case 'c':
+        cfg->config_file = val;
+        return config_parse_file(cfg, val);
+    case 'i':
+        cfg->pidfile = val;
+        return 0;
+    case 'g':
+        cfg->drain_timeout = atoi(val);
+        if (cfg->drain_timeout < 0) cfg->drain_timeout = 0;
+        return 0;
+    case 'w':
+        if (parse_count(val, &cfg->workers) != 0 || cfg->workers < 1 || cfg->workers > CONFIG_MAX_WORKERS) {
+            fprintf(stderr, "invalid worker count (1-%d): %s\n", CONFIG_MAX_WORKERS, val);
+            return -1;
+        }
+        return 0;
+    case 'M':
+        return parse_count(val, &cfg->max_conns) == 0 ? 0 : invalid(opt, val);
+    case 'm':
+        return parse_count(val, &cfg->max_conns_per_worker) == 0 ? 0 : invalid(opt, val);
+    case 'r':
+    case 'b': {
+        char *end = NULL;
+        double v = strtod(val, &end);
+        if (!*val || *end || v < 0) return invalid(opt, val);
+        if (opt == 'r') cfg->rate_limit = v;
+        else cfg->rate_burst = v;
+        return 0;
+    }
+    case 'Q':
+        return parse_count(val, &cfg->shed_queue_depth) == 0 ? 0 : invalid(opt, val);
+    case 'L':
+        return parse_count(val, &cfg->shed_lag_ms) == 0 ? 0 : invalid(opt, val);
+    case 'a':
+        return parse_count(val, &cfg->retry_after) == 0 ? 0 : invalid(opt, val);
+    case 'S':
+        if (val[0] != '/') return invalid(opt, val);
+        cfg->status_path = val;
+        return 0;
+    case 'A': {
+        int n = config_parse_cpus(cfg->cpus, CONFIG_MAX_WORKERS, val);
+        if (n < 0) return invalid(opt, val);
+        cfg->cpu_count = n;
+        return 0;
+    }
+    case 'B':
+        return parse_count(val, &cfg->busy_poll_us) == 0 ? 0 : invalid(opt, val);
+    case 'T':
+        return parse_count(val, &cfg->trace_entries) == 0 ? 0 : invalid(opt, val);
+    case 't':
+        if (val[0] != '/') return invalid(opt, val);
+        cfg->trace_path = val;
+        return 0;
+    case 'W':
+        if (val[0] != '/') return invalid(opt, val);
+        cfg->ws_path = val;
+        return 0;
+    case 'E':
+        if (val[0] != '/') return invalid(opt, val);
+        cfg->events_path = val;
+        return 0;
+    case 'R':
+        return parse_count(val, &cfg->events_replay) == 0 ? 0 : invalid(opt, val);
+    case 'e':
+        if (parse_count(val, &cfg->events_backlog_kb) != 0 || cfg->events_backlog_kb < 1) return invalid(opt, val);
+        return 0;
+    case 'u':
+        if (val[0] != '/') return invalid(opt, val);
+        cfg->upload_path = val;
+        return 0;
+    case 'U':
+        cfg->upload_dir = val;
+        return 0;
+    case 'z':
+        if (parse_count(val, &cfg->upload_max_mb) != 0 || cfg->upload_max_mb < 1) return invalid(opt, val);
+        return 0;
+    case 'j':
+        if (parse_count(val, &cfg->io_threads) != 0 || cfg->io_threads > CONFIG_MAX_IO_THREADS) {
+            return invalid(opt, val);
+        }
+        return 0;
+    case 'C':
+        if (parse_count(val, &cfg->cache_ttl_ms) != 0 || cfg->cache_ttl_ms > CONFIG_MAX_CACHE_TTL_MS) {
+            return invalid(opt, val);
+        }
+        return 0;
+    case 's':
+        return parse_count(val, &cfg->cache_stale_ms) == 0 ? 0 : invalid(opt, val);
+    case 'N':
+        if (parse_count(val, &cfg->cache_entries) != 0 || cfg->cache_entries < 1) return invalid(opt, val);
+        return 0;
+    case 'x':
+        return parse_count(val, &cfg->fallback_delay_us) == 0 ? 0 : invalid(opt, val);
+    case 'V':
+        if (!*val || strlen(val) > 64 || strpbrk(val, "\r\n")) return invalid(opt, val);
+        cfg->fallback_vary = val;
+        return 0;
+    }
+    return -1;
+}
+
+static const struct {
+    const char *name;
+    int opt;
+} file_options[] = {
+    { "port", 'p' },
+    { "docroot", 'd' },
+    { "docroot-pack", 'D' },
+    { "logfile", 'l' },
+    { "proxy", 'P' },
+    { "upstream-max-idle", 'k' },
+    { "pidfile", 'i' },
+    { "drain-timeout", 'g' },
+    { "workers", 'w' },
+    { "max-connections", 'M' },
+    { "max-connections-per-worker", 'm' },
+    { "rate-limit", 'r' },
+    { "rate-burst", 'b' },
+    { "shed-queue-depth", 'Q' },
+    { "shed-lag-ms", 'L' },
+    { "retry-after", 'a' },
+    { "status-path", 'S' },
+    { "cpu-affinity", 'A' },
+    { "busy-poll", 'B' },
+    { "trace-entries", 'T' },
+    { "trace-path", 't' },
+    { "websocket-path", 'W' },
+    { "events-path", 'E' },
+    { "events-replay", 'R' },
+    { "events-backlog-kb", 'e' },
+    { "upload-path", 'u' },
+    { "upload-dir", 'U' },
+    { "upload-max-mb", 'z' },
+    { "io-threads", 'j' },
+    { "cache-ttl-ms", 'C' },
+    { "cache-stale-ms", 's' },
+    { "cache-entries", 'N' },
+    { "fallback-delay-us", 'x' },
+    { "fallback-vary", 'V' },
+    { NULL, 0 }
+};
+
+int config_parse_file(server_config_t *cfg, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[512];
+    int lineno = 0;
+    int rc = 0;
+    while (rc == 0 && fgets(line, sizeof(line), f)) {
+        lineno++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *name = strtok(line, " \t\r\n");
+        if (!name) continue;
+        char *val = strtok(NULL, " \t\r\n");
+        int opt = 0;
+        for (int i = 0; file_options[i].name; ++i) {
+            if (strcmp(name, file_options[i].name) == 0) opt = file_options[i].opt;
+        }
+        if (!opt || !val) {
+            fprintf(stderr, "%s:%d: invalid option\n", path, lineno);
+            rc = -1;
+            break;
+        }
+        /* values outlive the line buffer; the config lives as long as the process */
+        char *copy = strdup(val);
+        if (!copy || config_set(cfg, opt, copy) != 0) {
+            fprintf(stderr, "%s:%d: invalid value for %s\n", path, lineno, name);
+            rc = -1;
+        }
+    }
+    fclose(f);
+    return rc;
+}
+
+int config_parse_args(server_config_t *cfg, int argc, char **argv) {
+    int c;
+    optind = 1;
+    while ((c = getopt(argc, argv, "p:d:D:l:P:k:c:i:g:w:M:m:r:b:Q:L:a:S:A:B:T:t:W:E:R:e:u:U:z:j:C:s:N:x:V:")) != -1) {
+        if (c == '?' || config_set(cfg, c, optarg) != 0) return -1;
+    }
+    if (optind < argc) {
+        fprintf(stderr, "unexpected argument: %s\n", argv[optind]);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+
+#define CONFIG_MAX_ROUTES 16
+#define CONFIG_PREFIX_MAX 128
+#define CONFIG_HOST_MAX 64
+#define CONFIG_MAX_WORKERS 64
+#define CONFIG_MAX_IO_THREADS 256
+#define CONFIG_MAX_CACHE_TTL_MS 1000
+
+/* A reverse-proxy route: requests whose path starts with `prefix` are
+ * forwarded to host:port. */
+typedef struct proxy_route_s {
+	char prefix[CONFIG_PREFIX_MAX];
+	size_t prefix_len;
+	char host[CONFIG_HOST_MAX];
+	unsigned short port;
+} proxy_route_t;
+
+typedef struct server_config_s {
+	unsigned short port;
+	const char *docroot;
+	const char *logfile;
+	const char *docroot_pack; /* serve static files from this archive instead of docroot */
+	/* reverse proxy */
+	proxy_route_t routes[CONFIG_MAX_ROUTES];
+	int route_count;
+	int upstream_max_idle; /* idle keep-alive connections kept per upstream */
+	/* upgrades */
+	const char *config_file; /* re-read by the new process on SIGHUP/SIGUSR2 */
+	const char *pidfile;
+	int drain_timeout; /* seconds an old process keeps serving after a handoff */
+	/* admission control; 0 disables a limit */
+	int workers;              /* event loop threads */
+	int max_conns;            /* open client connections, all workers together */
+	int max_conns_per_worker; /* a full worker stops accepting until one closes */
+	double rate_limit;        /* requests per second per client IP */
+	double rate_burst;        /* token bucket size; defaults to rate_limit */
+	int shed_queue_depth;     /* accept queue length that triggers 503s */
+	int shed_lag_ms;          /* event loop lag that triggers 503s */
+	int retry_after;          /* seconds advertised in 503 and 429 responses */
+	const char *status_path;  /* serve counters at this path */
+	/* low-latency mode */
+	int cpus[CONFIG_MAX_WORKERS]; /* worker i is pinned to cpus[i % cpu_count] */
+	int cpu_count;                /* 0: no pinning, one shared listener */
+	int busy_poll_us;             /* spin this long after the last event before sleeping */
+	/* tracing */
+	int trace_entries;            /* flight recorder size per worker, 0 = off */
+	const char *trace_path;       /* serve the flight recorder at this path */
+	/* push channels */
+	const char *ws_path;          /* WebSocket upgrades below this prefix, one channel per path */
+	const char *events_path;      /* text/event-stream subscriptions (GET) and publishing (POST) */
+	int events_replay;            /* recent events kept for Last-Event-ID resume */
+	int events_backlog_kb;        /* an event-stream subscriber further behind is dropped */
+	/* uploads */
+	const char *upload_path;      /* PUT/POST below this prefix store the body in upload_dir */
+	const char *upload_dir;       /* storage directory (default "uploads") */
+	int upload_max_mb;            /* larger uploads are refused with 413 */
+	/* blocking file I/O */
+	int io_threads;               /* threads for open/stat/read of static files; 0 = inline in the loop */
+	/* micro-cache for generated responses */
+	int cache_ttl_ms;             /* 0 = off */
+	int cache_stale_ms;           /* expired entries are still served this long while refreshed */
+	int cache_entries;            /* responses kept */
+	int fallback_delay_us;        /* simulated cost of the generated response */
+	const char *fallback_vary;    /* Vary header of the generated response, or NULL */
+} server_config_t;
+
+/* Fill cfg with the built-in defaults (port 8080, docroot "www"). */
+void config_defaults(server_config_t *cfg);
+
+/*
+ * Parse command line options into cfg (call config_defaults first).
+ *   -p PORT            listening port
+ *   -d DIR             document root
+ *   -D FILE            serve static files from a packed archive (bin/docpack)
+ *   -l FILE            log file
+ *   -P PREFIX=HOST:PORT  proxy PREFIX to an upstream (repeatable)
+ *   -k N               idle upstream connections kept per route
+ *   -c FILE            read options from FILE (see config_parse_file)
+ *   -i FILE            write the process id to FILE
+ *   -g SECONDS         drain deadline after an upgrade handoff
+ *   -w N               event loop threads
+ *   -M N               maximum open connections (global)
+ *   -m N               maximum open connections per worker
+ *   -r RATE            requests per second allowed per client IP
+ *   -b N               burst allowed above -r
+ *   -Q N               shed new connections with 503 above this accept queue length
+ *   -L MS              shed new connections with 503 above this event loop lag
+ *   -a SECONDS         Retry-After value for 503 and 429 responses
+ *   -S PATH            serve counters at PATH
+ *   -A CPUS            pin workers to CPUS ("0,2,4-7") and steer connections to them
+ *   -B USEC            busy-poll budget
+ *   -T N               keep phase timestamps of the last N requests per worker
+ *   -t PATH            serve the recorded requests at PATH
+ *   -W PATH            accept WebSocket upgrades below PATH
+ *   -E PATH            serve event streams below PATH
+ *   -R N               events kept for Last-Event-ID resume
+ *   -e KB              backlog at which an event-stream subscriber is dropped
+ *   -u PATH            store PUT/POST bodies below PATH as files
+ *   -U DIR             upload storage directory
+ *   -z MB              largest accepted upload
+ *   -j N               threads doing static-file I/O (0: on the event loop)
+ *   -C MS              cache generated responses this long (at most 1000)
+ *   -s MS              serve expired cache entries this long while refreshing them
+ *   -N N               responses kept in the cache
+ *   -x USEC            make the generated response take this long (benchmarks)
+ * Options are applied in order, so flags after -c override the file.
+ * Returns 0 on success, -1 on invalid arguments (message printed to stderr).
+ */
+int config_parse_args(server_config_t *cfg, int argc, char **argv);
+
+/*
+ * Read options from a file, one "name value" pair per line; '#' starts a
+ * comment. Names: port, docroot, docroot-pack, logfile, proxy,
+ * upstream-max-idle, pidfile, drain-timeout, workers, max-connections,
+ * max-connections-per-worker, rate-limit, rate-burst, shed-queue-depth,
+ * shed-lag-ms, retry-after, status-path, cpu-affinity, busy-poll,
+ * trace-entries, trace-path, websocket-path, events-path, events-replay,
+ * events-backlog-kb, upload-path, upload-dir, upload-max-mb, io-threads,
+ * cache-ttl-ms, cache-stale-ms, cache-entries, fallback-delay-us.
+ * Returns 0 on success, -1 on error.
+ */
+int config_parse_file(server_config_t *cfg, const char *path);
+
+/* Parse a single "PREFIX=HOST:PORT" route spec. Returns 0 on success, -1 on error. */
+int config_parse_route(proxy_route_t *route, const char *spec);
+
+/* Parse a CPU list such as "0,2,4-7" into cpus (at most max entries).
+ * Returns the number of CPUs, or -1 on error. */
+int config_parse_cpus(int *cpus, int max, const char *spec);
+
+/* Does path fall below prefix? "/api" matches "/api", "/api/x" and "/api?q"
+ * but not "/apix". */
+int config_path_match(const char *prefix, const char *path);
+
+/* Return the route with the longest prefix matching path, or NULL. */
+const proxy_route_t *config_match_route(const server_config_t *cfg, const char *path);
+
+#endif
@@ -0,0 +1,275 @@
+#define _GNU_SOURCE
+#include "conn.h"
+#include "iopool.h"
+#include "proxy.h"
+#include "sse.h"
+#include "upload.h"
+#include "ws.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* iovecs per writev() when flushing the shared queue */
+#define CONN_IOV_MAX 64
+
+connection_t *conn_new(worker_t *w, int fd) {
+    connection_t *c = calloc(1, sizeof(connection_t));
+    if (!c) return NULL;
+    c->kind = EV_CLIENT;
+    c->fd = fd;
+    http_parser_init(&c->parser);
+    /* use level-triggering for simplicity; edge-triggering requires careful draining */
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        free(c);
+        return NULL;
+    }
+    c->events = EPOLLIN;
+    c->next = w->conns;
+    if (w->conns) w->conns->prev = c;
+    w->conns = c;
+    w->conn_count++;
+    return c;
+}
+
+uint64_t conn_channel(const char *path) {
+    /* FNV-1a */
+    uint64_t h = 1469598103934665603ULL;
+    for (const char *p = path; *p && *p != '?'; ++p) {
+        h ^= (uint8_t)*p;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void conn_update_events(worker_t *w, connection_t *c) {
+    if (c->fd < 0) return;
+    uint32_t want = 0;
+    if (!c->read_paused) want |= EPOLLIN;
+    if (c->want_write || conn_pending(c)) want |= EPOLLOUT;
+    if (want == c->events) return;
+    struct epoll_event ev;
+    ev.events = want;
+    ev.data.ptr = c;
+    if (epoll_ctl(w->epfd, EPOLL_CTL_MOD, c->fd, &ev) == 0) c->events = want;
+}
+
+shared_buf_t *shared_buf_new(const void *data, size_t len) {
+    shared_buf_t *b = malloc(sizeof(*b) + len);
+    if (!b) return NULL;
+    atomic_init(&b->refs, 1);
+    b->len = len;
+    if (data) memcpy(b->data, data, len);
+    return b;
+}
+
+void shared_buf_unref(shared_buf_t *b) {
+    if (b && atomic_fetch_sub_explicit(&b->refs, 1, memory_order_acq_rel) == 1) free(b);
+}
+
+/* Append b to the shared queue, taking a reference. Returns 0/-1. */
+static int sq_push(connection_t *c, shared_buf_t *b) {
+    if (c->sq_len == c->sq_cap) {
+        size_t ncap = c->sq_cap ? c->sq_cap * 2 : 8;
+        shared_buf_t **nq = malloc(ncap * sizeof(*nq));
+        if (!nq) return -1;
+        /* unwrap the ring so the oldest entry is at index 0 */
+        for (size_t i = 0; i < c->sq_len; ++i) nq[i] = c->sq[(c->sq_head + i) & (c->sq_cap - 1)];
+        free(c->sq);
+        c->sq = nq;
+        c->sq_cap = ncap;
+        c->sq_head = 0;
+    }
+    shared_buf_ref(b);
+    c->sq[(c->sq_head + c->sq_len) & (c->sq_cap - 1)] = b;
+    c->sq_len++;
+    c->sq_bytes += b->len;
+    return 0;
+}
+
+/* n bytes of the shared queue were written: drop what is complete. */
+static void sq_consume(connection_t *c, size_t n) {
+    c->sq_bytes -= n;
+    while (n) {
+        shared_buf_t *b = c->sq[c->sq_head];
+        size_t left = b->len - c->sq_off;
+        if (n < left) {
+            c->sq_off += n;
+            return;
+        }
+        n -= left;
+        c->sq_off = 0;
+        c->sq_head = (c->sq_head + 1) & (c->sq_cap - 1);
+        c->sq_len--;
+        shared_buf_unref(b);
+    }
+}
+
+int conn_queue_shared(connection_t *c, shared_buf_t *b) {
+    if (c->fd < 0) return -1;
+    return sq_push(c, b);
+}
+
+int conn_sendv(worker_t *w, connection_t *c, const struct iovec *iov, int iovcnt) {
+    if (c->fd < 0) return -1;
+    size_t len = 0;
+    for (int i = 0; i < iovcnt; ++i) len += iov[i].iov_len;
+    if (c->sq_len) {
+        /* wbuf is written before the shared queue: keep the order by queueing a copy behind it */
+        shared_buf_t *b = shared_buf_new(NULL, len);
+        if (!b) return -1;
+        size_t off = 0;
+        for (int i = 0; i < iovcnt; ++i) {
+            memcpy(b->data + off, iov[i].iov_base, iov[i].iov_len);
+            off += iov[i].iov_len;
+        }
+        int rc = sq_push(c, b);
+        shared_buf_unref(b);
+        return rc;
+    }
+    size_t sent = 0;
+    /* only write directly if nothing is queued, otherwise bytes would be reordered */
+    if (c->woff == c->wlen) {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = (struct iovec *)iov;
+        msg.msg_iovlen = (size_t)iovcnt;
+        for (;;) {
+            /* one sendmsg for header + body: separate small writes would
+             * trip Nagle against the client's delayed ACK */
+            ssize_t s = sendmsg(c->fd, &msg, 0);
+            if (s >= 0) {
+                sent = (size_t)s;
+                break;
+            }
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            return -1;
+        }
+        if (sent == len) return 0;
+    }
+    /* queue the remainder, compacting already-written bytes away */
+    size_t pending = c->wlen - c->woff;
+    char *nb = malloc(pending + len - sent);
+    if (!nb) return -1;
+    if (pending) memcpy(nb, c->wbuf + c->woff, pending);
+    size_t off = pending;
+    size_t skip = sent;
+    for (int i = 0; i < iovcnt; ++i) {
+        size_t l = iov[i].iov_len;
+        if (skip >= l) {
+            skip -= l;
+            continue;
+        }
+        memcpy(nb + off, (const char *)iov[i].iov_base + skip, l - skip);
+        off += l - skip;
+        skip = 0;
+    }
+    free(c->wbuf);
+    c->wbuf = nb;
+    c->wlen = off;
+    c->woff = 0;
+    conn_update_events(w, c);
+    return 0;
+}
+
+int conn_send(worker_t *w, connection_t *c, const char *data, size_t len) {
+    struct iovec iov = { (void *)data, len };
+    return conn_sendv(w, c, &iov, 1);
+}
+
+int conn_flush(worker_t *w, connection_t *c) {
+    while (c->woff < c->wlen) {
+        ssize_t s = send(c->fd, c->wbuf + c->woff, c->wlen - c->woff, 0);
+        if (s > 0) {
+            c->woff += (size_t)s;
+            continue;
+        }
+        if (s < 0 && errno == EINTR) continue;
+        if (s < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        return -1;
+    }
+    free(c->wbuf);
+    c->wbuf = NULL;
+    c->wlen = c->woff = 0;
+    while (c->sq_len) {
+        struct iovec iov[CONN_IOV_MAX];
+        int n = 0;
+        for (size_t i = 0; i < c->sq_len && n < CONN_IOV_MAX; ++i) {
+            shared_buf_t *b = c->sq[(c->sq_head + i) & (c->sq_cap - 1)];
+            size_t off = i == 0 ? c->sq_off : 0;
+            iov[n].iov_base = b->data + off;
+            iov[n].iov_len = b->len - off;
+            n++;
+        }
+        ssize_t s = writev(c->fd, iov, n);
+        if (s > 0) {
+            sq_consume(c, (size_t)s);
+            continue;
+        }
+        if (s < 0 && errno == EINTR) continue;
+        if (s < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            conn_update_events(w, c);
+            return 0;
+        }
+        return -1;
+    }
+    conn_update_events(w, c);
+    return 1;
+}
+
+void conn_close(worker_t *w, connection_t *c) {
+    if (c->fd < 0) return;
+    if (c->proxy) proxy_abort(w, c);
+    if (c->ws) ws_abort(w, c);
+    if (c->sse) sse_abort(w, c);
+    if (c->upload) upload_abort(w, c);
+    if (c->io) iopool_cancel(w, c);
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    c->fd = -1;
+    http_parser_destroy(&c->parser);
+    free(c->wbuf);
+    c->wbuf = NULL;
+    c->wlen = c->woff = 0;
+    while (c->sq_len) {
+        shared_buf_unref(c->sq[c->sq_head]);
+        c->sq_head = (c->sq_head + 1) & (c->sq_cap - 1);
+        c->sq_len--;
+    }
+    free(c->sq);
+    c->sq = NULL;
+    c->sq_bytes = 0;
+    if (c->prev) c->prev->next = c->next;
+    else w->conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    w->conn_count--;
+    /* the slot was taken in the accept loop */
+    if (w->srv) atomic_fetch_sub_explicit(&w->srv->conn_count, 1, memory_order_relaxed);
+    worker_defer_free(w, c);
+}
+
+void worker_defer_free(worker_t *w, void *p) {
+    if (w->graveyard_len == w->graveyard_cap) {
+        size_t ncap = w->graveyard_cap ? w->graveyard_cap * 2 : 64;
+        void **ng = realloc(w->graveyard, ncap * sizeof(*ng));
+        if (!ng) {
+            /* leaking is safer than a use-after-free later in the batch */
+            return;
+        }
+        w->graveyard = ng;
+        w->graveyard_cap = ncap;
+    }
+    w->graveyard[w->graveyard_len++] = p;
+}
+
+void worker_reap(worker_t *w) {
+    for (size_t i = 0; i < w->graveyard_len; ++i) free(w->graveyard[i]);
+    w->graveyard_len = 0;
+}
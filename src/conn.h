@@ -0,0 +1,224 @@
+#ifndef CONN_H
+#define CONN_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/uio.h>
+#include "config.h"
+#include "http_parser.h"
+#include "pack.h"
+#include "trace.h"
+
+/*
+ * Every object registered with epoll stores a pointer to itself in
+ * epoll_event.data.ptr and starts with an `int kind` field, so the event
+ * loop can tell listeners, client connections and upstream sockets apart.
+ */
+enum ev_kind {
+    EV_LISTEN = 1,
+    EV_CLIENT,
+    EV_UPSTREAM,
+    EV_CONTROL, /* upgrade handshake socket */
+    EV_NOTIFY   /* eventfd other threads use to wake a worker */
+};
+
+typedef struct ev_source_s {
+    int kind;
+    int fd;
+} ev_source_t;
+
+struct proxy_exchange_s;
+struct upstream_pool_s;
+struct ws_conn_s;
+struct ws_worker_s;
+struct sse_conn_s;
+struct sse_worker_s;
+struct sse_hub_s;
+struct upload_s;
+struct io_job_s;
+struct iopool_s;
+struct microcache_s;
+struct ratelimit_s;
+struct server_s;
+
+/* An immutable, reference-counted buffer that can sit in the write queues of
+ * many connections at once: a broadcast is encoded once and every receiver
+ * holds a reference instead of a copy. */
+typedef struct shared_buf_s {
+    atomic_uint refs;
+    size_t len;
+    char data[];
+} shared_buf_t;
+
+typedef struct connection_s {
+    int kind; /* EV_CLIENT */
+    int fd;   /* -1 once closed */
+    uint32_t peer_addr; /* client IPv4 address, host byte order */
+    http_parser_t parser;
+    char buf[8192];
+    size_t buflen;
+    /* request body of a locally handled request, buffered behind its head;
+     * once complete it is moved to the start of buf */
+    size_t body_len;
+    int awaiting_body;
+    int body_unread; /* a body left in the socket for the proxy or an upload */
+    /* outgoing write buffer for partial writes */
+    char *wbuf;
+    size_t wlen; /* total length of wbuf */
+    size_t woff; /* bytes already written */
+    int should_close; /* close after write completes */
+    /* shared buffers queued behind wbuf, oldest first (a ring of sq_cap
+     * entries); sq_off bytes of the oldest one are already written */
+    shared_buf_t **sq;
+    size_t sq_head, sq_len, sq_cap;
+    size_t sq_off;
+    size_t sq_bytes; /* unwritten bytes in sq */
+    /* epoll interest: EPOLLIN unless read_paused, EPOLLOUT while output is
+     * pending or want_write is set */
+    uint32_t events;
+    int read_paused;
+    int want_write;
+    struct proxy_exchange_s *proxy; /* non-NULL while forwarding to an upstream */
+    struct ws_conn_s *ws;           /* non-NULL once upgraded to a WebSocket */
+    struct sse_conn_s *sse;         /* non-NULL while streaming events */
+    struct upload_s *upload;        /* non-NULL while an upload body is arriving */
+    struct io_job_s *io;            /* non-NULL while parked on blocking file I/O */
+    /* phase timestamps, only kept while the worker's flight recorder is on */
+    trace_rec_t trace;     /* request being read or handled */
+    trace_rec_t trace_out; /* answered request whose response is still queued */
+    int trace_out_pending;
+    uint64_t t_last_read;
+    struct connection_s *prev, *next; /* worker's list of open connections */
+} connection_t;
+
+/* Counters written by the owning worker, read by the status page. */
+typedef struct worker_stats_s {
+    atomic_ulong accepted;
+    atomic_ulong requests;
+    atomic_ulong shed;         /* answered with the canned 503 */
+    atomic_ulong throttled;    /* answered with 429 by the per-IP rate limit */
+    atomic_ulong accept_pauses; /* times the per-worker cap stopped accepting */
+    atomic_ulong io_jobs;      /* requests whose file I/O ran on the I/O threads */
+    atomic_long loop_lag_max_us; /* longest epoll batch so far */
+} worker_stats_t;
+
+/* State owned by one event loop. */
+typedef struct worker_s {
+    int id;
+    pthread_t thread;
+    struct server_s *srv;
+    int epfd;
+    ev_source_t listener; /* shared listening socket, fd -1 when not registered */
+    ev_source_t notify;
+    FILE *logf;
+    const server_config_t *cfg;
+    struct upstream_pool_s *pools; /* one per cfg->routes entry */
+    struct ws_worker_s *ws;        /* WebSocket subscribers and broadcast inbox */
+    struct sse_worker_s *sse;      /* event-stream subscribers and inbox */
+    /* uploads splice socket -> pipe -> file; created on first use, shared
+     * because each upload empties it before returning to the loop */
+    int upload_pipe[2];
+    size_t upload_pipe_cap;        /* 0 until the pipe exists */
+    /* file I/O finished by srv->iopool, newest first; pushed by the I/O
+     * threads under io_lock, which then wake the loop through notify */
+    pthread_mutex_t io_lock;
+    struct io_job_s *io_done;
+    connection_t *conns;
+    size_t conn_count;
+    int draining; /* listener handed off: finish requests with Connection: close */
+    /* objects closed while handling an epoll batch; later events in the same
+     * batch may still point at them, so they are freed after the batch */
+    void **graveyard;
+    size_t graveyard_len;
+    size_t graveyard_cap;
+    /* admission control */
+    int accept_paused;      /* at cfg->max_conns_per_worker */
+    long long loop_lag_us;  /* time spent handling the previous epoll batch */
+    long long last_event_us; /* busy polling: spin until this is cfg->busy_poll_us old */
+    int shedding;           /* last accept batch was shed; logged on change */
+    worker_stats_t stats;
+    trace_ring_t trace;        /* flight recorder; cap 0 when tracing is off */
+    unsigned trace_dump_seen;  /* last srv->trace_dump_gen handled */
+} worker_t;
+
+/* State shared by all workers of the process. */
+typedef struct server_s {
+    const server_config_t *cfg;
+    FILE *logf;
+    /* one listener shared by every worker, or one SO_REUSEPORT listener per
+     * worker when pinned; worker i uses listen_fds[i % nlisteners] */
+    int listen_fds[CONFIG_MAX_WORKERS];
+    int nlisteners;
+    worker_t *workers;
+    int nworkers;
+    atomic_long conn_count;          /* all workers, checked against cfg->max_conns */
+    struct ratelimit_s *ratelimit;   /* NULL unless cfg->rate_limit is set */
+    pack_t pack;                     /* mapped cfg->docroot_pack, base NULL if unused */
+    struct sse_hub_s *sse;           /* event ids and replay ring, NULL unless cfg->events_path */
+    struct iopool_s *iopool;         /* static-file I/O threads, NULL when cfg->io_threads is 0 */
+    struct microcache_s *cache;      /* generated responses, NULL unless cfg->cache_ttl_ms is set */
+    atomic_int running;
+    atomic_int draining;
+    long long drain_deadline;        /* monotonic ms, set before draining */
+    /* rendered at startup and written without parsing the request */
+    char shed_response[160];
+    size_t shed_len;
+    atomic_uint trace_dump_gen; /* bumped on SIGUSR1: workers dump their rings */
+} server_t;
+
+/* A shared buffer of len bytes with one reference, filled from data unless
+ * data is NULL. Returns NULL if out of memory. */
+shared_buf_t *shared_buf_new(const void *data, size_t len);
+
+static inline void shared_buf_ref(shared_buf_t *b) {
+    atomic_fetch_add_explicit(&b->refs, 1, memory_order_relaxed);
+}
+
+void shared_buf_unref(shared_buf_t *b);
+
+/* Channel key of a request path (WebSocket and event-stream subscribers):
+ * a 64-bit hash of the path without its query string. */
+uint64_t conn_channel(const char *path);
+
+/* Allocate a connection for an accepted, non-blocking fd and register it
+ * with the worker's epoll set. Returns NULL on failure (fd left open). */
+connection_t *conn_new(worker_t *w, int fd);
+
+/* Send data, queueing whatever the socket does not accept right away.
+ * Returns 0 on success (sent or queued), -1 on a fatal socket error. */
+int conn_send(worker_t *w, connection_t *c, const char *data, size_t len);
+
+/* Like conn_send() for several buffers, written with a single syscall. */
+int conn_sendv(worker_t *w, connection_t *c, const struct iovec *iov, int iovcnt);
+
+/* Queue a shared buffer by reference (no copy) behind any pending output.
+ * Nothing is written until conn_flush(), so several buffers queued in a row
+ * go out with one writev(). Returns 0, or -1 if out of memory. */
+int conn_queue_shared(connection_t *c, shared_buf_t *b);
+
+/* Anything still waiting to be written? */
+static inline int conn_pending(const connection_t *c) {
+    return c->woff < c->wlen || c->sq_len;
+}
+
+/* Try to write out the queued output.
+ * Returns 1 when nothing is left queued, 0 if data is still pending, -1 on error. */
+int conn_flush(worker_t *w, connection_t *c);
+
+/* Re-derive the epoll interest from read_paused/want_write/pending output. */
+void conn_update_events(worker_t *w, connection_t *c);
+
+/* Unregister and close the socket (releasing its slot in the global
+ * connection count); memory is released by worker_reap(). */
+void conn_close(worker_t *w, connection_t *c);
+
+/* Queue p to be freed once the current event batch is finished. */
+void worker_defer_free(worker_t *w, void *p);
+
+/* Free everything queued by worker_defer_free(). */
+void worker_reap(worker_t *w);
+
+#endif
@@ -66,8 +66,8 @@ static int normalize_path(char *buf, size_t buflen) {
     return 0;
 }
 
-int safe_resolve_path(const char *base, const char *reqpath, char *outbuf, size_t outlen) {
-    if (!base || !reqpath || !outbuf) return -1;
+int normalize_request_path(const char *reqpath, char *outbuf, size_t outlen) {
+    if (!reqpath || !outbuf) return -1;
     // make a local mutable copy of reqpath
     char tmp[PATH_MAX];
     if (strlen(reqpath) >= sizeof(tmp)) return -1;
@@ -79,6 +79,28 @@ int safe_resolve_path(const char *base, const char *reqpath, char *outbuf, size_
     if (url_decode_inplace(tmp) != 0) return -1;
     // normalize to collapse .. and . components
     if (normalize_path(tmp, sizeof(tmp)) != 0) return -1;
+    if (strlen(tmp) + 1 > outlen) return -1;
+    strcpy(outbuf, tmp);
+    return 0;
+}
+
+/* Simple MIME mapping based on file extension */
+const char *mime_type_for_path(const char *path) {
+    const char *ext = strrchr(path, '.');
+    if (!ext) return "text/plain; charset=utf-8";
+    if (strcmp(ext, ".html") == 0 || strcmp(ext, ".htm") == 0) return "text/html; charset=utf-8";
+    if (strcmp(ext, ".css") == 0) return "text/css; charset=utf-8";
+    if (strcmp(ext, ".js") == 0) return "application/javascript";
+    if (strcmp(ext, ".png") == 0) return "image/png";
+    if (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0) return "image/jpeg";
+    if (strcmp(ext, ".gif") == 0) return "image/gif";
+    return "application/octet-stream";
+}
+
+int safe_resolve_path(const char *base, const char *reqpath, char *outbuf, size_t outlen) {
+    if (!base || !reqpath || !outbuf) return -1;
+    char tmp[PATH_MAX];
+    if (normalize_request_path(reqpath, tmp, sizeof(tmp)) != 0) return -1;
     // join base + tmp
     char candidate[PATH_MAX];
     if (snprintf(candidate, sizeof(candidate), "%s%s", base, tmp) >= (int)sizeof(candidate)) return -1;
@@ -93,3 +115,28 @@ int safe_resolve_path(const char *base, const char *reqpath, char *outbuf, size_
     strcpy(outbuf, real_candidate);
     return 0;
 }
+
+int safe_resolve_new_path(const char *base, const char *reqpath, char *outbuf, size_t outlen) {
+    if (!base || !reqpath || !outbuf) return -1;
+    size_t rl = strlen(reqpath);
+    // a path ending in '/' names a directory, not a file
+    if (rl == 0 || reqpath[rl - 1] == '/') return -1;
+    char tmp[PATH_MAX];
+    if (normalize_request_path(reqpath, tmp, sizeof(tmp)) != 0) return -1;
+    // split into directory and file name; "/a/.." leaves no name
+    char *slash = strrchr(tmp, '/');
+    if (!slash || slash[1] == '\0') return -1;
+    *slash = '\0';
+    const char *name = slash + 1;
+    char dir[PATH_MAX];
+    if (snprintf(dir, sizeof(dir), "%s%s", base, tmp) >= (int)sizeof(dir)) return -1;
+    // the directory must exist; symlinks are resolved before the containment check
+    char real_dir[PATH_MAX];
+    if (!realpath(dir, real_dir)) return -1;
+    char real_base[PATH_MAX];
+    if (!realpath(base, real_base)) return -1;
+    size_t bl = strlen(real_base);
+    if (strncmp(real_dir, real_base, bl) != 0 || (real_dir[bl] != '\0' && real_dir[bl] != '/')) return -1;
+    if (snprintf(outbuf, outlen, "%s/%s", real_dir, name) >= (int)outlen) return -1;
+    return 0;
+}
@@ -11,4 +11,17 @@
  */
 int safe_resolve_path(const char *base, const char *reqpath, char *outbuf, size_t outlen);
 
+/* Like safe_resolve_path() for a file that may not exist yet (an upload):
+ * the path must name a file whose directory exists and resolves to base or
+ * below it. Returns 0 on success, -1 on error. */
+int safe_resolve_new_path(const char *base, const char *reqpath, char *outbuf, size_t outlen);
+
+/* The docroot-relative path safe_resolve_path() would look up: "/" becomes
+ * "/index.html", percent escapes are decoded and "." / ".." collapsed.
+ * Returns 0 on success, -1 if the path leaves the root or does not fit. */
+int normalize_request_path(const char *reqpath, char *outbuf, size_t outlen);
+
+/* Content-Type for a file name, by extension. */
+const char *mime_type_for_path(const char *path);
+
 #endif
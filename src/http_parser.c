@@ -28,6 +28,7 @@ void http_parser_init(http_parser_t *p) {
 int http_parser_execute(http_parser_t *p, const char *data, size_t len, size_t *consumed) {
     *consumed = 0;
     if (p->buflen + len >= sizeof(p->buf)) return -1;
+    size_t prev = p->buflen;
     memcpy(p->buf + p->buflen, data, len);
     p->buflen += len;
     p->buf[p->buflen] = '\0';
@@ -42,7 +43,9 @@ int http_parser_execute(http_parser_t *p, const char *data, size_t len, size_t *
 
     // Do not write into buffer at pos yet; hdr_end marks end of headers
     size_t hdr_len = (pos - p->buf) + 4;
-    *consumed = hdr_len;
+    // only count bytes from this call: earlier calls already reported theirs,
+    // anything after the header block (body, pipelined request) is left to the caller
+    *consumed = hdr_len - prev;
 
     // parse request-line using the CRLF that ends the first line
     char *line_end = strstr(p->buf, "\r\n");
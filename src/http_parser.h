@@ -27,7 +27,8 @@ void http_parser_destroy(http_parser_t *p);
 /*
  * Feed data into the parser incrementally.
  * - data/len: incoming bytes
- * - consumed: out param set to number of bytes consumed from the input
+ * - consumed: out param set to number of bytes consumed from the input; once
+ *   the header block is complete, bytes after it are not consumed
  * Returns:
  *  0 => need more data
  *  1 => request parsed successfully (headers complete)
@@ -0,0 +1,159 @@
+#define _GNU_SOURCE
+#include "iopool.h"
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+struct iopool_s {
+    pthread_mutex_t lock;
+    pthread_cond_t ready;
+    io_job_t *head, *tail; /* queued jobs, oldest first */
+    int stopping;
+    int nthreads;
+    pthread_t threads[];
+};
+
+/* Only the first job of a batch wakes the loop: a non-empty list is
+ * already signalled. */
+void iopool_complete(io_job_t *job) {
+    worker_t *w = job->w;
+    pthread_mutex_lock(&w->io_lock);
+    int wake = !w->io_done;
+    job->next = w->io_done;
+    w->io_done = job;
+    pthread_mutex_unlock(&w->io_lock);
+    uint64_t one = 1;
+    if (wake && write(w->notify.fd, &one, sizeof(one)) < 0) perror("io notify");
+}
+
+static void *pool_main(void *arg) {
+    iopool_t *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->head && !pool->stopping) pthread_cond_wait(&pool->ready, &pool->lock);
+        io_job_t *job = pool->head;
+        if (!job) break;
+        pool->head = job->next;
+        if (!pool->head) pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+        job->run(job);
+        iopool_complete(job);
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+iopool_t *iopool_new(int threads) {
+    iopool_t *pool = calloc(1, sizeof(*pool) + (size_t)threads * sizeof(pthread_t));
+    if (!pool) return NULL;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->ready, NULL);
+    /* signals stay with the main thread */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    for (int i = 0; i < threads; ++i) {
+        if (pthread_create(&pool->threads[i], NULL, pool_main, pool) != 0) break;
+        pool->nthreads++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if (pool->nthreads < threads) {
+        iopool_free(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void iopool_free(iopool_t *pool) {
+    if (!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->nthreads; ++i) pthread_join(pool->threads[i], NULL);
+    pthread_cond_destroy(&pool->ready);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+void iopool_park(worker_t *w, connection_t *c, io_job_t *job) {
+    job->w = w;
+    job->conn = c;
+    job->next = NULL;
+    if (!c) return;
+    c->io = job;
+    /* nothing is read until the request is answered; a hangup still shows */
+    c->read_paused = 1;
+    conn_update_events(w, c);
+}
+
+void iopool_submit(iopool_t *pool, worker_t *w, connection_t *c, io_job_t *job) {
+    iopool_park(w, c, job);
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail) pool->tail->next = job;
+    else pool->head = job;
+    pool->tail = job;
+    pthread_cond_signal(&pool->ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int iopool_worker_init(worker_t *w) {
+    w->io_done = NULL;
+    return pthread_mutex_init(&w->io_lock, NULL) == 0 ? 0 : -1;
+}
+
+void iopool_worker_notified(worker_t *w) {
+    pthread_mutex_lock(&w->io_lock);
+    io_job_t *list = w->io_done;
+    w->io_done = NULL;
+    pthread_mutex_unlock(&w->io_lock);
+    /* the list is newest first */
+    io_job_t *batch = NULL;
+    while (list) {
+        io_job_t *next = list->next;
+        list->next = batch;
+        batch = list;
+        list = next;
+    }
+    while (batch) {
+        io_job_t *job = batch;
+        batch = job->next;
+        connection_t *c = job->conn;
+        if (c) {
+            c->io = NULL;
+            c->read_paused = 0;
+            conn_update_events(w, c);
+        }
+        job->done(w, job);
+    }
+}
+
+void iopool_cancel(worker_t *w, connection_t *c) {
+    (void)w;
+    /* job->conn is only ever read by the worker, so no lock is needed */
+    c->io->conn = NULL;
+    c->io = NULL;
+}
+
+int iopool_worker_drain(worker_t *w) {
+    pthread_mutex_lock(&w->io_lock);
+    io_job_t *job = w->io_done;
+    w->io_done = NULL;
+    pthread_mutex_unlock(&w->io_lock);
+    int n = 0;
+    while (job) {
+        io_job_t *next = job->next;
+        job->conn = NULL;
+        job->done(w, job);
+        job = next;
+        n++;
+    }
+    return n;
+}
+
+void iopool_worker_shutdown(worker_t *w) {
+    iopool_worker_drain(w);
+    pthread_mutex_destroy(&w->io_lock);
+}
@@ -0,0 +1,70 @@
+#ifndef IOPOOL_H
+#define IOPOOL_H
+
+#include "conn.h"
+
+/*
+ * Blocking I/O off the event loop. open(), stat(), realpath() and read() on
+ * a cold page cache or a network filesystem can take milliseconds, and a loop
+ * that makes them stalls every connection it owns. Such work is packaged as a
+ * job and run by a fixed set of threads shared by all workers. Meanwhile the
+ * connection is parked: it is not read, and its request is not finished.
+ * Finished jobs go back to the worker that submitted them through a per-worker
+ * list and its notify eventfd, and the worker answers the request.
+ *
+ * A connection has at most one job in flight, so the queue is bounded by the
+ * number of open connections.
+ */
+
+typedef struct iopool_s iopool_t;
+
+typedef struct io_job_s {
+    /* runs on a pool thread; must not touch the connection or the worker */
+    void (*run)(struct io_job_s *job);
+    /* runs on the submitting worker once run() returned, and frees the job;
+     * conn is NULL if the connection was closed meanwhile */
+    void (*done)(worker_t *w, struct io_job_s *job);
+    worker_t *w;
+    connection_t *conn;
+    struct io_job_s *next;
+} io_job_t;
+
+/* Start threads (signals blocked in them). Returns NULL on failure. */
+iopool_t *iopool_new(int threads);
+
+/* Run whatever is still queued, then stop and join the threads. */
+void iopool_free(iopool_t *pool);
+
+/* Park c on job (c->io set, reading paused) and queue the job. job->run and
+ * job->done must be set. c may be NULL for work no request waits for. */
+void iopool_submit(iopool_t *pool, worker_t *w, connection_t *c, io_job_t *job);
+
+/* Park c on a job completed by something other than the pool (only
+ * job->done is used): whoever finishes it calls iopool_complete(), from any
+ * thread. */
+void iopool_park(worker_t *w, connection_t *c, io_job_t *job);
+
+/* Hand a finished job back to its worker. */
+void iopool_complete(io_job_t *job);
+
+/* Per-worker completion list. Returns 0/-1. */
+int iopool_worker_init(worker_t *w);
+
+/* Call done() for the jobs finished for this worker, oldest first. The
+ * connection is unparked before its done() runs. */
+void iopool_worker_notified(worker_t *w);
+
+/* The connection parked on a job is being closed: the job completes without
+ * it. */
+void iopool_cancel(worker_t *w, connection_t *c);
+
+/* Drop jobs still waiting for a worker that has stopped (after
+ * iopool_free()). Their done() may complete jobs for other workers, so this
+ * is repeated over all workers until none has any left. Returns the number
+ * dropped. */
+int iopool_worker_drain(worker_t *w);
+
+/* Drain, and release the completion list. */
+void iopool_worker_shutdown(worker_t *w);
+
+#endif
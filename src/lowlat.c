@@ -0,0 +1,55 @@
+#define _GNU_SOURCE
+#include "lowlat.h"
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+/* from linux/eventpoll.h, missing in older uapi headers */
+#ifndef EPIOCSPARAMS
+struct epoll_params {
+    uint32_t busy_poll_usecs;
+    uint16_t busy_poll_budget;
+    uint8_t prefer_busy_poll;
+    uint8_t __pad;
+};
+#define EPIOCSPARAMS _IOW(0x8A, 0x01, struct epoll_params)
+#endif
+
+int lowlat_pin_thread(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        errno = rc;
+        return -1;
+    }
+    return 0;
+}
+
+int lowlat_steer_listener(int fd, int cpu) {
+    return setsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, sizeof(cpu));
+}
+
+int lowlat_socket_busy_poll(int fd, int usec) {
+    int one = 1;
+    /* values above net.core.busy_read need CAP_NET_ADMIN */
+    if (setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &usec, sizeof(usec)) < 0) return -1;
+    /* keep the device IRQ quiet while the application polls */
+    return setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &one, sizeof(one));
+}
+
+int lowlat_epoll_busy_poll(int epfd, int usec) {
+    struct epoll_params p = { 0 };
+    p.busy_poll_usecs = (uint32_t)usec;
+    p.busy_poll_budget = 8; /* packets per poll; more needs CAP_NET_ADMIN */
+    p.prefer_busy_poll = 1;
+    return ioctl(epfd, EPIOCSPARAMS, &p);
+}
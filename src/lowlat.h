@@ -0,0 +1,24 @@
+#ifndef LOWLAT_H
+#define LOWLAT_H
+
+/*
+ * Low-latency mode helpers. Every call is best effort: a kernel or
+ * privilege level that lacks a feature leaves the server in the default
+ * mode. Each returns 0 on success, -1 with errno set.
+ */
+
+/* Pin the calling thread to cpu. */
+int lowlat_pin_thread(int cpu);
+
+/* Ask the kernel to deliver connections whose packets arrive on cpu to
+ * this SO_REUSEPORT listener (Linux 6.2+ honours this across the group). */
+int lowlat_steer_listener(int fd, int cpu);
+
+/* Let blocking socket calls busy-poll the device queue for usec before
+ * sleeping. Accepted sockets inherit the setting from the listener. */
+int lowlat_socket_busy_poll(int fd, int usec);
+
+/* Enable kernel busy polling in epoll_wait() on epfd (Linux 6.9+). */
+int lowlat_epoll_busy_poll(int epfd, int usec);
+
+#endif
@@ -1,48 +1,62 @@
 // Minimal epoll-based non-blocking HTTP server (toy)
 #define _GNU_SOURCE
 #include <arpa/inet.h>
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include "config.h"
+#include "conn.h"
 #include "http_parser.h"
 #include "fsutils.h"
+#include "iopool.h"
+#include "lowlat.h"
+#include "microcache.h"
+#include "proxy.h"
+#include "ratelimit.h"
+#include "sse.h"
+#include "upgrade.h"
+#include "upload.h"
+#include "ws.h"
 #include <signal.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <limits.h>
+#include <stddef.h>
+#include <time.h>
 
-typedef struct connection_s {
-    int fd;
-    http_parser_t parser;
-    char buf[8192];
-    size_t buflen;
-    /* outgoing write buffer for partial writes */
-    char *wbuf;
-    size_t wlen; /* total length of wbuf */
-    size_t woff; /* bytes already written */
-    int should_close; /* close after write completes */
-} connection_t;
-
+/* signals are only delivered to the main thread, see start_workers() */
 static volatile sig_atomic_t running = 1;
+static volatile sig_atomic_t upgrade_requested = 0;
+static volatile sig_atomic_t dump_requested = 0;
 
 static void handle_sigint(int sig) {
     (void)sig;
     running = 0;
 }
 
-static const char *response =
-    "HTTP/1.1 200 OK\r\n"
-    "Content-Type: text/plain; charset=utf-8\r\n"
-    "Content-Length: 13\r\n"
-    "Connection: close\r\n"
-    "\r\n"
-    "Hello, world!";
+/* SIGUSR2 (new binary) and SIGHUP (new config) both re-exec the binary */
+static void handle_upgrade(int sig) {
+    (void)sig;
+    upgrade_requested = 1;
+}
+
+/* SIGUSR1 dumps the flight recorders to the log */
+static void handle_dump(int sig) {
+    (void)sig;
+    dump_requested = 1;
+}
+
+static const char *response = "Hello, world!";
 
 static int set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
@@ -51,416 +65,1435 @@ static int set_nonblocking(int fd) {
     return 0;
 }
 
-/* Simple MIME mapping based on file extension */
-static const char *mime_type_for_path(const char *path) {
-    const char *ext = strrchr(path, '.');
-    if (!ext) return "text/plain; charset=utf-8";
-    if (strcmp(ext, ".html") == 0 || strcmp(ext, ".htm") == 0) return "text/html; charset=utf-8";
-    if (strcmp(ext, ".css") == 0) return "text/css; charset=utf-8";
-    if (strcmp(ext, ".js") == 0) return "application/javascript";
-    if (strcmp(ext, ".png") == 0) return "image/png";
-    if (strcmp(ext, ".jpg") == 0 || strcmp(ext, ".jpeg") == 0) return "image/jpeg";
-    if (strcmp(ext, ".gif") == 0) return "image/gif";
-    return "application/octet-stream";
+/* path resolution and MIME types moved to src/fsutils.c */
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-/* path resolution moved to src/fsutils.c */
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-int main(void) {
-    // open simple logfile
-    FILE *logf = fopen("server.log", "a");
-    if (!logf) logf = stderr;
+/* ---- request phase tracing ---- */
 
-    // handle signals for graceful shutdown
-    signal(SIGINT, handle_sigint);
-    signal(SIGTERM, handle_sigint);
-    /* avoid SIGPIPE killing the process on write to closed socket */
-    signal(SIGPIPE, SIG_IGN);
-    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+static inline int tracing(const worker_t *w) {
+    return w->trace.cap != 0;
+}
+
+static inline void trace_mark(worker_t *w, connection_t *conn, int phase) {
+    if (tracing(w)) conn->trace.t[phase] = trace_now();
+}
+
+/* The request has been answered. It goes into the flight recorder now if
+ * the response went out whole, otherwise once the write queue drains. */
+static void trace_answered(worker_t *w, connection_t *conn) {
+    TRACE_PROBE2(queued, conn->fd, conn->wlen - conn->woff);
+    if (!tracing(w)) return;
+    uint64_t now = trace_now();
+    /* a pipelined response queued behind it: record the older one as is */
+    if (conn->trace_out_pending) trace_ring_push(&w->trace, &conn->trace_out);
+    conn->trace_out_pending = 0;
+    conn->trace.fd = conn->fd;
+    /* local responses were stamped when sent; a proxied one ends here */
+    if (!conn->trace.t[TRACE_QUEUED]) conn->trace.t[TRACE_QUEUED] = now;
+    if (conn->woff == conn->wlen) {
+        /* written by the same send */
+        conn->trace.t[TRACE_FLUSHED] = conn->trace.t[TRACE_QUEUED];
+        trace_ring_push(&w->trace, &conn->trace);
+    } else {
+        conn->trace_out = conn->trace;
+        conn->trace_out_pending = 1;
+    }
+    memset(&conn->trace, 0, sizeof(conn->trace));
+    /* bytes already buffered belong to the next request */
+    if (conn->buflen) conn->trace.t[TRACE_FIRST_BYTE] = conn->t_last_read;
+}
+
+/* The write queue drained: a response held back by backpressure is done. */
+static void trace_flushed(worker_t *w, connection_t *conn) {
+    TRACE_PROBE1(flushed, conn->fd);
+    if (!conn->trace_out_pending) return;
+    conn->trace_out.t[TRACE_FLUSHED] = trace_now();
+    trace_ring_push(&w->trace, &conn->trace_out);
+    conn->trace_out_pending = 0;
+}
+
+/* Send a response header followed by its body. Returns 0/-1 like conn_send. */
+static int send_response(worker_t *w, connection_t *conn, const char *ctype, const char *body, size_t len) {
+    char hdr[256];
+    const char *connval = conn->should_close ? "close" : "keep-alive";
+    int hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n", ctype, len, connval);
+    struct iovec iov[2] = { { hdr, (size_t)hlen }, { (void *)body, len } };
+    trace_mark(w, conn, TRACE_QUEUED);
+    return conn_sendv(w, conn, iov, 2);
+}
+
+static const char *request_header(connection_t *conn, const char *name) {
+    int hcount = http_parser_header_count(&conn->parser);
+    for (int i = 0; i < hcount; ++i) {
+        const char *hn = http_parser_header_name(&conn->parser, i);
+        if (hn && strcasecmp(hn, name) == 0) return http_parser_header_value(&conn->parser, i);
+    }
+    return NULL;
+}
+
+/* Serve from the mapped archive: one hash lookup, no filesystem calls, and
+ * the head and body go out straight from the shared mapping. Same return
+ * values as serve_static(). */
+static int serve_packed(worker_t *w, connection_t *conn, const char *path) {
+    const pack_t *pack = &w->srv->pack;
+    char key[PATH_MAX];
+    if (normalize_request_path(path, key, sizeof(key)) != 0) return 0;
+    const pack_entry_t *e = pack_lookup(pack, key, strlen(key));
+    if (!e) return 0;
+    trace_mark(w, conn, TRACE_RESOLVED);
+    TRACE_PROBE2(resolved, conn->fd, key);
+    const char *connval = conn->should_close ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+    const char *inm = request_header(conn, "If-None-Match");
+    if (inm && strlen(inm) == e->etag_len && memcmp(inm, pack_ptr(pack, e->etag_off), e->etag_len) == 0) {
+        static const char nm[] = "HTTP/1.1 304 Not Modified\r\nETag: ";
+        struct iovec iov[4] = { { (void *)nm, sizeof(nm) - 1 },
+                                { (void *)pack_ptr(pack, e->etag_off), e->etag_len },
+                                { "\r\n", 2 },
+                                { (void *)connval, strlen(connval) } };
+        trace_mark(w, conn, TRACE_QUEUED);
+        return conn_sendv(w, conn, iov, 4) < 0 ? -1 : 1;
+    }
+    struct iovec iov[3] = { { (void *)pack_ptr(pack, e->head_off), e->head_len },
+                            { (void *)connval, strlen(connval) },
+                            { (void *)pack_ptr(pack, e->body_off), (size_t)e->body_len } };
+    trace_mark(w, conn, TRACE_QUEUED);
+    return conn_sendv(w, conn, iov, 3) < 0 ? -1 : 1;
+}
+
+/*
+ * The blocking half of serving a regular file below the docroot: resolve the
+ * path, stat the file and read it whole. Runs on an I/O thread, or on the
+ * loop itself with -j 0.
+ */
+typedef struct file_load_s {
+    char fullpath[PATH_MAX];
+    int resolved;
+    char *body; /* the file's contents, NULL if there is no such file */
+    size_t len;
+    uint64_t t_resolved, t_io; /* trace_now() stamps, taken when stamp is set */
+} file_load_t;
+
+static void load_file(const char *docroot, const char *path, int stamp, file_load_t *f) {
+    f->resolved = 0;
+    f->body = NULL;
+    f->len = 0;
+    if (safe_resolve_path(docroot, path, f->fullpath, sizeof(f->fullpath)) != 0) return;
+    f->resolved = 1;
+    if (stamp) f->t_resolved = trace_now();
+    struct stat st;
+    if (stat(f->fullpath, &st) != 0 || !S_ISREG(st.st_mode)) return;
+    FILE *fp = fopen(f->fullpath, "rb");
+    if (!fp) return;
+    size_t sz = (size_t)st.st_size;
+    char *buf = malloc(sz ? sz : 1);
+    if (buf && fread(buf, 1, sz, fp) == sz) {
+        f->body = buf;
+        f->len = sz;
+        if (stamp) f->t_io = trace_now();
+    } else {
+        free(buf);
+    }
+    fclose(fp);
+}
+
+/* Send what load_file() found. Same return values as serve_static(). */
+static int send_file(worker_t *w, connection_t *conn, const file_load_t *f) {
+    if (!f->resolved) return 0;
+    if (tracing(w)) conn->trace.t[TRACE_RESOLVED] = f->t_resolved;
+    TRACE_PROBE2(resolved, conn->fd, f->fullpath);
+    if (!f->body) return 0;
+    if (tracing(w)) conn->trace.t[TRACE_IO] = f->t_io;
+    TRACE_PROBE2(io, conn->fd, f->len);
+    return send_response(w, conn, mime_type_for_path(f->fullpath), f->body, f->len) < 0 ? -1 : 1;
+}
+
+/* Serve a regular file below the docroot. Returns 1 if served, 0 if there is
+ * no such file, -1 on a fatal send error. */
+static int serve_static(worker_t *w, connection_t *conn, const char *path) {
+    if (w->srv->pack.base) return serve_packed(w, conn, path);
+    file_load_t f;
+    load_file(w->cfg->docroot, path, tracing(w), &f);
+    int rc = send_file(w, conn, &f);
+    free(f.body);
+    return rc;
+}
+
+#define STAT(x) atomic_load_explicit(&(x), memory_order_relaxed)
+#define STAT_INC(x) atomic_fetch_add_explicit(&(x), 1, memory_order_relaxed)
+
+/* Plain-text admission counters: totals, then one line per worker. */
+static int send_status(worker_t *w, connection_t *conn) {
+    server_t *srv = w->srv;
+    char body[4096];
+    unsigned long acc = 0, req = 0, shed = 0, thr = 0, pauses = 0, io = 0;
+    long lag = 0;
+    for (int i = 0; i < srv->nworkers; ++i) {
+        worker_stats_t *st = &srv->workers[i].stats;
+        acc += STAT(st->accepted);
+        req += STAT(st->requests);
+        shed += STAT(st->shed);
+        thr += STAT(st->throttled);
+        pauses += STAT(st->accept_pauses);
+        io += STAT(st->io_jobs);
+        if (STAT(st->loop_lag_max_us) > lag) lag = STAT(st->loop_lag_max_us);
+    }
+    int off = snprintf(body, sizeof(body),
+                       "connections %ld\naccepted %lu\nrequests %lu\nshed %lu\nthrottled %lu\naccept_pauses %lu\n"
+                       "io_jobs %lu\nloop_lag_max_us %ld\n",
+                       atomic_load(&srv->conn_count), acc, req, shed, thr, pauses, io, lag);
+    for (int i = 0; i < srv->nworkers && off < (int)sizeof(body); ++i) {
+        worker_stats_t *st = &srv->workers[i].stats;
+        off += snprintf(body + off, sizeof(body) - (size_t)off,
+                        "worker %d accepted %lu requests %lu shed %lu throttled %lu io_jobs %lu loop_lag_max_us %ld\n",
+                        i, STAT(st->accepted), STAT(st->requests), STAT(st->shed), STAT(st->throttled),
+                        STAT(st->io_jobs), STAT(st->loop_lag_max_us));
+    }
+    if (srv->cache && off < (int)sizeof(body)) {
+        mc_stats_t cs;
+        microcache_stats(srv->cache, &cs);
+        off += snprintf(body + off, sizeof(body) - (size_t)off,
+                        "cache_hits %lu\ncache_stale %lu\ncache_misses %lu\ncache_coalesced %lu\ncache_refreshes %lu\n",
+                        cs.hits, cs.stale, cs.misses, cs.coalesced, cs.refreshes);
+    }
+    if (off > (int)sizeof(body)) off = (int)sizeof(body);
+    return send_response(w, conn, "text/plain; charset=utf-8", body, (size_t)off);
+}
+
+/* Every worker's flight recorder, oldest request first. */
+static int send_trace(worker_t *w, connection_t *conn) {
+    server_t *srv = w->srv;
+    char *body = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&body, &len);
+    if (!f) return -1;
+    if (!tracing(w)) fprintf(f, "tracing is off (-T)\n");
+    for (int i = 0; i < srv->nworkers; ++i) trace_ring_dump(&srv->workers[i].trace, i, f);
+    fclose(f);
+    int rc = send_response(w, conn, "text/plain; charset=utf-8", body, len);
+    free(body);
+    return rc;
+}
+
+static int send_throttled(worker_t *w, connection_t *conn) {
+    char hdr[160];
+    int hlen = snprintf(hdr, sizeof(hdr),
+                        "HTTP/1.1 429 Too Many Requests\r\nRetry-After: %d\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                        w->cfg->retry_after, conn->should_close ? "close" : "keep-alive");
+    trace_mark(w, conn, TRACE_QUEUED);
+    return conn_send(w, conn, hdr, (size_t)hlen);
+}
+
+/* ---- generated responses and the micro-cache ---- */
+
+/*
+ * The response for requests nothing else answers. It stands in for real
+ * handlers and, like them, may take a while (cfg->fallback_delay_us) and
+ * vary on request headers (cfg->fallback_vary). It is
+ * rendered without its Connection line so it can be cached, and is safe to
+ * call from any thread. Returns NULL if out of memory.
+ */
+static shared_buf_t *render_fallback(const server_config_t *cfg, size_t *head_len) {
+    if (cfg->fallback_delay_us) {
+        struct timespec ts = { cfg->fallback_delay_us / 1000000, (cfg->fallback_delay_us % 1000000) * 1000L };
+        nanosleep(&ts, NULL);
+    }
+    char head[256];
+    size_t len = strlen(response);
+    int hlen = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Length: %zu\r\n%s%s%s", len,
+                        cfg->fallback_vary ? "Vary: " : "", cfg->fallback_vary ? cfg->fallback_vary : "",
+                        cfg->fallback_vary ? "\r\n" : "");
+    shared_buf_t *b = shared_buf_new(NULL, (size_t)hlen + len);
+    if (!b) return NULL;
+    memcpy(b->data, head, (size_t)hlen);
+    memcpy(b->data + hlen, response, len);
+    *head_len = (size_t)hlen;
+    return b;
+}
+
+/* Send a rendered response, adding the Connection line. Returns 1, or -1 on
+ * a fatal send error. */
+static int send_rendered(worker_t *w, connection_t *conn, const shared_buf_t *b, size_t head_len) {
+    const char *connval = conn->should_close ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+    struct iovec iov[3] = { { (void *)b->data, head_len },
+                            { (void *)connval, strlen(connval) },
+                            { (void *)(b->data + head_len), b->len - head_len } };
+    trace_mark(w, conn, TRACE_QUEUED);
+    return conn_sendv(w, conn, iov, 3) < 0 ? -1 : 1;
+}
+
+static void log_served(worker_t *w, connection_t *conn) {
+    fprintf(w->logf, "served fd=%d %s %s\n", conn->fd, http_parser_method(&conn->parser) ?: "",
+            http_parser_path(&conn->parser) ?: "/");
+    fflush(w->logf);
+}
+
+static const char *cache_header(void *arg, const char *name) {
+    return request_header(arg, name);
+}
+
+static void cache_request(connection_t *conn, mc_request_t *req) {
+    req->method = http_parser_method(&conn->parser) ?: "";
+    req->path = http_parser_path(&conn->parser) ?: "/";
+    req->header = cache_header;
+    req->arg = conn;
+}
+
+/* The Vary lines of a rendered response head, joined with commas into buf;
+ * NULL if there are none, "*" (never stored) if they do not fit. */
+static const char *rendered_vary(const shared_buf_t *b, size_t head_len, char *buf, size_t size) {
+    const char *p = b->data, *end = b->data + head_len;
+    size_t o = 0;
+    while (p < end) {
+        const char *eol = memchr(p, '\n', (size_t)(end - p));
+        if (!eol) eol = end;
+        if (eol - p > 5 && strncasecmp(p, "Vary:", 5) == 0) {
+            const char *v = p + 5, *ve = eol;
+            while (v < ve && (*v == ' ' || *v == '\t')) ++v;
+            while (ve > v && (ve[-1] == '\r' || ve[-1] == ' ' || ve[-1] == '\t')) --ve;
+            if (o + (o ? 1 : 0) + (size_t)(ve - v) >= size) return "*";
+            if (o) buf[o++] = ',';
+            memcpy(buf + o, v, (size_t)(ve - v));
+            o += (size_t)(ve - v);
+        }
+        p = eol + 1;
+    }
+    if (!o) return NULL;
+    buf[o] = '\0';
+    return buf;
+}
+
+/* Store a rendered response in the cache entry being filled, then answer
+ * conn with it; either may be NULL. Takes over resp. Returns 1, or -1 if
+ * conn must be dropped. */
+static int finish_fallback(worker_t *w, connection_t *conn, mc_fill_t *fill, shared_buf_t *resp, size_t head_len) {
+    if (fill) {
+        mc_request_t req;
+        char buf[256];
+        const char *vary = resp ? rendered_vary(resp, head_len, buf, sizeof(buf)) : NULL;
+        if (conn) cache_request(conn, &req);
+        microcache_fill(w->srv->cache, fill, conn ? &req : NULL, vary, resp, head_len, now_ms());
+    }
+    int r = 1;
+    if (conn) {
+        r = resp ? send_rendered(w, conn, resp, head_len) : -1;
+        if (r > 0) log_served(w, conn);
+    }
+    if (resp) shared_buf_unref(resp);
+    return r;
+}
+
+static void request_finished(worker_t *w, connection_t *conn);
+
+/* A cache fill rendered by the I/O threads, for the request that missed
+ * (parked meanwhile) or in the background for a stale entry (conn NULL). */
+typedef struct fill_job_s {
+    io_job_t io;
+    const server_config_t *cfg;
+    mc_fill_t *fill;
+    shared_buf_t *resp;
+    size_t head_len;
+} fill_job_t;
+
+static void fill_job_run(io_job_t *io) {
+    fill_job_t *job = (fill_job_t *)io;
+    job->resp = render_fallback(job->cfg, &job->head_len);
+}
+
+static void fill_job_done(worker_t *w, io_job_t *io) {
+    fill_job_t *job = (fill_job_t *)io;
+    connection_t *conn = io->conn;
+    int r = finish_fallback(w, conn, job->fill, job->resp, job->head_len);
+    if (conn) {
+        if (r < 0) conn_close(w, conn);
+        else request_finished(w, conn);
+    }
+    free(job);
+}
+
+/* Render the response filling a cache entry, on the I/O threads if there
+ * are any. Returns like handle_request(). */
+static int start_fill(worker_t *w, connection_t *conn, mc_fill_t *fill) {
+    if (w->srv->iopool) {
+        fill_job_t *job = malloc(sizeof(*job));
+        if (!job) return finish_fallback(w, conn, fill, NULL, 0);
+        job->io.run = fill_job_run;
+        job->io.done = fill_job_done;
+        job->cfg = w->cfg;
+        job->fill = fill;
+        job->resp = NULL;
+        iopool_submit(w->srv->iopool, w, conn, &job->io);
+        return 0;
+    }
+    size_t head_len = 0;
+    shared_buf_t *resp = render_fallback(w->cfg, &head_len);
+    return finish_fallback(w, conn, fill, resp, head_len);
+}
+
+/* A GET parked behind someone else's fill of its cache entry. */
+typedef struct cache_wait_s {
+    io_job_t io;
+    mc_waiter_t waiter;
+} cache_wait_t;
+
+static void cache_wait_wake(mc_waiter_t *waiter) {
+    cache_wait_t *cw = (cache_wait_t *)((char *)waiter - offsetof(cache_wait_t, waiter));
+    iopool_complete(&cw->io);
+}
+
+static int serve_get(worker_t *w, connection_t *conn, int flags);
+
+static void cache_wait_done(worker_t *w, io_job_t *io) {
+    connection_t *conn = io->conn;
+    free(io);
+    if (!conn) return;
+    int r = serve_get(w, conn, MC_WOKEN);
+    if (r < 0) conn_close(w, conn);
+    else if (r > 0) request_finished(w, conn);
+}
+
+#define CACHE_MISS 2
+
+/*
+ * Answer a request from the micro-cache. Returns 1 if answered, 0 if parked
+ * behind a fill in flight, -1 if the connection must be dropped, CACHE_MISS
+ * otherwise. With MC_CLAIM in flags a missing entry is claimed and *fill
+ * set: the caller renders the response and fills it.
+ */
+static int cache_answer(worker_t *w, connection_t *conn, int flags, mc_fill_t **fill) {
+    microcache_t *mc = w->srv->cache;
+    mc_request_t req;
+    cache_request(conn, &req);
+    shared_buf_t *resp = NULL;
+    size_t head_len = 0;
+    mc_fill_t *claimed = NULL;
+    long long now = now_ms();
+    int rc = microcache_lookup(mc, &req, now, flags, NULL, &resp, &head_len, &claimed);
+    if (rc == MC_PENDING) {
+        cache_wait_t *cw = malloc(sizeof(*cw));
+        if (!cw) return -1;
+        cw->io.run = NULL;
+        cw->io.done = cache_wait_done;
+        cw->waiter.wake = cache_wait_wake;
+        /* parked first: the fill may complete on another thread right away */
+        iopool_park(w, conn, &cw->io);
+        rc = microcache_lookup(mc, &req, now, flags, &cw->waiter, &resp, &head_len, &claimed);
+        if (rc == MC_PENDING) return 0;
+        conn->io = NULL;
+        conn->read_paused = 0;
+        conn_update_events(w, conn);
+        free(cw);
+    }
+    if (rc == MC_MISS || rc == MC_UNCACHEABLE) {
+        if (fill) *fill = claimed;
+        return CACHE_MISS;
+    }
+    int r = send_rendered(w, conn, resp, head_len);
+    shared_buf_unref(resp);
+    if (r > 0) log_served(w, conn);
+    /* stale: this request also refreshes it, in the background */
+    if (claimed) start_fill(w, NULL, claimed);
+    return r;
+}
+
+/* Answer a request nobody else took: the static file if one was served,
+ * the generated response otherwise (cached if it is a GET). Returns like
+ * handle_request(); -1 also if served is -1. */
+static int answer_local(worker_t *w, connection_t *conn, int served) {
+    if (served < 0) return -1;
+    if (served) {
+        log_served(w, conn);
+        return 1;
+    }
+    if (w->srv->cache && strcmp(http_parser_method(&conn->parser) ?: "", "GET") == 0) {
+        mc_fill_t *fill = NULL;
+        int r = cache_answer(w, conn, MC_CLAIM, &fill);
+        if (r != CACHE_MISS) return r;
+        if (fill) return start_fill(w, conn, fill);
+    }
+    size_t head_len = 0;
+    shared_buf_t *resp = render_fallback(w->cfg, &head_len);
+    return finish_fallback(w, conn, NULL, resp, head_len);
+}
+
+static int start_file_job(worker_t *w, connection_t *conn, const char *path);
+
+/* A GET nobody else took: from the micro-cache, a static file or the
+ * generated response. flags go to the cache lookup. Returns like
+ * handle_request(). */
+static int serve_get(worker_t *w, connection_t *conn, int flags) {
+    const char *path = http_parser_path(&conn->parser) ?: "/";
+    if (w->srv->cache) {
+        int r = cache_answer(w, conn, flags, NULL);
+        if (r != CACHE_MISS) return r;
+    }
+    /* the archive needs no file system calls; anything else may block */
+    if (w->srv->iopool && !w->srv->pack.base && strlen(path) < PATH_MAX) return start_file_job(w, conn, path);
+    return answer_local(w, conn, serve_static(w, conn, path));
+}
+
+/* A request whose body buffer_body() left in the socket for the proxy or an
+ * upload is answered here instead: the body must not be parsed as the next request,
+ * so it is dropped and the connection closes after the response. */
+static void drop_unread_body(connection_t *conn) {
+    if (!conn->body_unread) return;
+    conn->should_close = 1;
+    conn->buflen = 0;
+}
+
+/*
+ * Handle one parsed request. Returns 1 if the request was answered, 0 if it
+ * was handed off (to the proxy, an upload or the I/O threads; the connection
+ * waits for it), -1 if the connection must be dropped.
+ */
+static int handle_request(worker_t *w, connection_t *conn) {
+    const char *method = http_parser_method(&conn->parser) ?: "";
+    const char *path = http_parser_path(&conn->parser) ?: "/";
+    /* determine whether the client requested to close the connection */
+    int req_close = 0;
+    const char *ver = http_parser_version(&conn->parser) ?: "";
+    int hcount = http_parser_header_count(&conn->parser);
+    for (int hi = 0; hi < hcount; ++hi) {
+        const char *hn = http_parser_header_name(&conn->parser, hi);
+        const char *hv = http_parser_header_value(&conn->parser, hi);
+        if (hn && hv && strcasecmp(hn, "Connection") == 0) {
+            if (strcasecmp(hv, "close") == 0) req_close = 1;
+            if (strcasecmp(hv, "keep-alive") == 0) req_close = 0;
+        }
+    }
+    /* HTTP/1.0 defaults to close unless 'Connection: keep-alive' present */
+    if (strncmp(ver, "HTTP/1.0", 8) == 0 && hcount == 0) req_close = 1;
+    /* set per-connection close flag according to request */
+    conn->should_close = req_close;
+    /* a draining process hands every client over to its successor */
+    if (w->draining) conn->should_close = 1;
+    STAT_INC(w->stats.requests);
+
+    /* before everything else: the status and trace pages are not free either */
+    if (w->srv->ratelimit && !ratelimit_allow(w->srv->ratelimit, conn->peer_addr, (uint64_t)now_ms())) {
+        STAT_INC(w->stats.throttled);
+        fprintf(w->logf, "throttled fd=%d %s %s\n", conn->fd, method, path);
+        fflush(w->logf);
+        drop_unread_body(conn);
+        return send_throttled(w, conn) < 0 ? -1 : 1;
+    }
+    if (w->cfg->status_path && strcmp(path, w->cfg->status_path) == 0) {
+        drop_unread_body(conn);
+        return send_status(w, conn) < 0 ? -1 : 1;
+    }
+    if (w->cfg->trace_path && strcmp(path, w->cfg->trace_path) == 0) {
+        drop_unread_body(conn);
+        return send_trace(w, conn) < 0 ? -1 : 1;
+    }
+
+    if (w->cfg->ws_path && config_path_match(w->cfg->ws_path, path)) {
+        fprintf(w->logf, "websocket fd=%d %s %s\n", conn->fd, method, path);
+        fflush(w->logf);
+        drop_unread_body(conn);
+        return ws_upgrade(w, conn, path) < 0 ? -1 : 1;
+    }
+    if (w->cfg->events_path && config_path_match(w->cfg->events_path, path)) {
+        fprintf(w->logf, "events fd=%d %s %s\n", conn->fd, method, path);
+        fflush(w->logf);
+        drop_unread_body(conn);
+        return sse_request(w, conn, path) < 0 ? -1 : 1;
+    }
+    if (w->cfg->upload_path && config_path_match(w->cfg->upload_path, path)) {
+        fprintf(w->logf, "upload fd=%d %s %s\n", conn->fd, method, path);
+        fflush(w->logf);
+        return upload_start(w, conn, path);
+    }
+
+    upstream_pool_t *pool = proxy_match(w, path);
+    if (pool) {
+        fprintf(w->logf, "proxy fd=%d %s %s -> %s:%u\n", conn->fd, method, path, pool->route->host,
+                (unsigned)pool->route->port);
+        fflush(w->logf);
+        int r = proxy_start(w, conn, pool);
+        if (conn->fd < 0) return -1;
+        return r;
+    }
+
+    // Serve static files for GET, otherwise respond with hello
+    if (strcmp(method, "GET") == 0) return serve_get(w, conn, 0);
+    return answer_local(w, conn, 0);
+}
+
+/* A static file read by the I/O threads while the connection was parked. */
+typedef struct file_job_s {
+    io_job_t io;
+    const server_config_t *cfg;
+    int stamp;
+    /* without a cache, a missing file gets the generated response rendered
+     * right here instead of on the loop */
+    int render;
+    char path[PATH_MAX];
+    file_load_t file;
+    shared_buf_t *resp;
+    size_t head_len;
+} file_job_t;
+
+static void file_job_run(io_job_t *io) {
+    file_job_t *job = (file_job_t *)io;
+    load_file(job->cfg->docroot, job->path, job->stamp, &job->file);
+    if (!job->file.body && job->render) job->resp = render_fallback(job->cfg, &job->head_len);
+}
+
+static void file_job_done(worker_t *w, io_job_t *io) {
+    file_job_t *job = (file_job_t *)io;
+    connection_t *conn = io->conn;
+    if (conn) {
+        int r, served = send_file(w, conn, &job->file);
+        if (served == 0 && job->resp) {
+            r = finish_fallback(w, conn, NULL, job->resp, job->head_len);
+            job->resp = NULL;
+        } else {
+            r = answer_local(w, conn, served);
+        }
+        if (r < 0) conn_close(w, conn);
+        else if (r > 0) request_finished(w, conn);
+    }
+    if (job->resp) shared_buf_unref(job->resp);
+    free(job->file.body);
+    free(job);
+}
+
+/* Park the connection while an I/O thread reads the file. Returns 0, or -1
+ * if out of memory. */
+static int start_file_job(worker_t *w, connection_t *conn, const char *path) {
+    file_job_t *job = malloc(sizeof(*job));
+    if (!job) return -1;
+    job->io.run = file_job_run;
+    job->io.done = file_job_done;
+    job->cfg = w->cfg;
+    job->stamp = tracing(w);
+    job->render = !w->srv->cache;
+    job->resp = NULL;
+    /* the parser's copy must not be read from another thread */
+    strcpy(job->path, path);
+    STAT_INC(w->stats.io_jobs);
+    iopool_submit(w->srv->iopool, w, conn, &job->io);
+    return 0;
+}
+
+/* Does the request announce a body? */
+static int request_has_body(connection_t *conn) {
+    if (request_header(conn, "Transfer-Encoding")) return 1;
+    const char *cl = request_header(conn, "Content-Length");
+    return cl && strspn(cl, "0") != strlen(cl);
+}
+
+/* Refuse a request body we will not read; the connection closes after it. */
+static int refuse_body(worker_t *w, connection_t *conn, const char *status) {
+    char resp[128];
+    int n = snprintf(resp, sizeof(resp), "HTTP/1.1 %s\r\nConnection: close\r\nContent-Length: 0\r\n\r\n", status);
+    conn->should_close = 1;
+    conn->buflen = 0;
+    fprintf(w->logf, "refused body fd=%d: %s\n", conn->fd, status);
+    fflush(w->logf);
+    if (conn_send(w, conn, resp, (size_t)n) < 0) conn_close(w, conn);
+    return -1;
+}
+
+/*
+ * A locally handled request may carry a body (an event published with POST).
+ * Wait until all of it is buffered behind the header block, so the handler
+ * finds it at the start of conn->buf and it is never parsed as the next
+ * request. Proxied requests and uploads are left alone: their handlers
+ * stream the body themselves, and conn->body_unread marks a body left in
+ * the socket in case the request is answered before reaching them.
+ * Returns 1 once conn->body_len bytes are ready, 0 while more are needed, -1
+ * if the request was refused.
+ */
+static int buffer_body(worker_t *w, connection_t *conn) {
+    if (!conn->awaiting_body) {
+        conn->awaiting_body = 1;
+        conn->body_len = 0;
+        conn->body_unread = 0;
+        const char *path = http_parser_path(&conn->parser) ?: "/";
+        if (proxy_match(w, path)) {
+            conn->body_unread = request_has_body(conn);
+            return 1;
+        }
+        const char *method = http_parser_method(&conn->parser) ?: "";
+        if (w->cfg->upload_path && config_path_match(w->cfg->upload_path, path) &&
+            (strcmp(method, "PUT") == 0 || strcmp(method, "POST") == 0)) {
+            conn->body_unread = request_has_body(conn);
+            return 1;
+        }
+        if (request_header(conn, "Transfer-Encoding")) return refuse_body(w, conn, "411 Length Required");
+        const char *cl = request_header(conn, "Content-Length");
+        if (cl) {
+            char *end;
+            errno = 0;
+            unsigned long long v = strtoull(cl, &end, 10);
+            if (!isdigit((unsigned char)*cl) || *end || errno) return refuse_body(w, conn, "400 Bad Request");
+            /* the body has to fit the connection buffer */
+            if (v > sizeof(conn->buf) - 1) return refuse_body(w, conn, "413 Content Too Large");
+            conn->body_len = (size_t)v;
+        }
+        const char *expect = request_header(conn, "Expect");
+        if (conn->buflen < conn->body_len && expect && strcasecmp(expect, "100-continue") == 0) {
+            const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+            if (conn_send(w, conn, cont, strlen(cont)) < 0) {
+                conn_close(w, conn);
+                return -1;
+            }
+        }
+    }
+    return conn->buflen >= conn->body_len;
+}
+
+/*
+ * Parse and answer every complete request buffered on the connection
+ * (pipelined requests are handled in order). Stops while a proxied exchange
+ * or an upload is in flight, and while an earlier response is still queued:
+ * reading pauses until it is written, so a client that pipelines requests
+ * without reading the responses holds one of them, not all. May close the
+ * connection.
+ */
+static void process_input(worker_t *w, connection_t *conn) {
+    while (conn->fd >= 0 && !conn->proxy && !conn->upload && !conn->io && !conn->should_close && conn->buflen > 0) {
+        if (!conn->awaiting_body && conn_pending(conn)) {
+            conn->read_paused = 1;
+            conn_update_events(w, conn);
+            return;
+        }
+        if (!conn->awaiting_body) {
+            size_t room = sizeof(conn->parser.buf) - 1 - conn->parser.buflen;
+            size_t feed = conn->buflen < room ? conn->buflen : room;
+            size_t consumed = 0;
+            int pres = feed ? http_parser_execute(&conn->parser, conn->buf, feed, &consumed) : -1;
+            // Remove consumed bytes from buffer
+            if (consumed > 0 && consumed <= conn->buflen) {
+                memmove(conn->buf, conn->buf + consumed, conn->buflen - consumed);
+                conn->buflen -= consumed;
+            }
+            if (pres == 0) continue;
+            if (pres == -1) {
+                const char *err = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+                conn->should_close = 1;
+                conn->buflen = 0;
+                fprintf(w->logf, "bad request fd=%d\n", conn->fd);
+                fflush(w->logf);
+                if (conn_send(w, conn, err, strlen(err)) < 0) conn_close(w, conn);
+                break;
+            }
+            if (tracing(w)) {
+                conn->trace.t[TRACE_HEADER] = conn->t_last_read;
+                conn->trace.t[TRACE_PARSED] = trace_now();
+                snprintf(conn->trace.method, sizeof(conn->trace.method), "%s", http_parser_method(&conn->parser) ?: "");
+                snprintf(conn->trace.path, sizeof(conn->trace.path), "%s", http_parser_path(&conn->parser) ?: "");
+            }
+            TRACE_PROBE3(request, conn->fd, http_parser_method(&conn->parser), http_parser_path(&conn->parser));
+        }
+        /* refused, or the rest of the body is still on its way */
+        if (buffer_body(w, conn) <= 0) break;
+        conn->awaiting_body = 0;
+        int r = handle_request(w, conn);
+        if (r < 0) {
+            conn_close(w, conn);
+            return;
+        }
+        /* the handler is done with the body */
+        memmove(conn->buf, conn->buf + conn->body_len, conn->buflen - conn->body_len);
+        conn->buflen -= conn->body_len;
+        conn->body_len = 0;
+        if (r == 0) return; /* proxied, uploading or reading a file: resumes in request_finished() */
+        trace_answered(w, conn);
+        if (conn->ws) {
+            /* frames may have arrived right behind the handshake */
+            ws_on_input(w, conn);
+            return;
+        }
+        if (conn->sse) {
+            /* the stream only goes one way; anything else the client sends is ignored */
+            conn->buflen = 0;
+            return;
+        }
+        if (!conn->should_close) {
+            /* prepare for next request on this connection */
+            http_parser_destroy(&conn->parser);
+            http_parser_init(&conn->parser);
+        }
+    }
+    /* close once the response has been written out */
+    if (conn->fd >= 0 && conn->should_close && !conn_pending(conn) && !conn->proxy && !conn->upload && !conn->io) {
+        conn_close(w, conn);
+    }
+}
+
+/* A proxied exchange, an upload or a file read ended: continue with
+ * pipelined requests or close. */
+static void request_finished(worker_t *w, connection_t *conn) {
+    if (conn->fd < 0) return;
+    trace_answered(w, conn);
+    if (!conn->should_close) {
+        http_parser_destroy(&conn->parser);
+        http_parser_init(&conn->parser);
+    }
+    process_input(w, conn);
+}
+
+static void handle_client_event(worker_t *w, connection_t *conn, uint32_t events) {
+    if (conn->proxy) {
+        if (proxy_on_client_event(w, conn, events)) request_finished(w, conn);
+        return;
+    }
+    if (conn->upload) {
+        if (upload_on_client_event(w, conn, events)) request_finished(w, conn);
+        return;
+    }
+    if (conn->ws) {
+        ws_on_client_event(w, conn, events);
+        return;
+    }
+    if (conn->sse) {
+        sse_on_client_event(w, conn, events);
+        return;
+    }
+    if (conn->io) {
+        /* parked with reading paused: only a hangup or an error shows up */
+        if (events & (EPOLLERR | EPOLLHUP)) conn_close(w, conn);
+        return;
+    }
+    int client = conn->fd;
+    /* if socket is writable, try to flush pending write buffer */
+    if (events & EPOLLOUT) {
+        int fr = conn_flush(w, conn);
+        if (fr == 1) trace_flushed(w, conn);
+        if (fr < 0 || (fr == 1 && conn->should_close)) {
+            conn_close(w, conn);
+            return;
+        }
+        if (fr == 1 && conn->read_paused) {
+            /* the response holding up the pipelined requests is out */
+            conn->read_paused = 0;
+            conn_update_events(w, conn);
+            process_input(w, conn);
+            if (conn->fd < 0) return;
+        }
+    }
+    if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return;
+    ssize_t r = 0;
+    int done = 0;
+    size_t before = conn->buflen;
+    for (;;) {
+        r = recv(client, conn->buf + conn->buflen, sizeof(conn->buf) - conn->buflen - 1, 0);
+        if (r > 0) {
+            conn->buflen += r;
+            if (conn->buflen >= sizeof(conn->buf) - 1) break;
+            continue;
+        } else if (r == 0) {
+            done = 1; // peer closed
+            break;
+        } else {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            done = 1;
+            break;
+        }
+    }
+    conn->buf[conn->buflen] = '\0';
+    if (conn->buflen > before) {
+        TRACE_PROBE2(read, client, conn->buflen - before);
+        if (tracing(w)) {
+            conn->t_last_read = trace_now();
+            if (!conn->trace.t[TRACE_FIRST_BYTE]) conn->trace.t[TRACE_FIRST_BYTE] = conn->t_last_read;
+        }
+    }
+    process_input(w, conn);
+    if (done && conn->fd >= 0) {
+        /* if there is pending write buffered, leave connection open until flushed */
+        if (conn_pending(conn)) {
+            conn->should_close = 1;
+            conn->read_paused = 1;
+            conn_update_events(w, conn);
+        } else if (conn->io) {
+            /* answer the request the client half-closed after, then close */
+            conn->should_close = 1;
+        } else if (!conn->proxy && !conn->upload) {
+            conn_close(w, conn);
+        }
+    }
+}
+
+/* The listening socket is shared by all workers; EPOLLEXCLUSIVE wakes only
+ * one of them per incoming connection. */
+static int listener_register(worker_t *w) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    ev.data.ptr = &w->listener;
+    return epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->listener.fd, &ev);
+}
+
+/* Per-worker cap reached: leave new connections in the kernel queue, where
+ * another worker (or this one, once a connection closes) picks them up. */
+static void listener_pause(worker_t *w) {
+    if (w->accept_paused) return;
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, w->listener.fd, NULL);
+    w->accept_paused = 1;
+    STAT_INC(w->stats.accept_pauses);
+}
+
+static void listener_resume(worker_t *w) {
+    if (!w->accept_paused || w->listener.fd < 0) return;
+    if (w->conn_count >= (size_t)w->cfg->max_conns_per_worker) return;
+    if (listener_register(w) == 0) w->accept_paused = 0;
+}
+
+/* Number of connections waiting in the accept queue; for a listening socket
+ * Linux reports it in tcpi_unacked. */
+static int accept_queue_depth(int fd) {
+    struct tcp_info ti;
+    socklen_t len = sizeof(ti);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &ti, &len) != 0) return 0;
+    return (int)ti.tcpi_unacked;
+}
+
+/* Too far behind to give a new connection a timely answer? */
+static int overloaded(worker_t *w) {
+    const server_config_t *cfg = w->cfg;
+    if (cfg->shed_lag_ms && w->loop_lag_us >= (long long)cfg->shed_lag_ms * 1000) return 1;
+    if (cfg->shed_queue_depth && accept_queue_depth(w->listener.fd) >= cfg->shed_queue_depth) return 1;
+    return 0;
+}
+
+/* Answer a fresh connection with the canned 503 and drop it, without
+ * allocating a connection or parsing the request. */
+static void shed_connection(worker_t *w, int fd) {
+    char discard[1024];
+    /* swallow a request that has already arrived, so close() sends FIN, not RST */
+    while (recv(fd, discard, sizeof(discard), MSG_DONTWAIT) > 0) {
+    }
+    send(fd, w->srv->shed_response, w->srv->shed_len, MSG_DONTWAIT | MSG_NOSIGNAL);
+    shutdown(fd, SHUT_WR);
+    close(fd);
+    STAT_INC(w->stats.shed);
+}
+
+static void accept_clients(worker_t *w) {
+    server_t *srv = w->srv;
+    const server_config_t *cfg = w->cfg;
+    int shed = w->shedding;
+    // accept loop
+    for (;;) {
+        if (cfg->max_conns_per_worker && w->conn_count >= (size_t)cfg->max_conns_per_worker) {
+            listener_pause(w);
+            break;
+        }
+        struct sockaddr_in peer;
+        socklen_t plen = sizeof(peer);
+        /* CLOEXEC: client sockets must not leak into an upgraded binary */
+        int client = accept4(w->listener.fd, (struct sockaddr *)&peer, &plen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            perror("accept");
+            break;
+        }
+        STAT_INC(w->stats.accepted);
+        /* take a slot in the global count; conn_close() gives it back */
+        long total = atomic_fetch_add_explicit(&srv->conn_count, 1, memory_order_relaxed);
+        shed = (cfg->max_conns && total >= cfg->max_conns) || overloaded(w);
+        if (shed) {
+            atomic_fetch_sub_explicit(&srv->conn_count, 1, memory_order_relaxed);
+            shed_connection(w, client);
+            continue;
+        }
+        connection_t *conn = conn_new(w, client);
+        if (!conn) {
+            perror("epoll_ctl: client add");
+            atomic_fetch_sub_explicit(&srv->conn_count, 1, memory_order_relaxed);
+            close(client);
+            continue;
+        }
+        conn->peer_addr = ntohl(peer.sin_addr.s_addr);
+        trace_mark(w, conn, TRACE_ACCEPT);
+        TRACE_PROBE2(accept, client, conn->peer_addr);
+        fprintf(w->logf, "accepted fd=%d\n", client);
+        fflush(w->logf);
+    }
+    if (shed != w->shedding) {
+        w->shedding = shed;
+        if (shed) {
+            fprintf(w->logf, "overload: worker %d shedding new connections (%ld open, loop lag %lldus)\n", w->id,
+                    atomic_load(&srv->conn_count), w->loop_lag_us);
+        } else {
+            fprintf(w->logf, "overload: worker %d accepting again\n", w->id);
+        }
+        fflush(w->logf);
+    }
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-c config] [-p port] [-d docroot] [-D docroot.pack] [-l logfile] [-P /prefix=host:port]... [-k max_idle] [-i pidfile] [-g drain_seconds]\n"
+                    "       [-w workers] [-M max_conns] [-m max_conns_per_worker] [-r rate] [-b burst]\n"
+                    "       [-Q shed_queue_depth] [-L shed_lag_ms] [-a retry_after] [-S status_path]\n"
+                    "       [-A cpus] [-B busy_poll_us] [-T trace_entries] [-t trace_path] [-W websocket_path]\n"
+                    "       [-E events_path] [-R events_replay] [-e events_backlog_kb]\n"
+                    "       [-u upload_path] [-U upload_dir] [-z upload_max_mb] [-j io_threads]\n"
+                    "       [-C cache_ttl_ms] [-s cache_stale_ms] [-N cache_entries] [-x fallback_delay_us] [-V fallback_vary]\n", prog);
+}
+
+static int open_listener(unsigned short port, int reuseport) {
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
     if (listen_fd < 0) {
         perror("socket");
-        return 1;
+        return -1;
     }
 
     int opt = 1;
     setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (reuseport) setsockopt(listen_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
 
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(8080);
+    addr.sin_port = htons(port);
 
     if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
         perror("bind");
         close(listen_fd);
-        return 1;
+        return -1;
     }
 
-    if (listen(listen_fd, 128) < 0) {
+    /* a burst of connects must not overflow the accept queue: dropped SYNs
+     * are retried only after a second (the kernel caps this at somaxconn) */
+    if (listen(listen_fd, SOMAXCONN) < 0) {
         perror("listen");
         close(listen_fd);
-        return 1;
+        return -1;
     }
 
     if (set_nonblocking(listen_fd) < 0) {
         perror("set_nonblocking");
         close(listen_fd);
-        return 1;
+        return -1;
     }
+    return listen_fd;
+}
 
-    int epfd = epoll_create1(0);
-    if (epfd < 0) {
-        perror("epoll_create1");
-        close(listen_fd);
-        return 1;
+/*
+ * Fill fds with up to want listening sockets for the configured port: those
+ * handed over by an old process first, then new ones. More than one socket
+ * means an SO_REUSEPORT group; if the inherited socket cannot join one, the
+ * workers share what was inherited. Returns the number of sockets, 0 on error.
+ */
+static int acquire_listeners(unsigned short port, int *fds, int want, FILE *logf) {
+    int inherited[UPGRADE_MAX_FDS];
+    int n = upgrade_inherit(inherited, UPGRADE_MAX_FDS);
+    if (n < 0) {
+        fprintf(logf, "upgrade: failed to receive listening sockets\n");
+        return 0;
+    }
+    int have = 0;
+    for (int i = 0; i < n; ++i) {
+        struct sockaddr_in a;
+        socklen_t alen = sizeof(a);
+        if (have < want && getsockname(inherited[i], (struct sockaddr *)&a, &alen) == 0 && ntohs(a.sin_port) == port) {
+            fds[have++] = inherited[i];
+        } else {
+            /* connections already queued on a surplus socket are reset */
+            close(inherited[i]);
+        }
+    }
+    if (have) fprintf(logf, "upgrade: inherited listening socket fd=%d (%d of %d)\n", fds[0], have, want);
+    while (have < want) {
+        int fd = open_listener(port, want > 1);
+        if (fd < 0) {
+            if (have == 0) return 0;
+            fprintf(logf, "cannot add SO_REUSEPORT listeners, workers share %d\n", have);
+            break;
+        }
+        fds[have++] = fd;
     }
+    return have;
+}
+
+static void write_pidfile(const char *path) {
+    if (!path) return;
+    FILE *f = fopen(path, "w");
+    if (!f) return;
+    fprintf(f, "%ld\n", (long)getpid());
+    fclose(f);
+}
+
+/* The successor is accepting: stop accepting and finish what is in flight. */
+static void begin_drain(worker_t *w) {
+    if (!w->accept_paused) epoll_ctl(w->epfd, EPOLL_CTL_DEL, w->listener.fd, NULL);
+    /* the socket itself stays open until exit; the successor accepts from the same queue */
+    w->listener.fd = -1;
+    w->accept_paused = 0;
+    w->draining = 1;
+    /* WebSocket and event-stream clients are asked to reconnect, which takes
+     * them to the successor */
+    ws_drain(w);
+    sse_drain(w);
+    /* open connections are not cut: closing an idle one could race a request
+     * already on the wire. Each gets Connection: close on its next response,
+     * whatever is left at the deadline is closed. */
+}
+
+static void worker_notified(worker_t *w) {
+    uint64_t v;
+    while (read(w->notify.fd, &v, sizeof(v)) == (ssize_t)sizeof(v)) {
+    }
+    if (atomic_load(&w->srv->draining) && !w->draining) begin_drain(w);
+    ws_worker_notified(w);
+    sse_worker_notified(w);
+    iopool_worker_notified(w);
+    unsigned gen = atomic_load(&w->srv->trace_dump_gen);
+    if (gen != w->trace_dump_seen) {
+        w->trace_dump_seen = gen;
+        if (tracing(w)) {
+            /* the dump is written by the owner, so it never races a push */
+            flockfile(w->logf);
+            fprintf(w->logf, "trace: worker %d flight recorder\n", w->id);
+            trace_ring_dump(&w->trace, w->id, w->logf);
+            funlockfile(w->logf);
+            fflush(w->logf);
+        }
+    }
+}
 
+/* Wake every worker so it re-reads srv->running and srv->draining. */
+static void notify_workers(server_t *srv) {
+    uint64_t one = 1;
+    for (int i = 0; i < srv->nworkers; ++i) {
+        if (write(srv->workers[i].notify.fd, &one, sizeof(one)) < 0) perror("notify");
+    }
+}
+
+static atomic_int live_workers;
+
+/* One event loop: owns its epoll set, connections and upstream pools. */
+static void *worker_main(void *arg) {
+    worker_t *w = arg;
+    server_t *srv = w->srv;
+    const server_config_t *cfg = w->cfg;
+    struct epoll_event events[64];
+    if (cfg->cpu_count) {
+        int cpu = cfg->cpus[w->id % cfg->cpu_count];
+        if (lowlat_pin_thread(cpu) < 0) fprintf(w->logf, "worker %d: cannot pin to cpu %d: %s\n", w->id, cpu, strerror(errno));
+    }
+    while (atomic_load(&srv->running)) {
+        int timeout = -1;
+        if (w->draining) {
+            if (w->conn_count == 0) break;
+            long long left = srv->drain_deadline - now_ms();
+            if (left <= 0) {
+                fprintf(w->logf, "upgrade: drain deadline reached, closing %zu connections\n", w->conn_count);
+                while (w->conns) conn_close(w, w->conns);
+                break;
+            }
+            timeout = (int)left;
+        }
+        /* busy polling: no sleep (and no wakeup latency) for a while after
+         * the last event, since the next one is likely to follow soon */
+        if (cfg->busy_poll_us && now_us() - w->last_event_us < cfg->busy_poll_us) timeout = 0;
+        int n = epoll_wait(w->epfd, events, 64, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        if (n == 0) continue;
+        long long batch_start = now_us();
+        w->last_event_us = batch_start;
+        for (int i = 0; i < n; ++i) {
+            ev_source_t *src = events[i].data.ptr;
+            if (src->fd < 0) continue; /* closed earlier in this batch */
+            switch (src->kind) {
+            case EV_LISTEN:
+                accept_clients(w);
+                break;
+            case EV_CLIENT:
+                handle_client_event(w, (connection_t *)src, events[i].events);
+                break;
+            case EV_UPSTREAM: {
+                connection_t *done = proxy_on_upstream_event(w, (upstream_conn_t *)src, events[i].events);
+                if (done) request_finished(w, done);
+                break;
+            }
+            case EV_NOTIFY:
+                worker_notified(w);
+                break;
+            }
+        }
+        worker_reap(w);
+        /* events that arrived meanwhile waited this long before being seen */
+        w->loop_lag_us = now_us() - batch_start;
+        if (w->loop_lag_us > STAT(w->stats.loop_lag_max_us)) {
+            atomic_store_explicit(&w->stats.loop_lag_max_us, w->loop_lag_us, memory_order_relaxed);
+        }
+        if (w->accept_paused && !w->draining) listener_resume(w);
+    }
+    proxy_shutdown(w);
+    worker_reap(w);
+    atomic_fetch_sub(&live_workers, 1);
+    return NULL;
+}
+
+static int worker_setup(server_t *srv, worker_t *w, int id) {
+    w->id = id;
+    w->srv = srv;
+    w->logf = srv->logf;
+    w->cfg = srv->cfg;
+    w->listener.kind = EV_LISTEN;
+    w->listener.fd = srv->listen_fds[id % srv->nlisteners];
+    w->notify.kind = EV_NOTIFY;
+    w->notify.fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    w->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (w->epfd < 0 || w->notify.fd < 0) {
+        perror("epoll_create1/eventfd");
+        return -1;
+    }
+    if (proxy_init(w) != 0) {
+        perror("proxy_init");
+        return -1;
+    }
+    if (ws_init(w) != 0) {
+        perror("ws_init");
+        return -1;
+    }
+    if (sse_init(w) != 0) {
+        perror("sse_init");
+        return -1;
+    }
+    if (iopool_worker_init(w) != 0) {
+        perror("iopool_worker_init");
+        return -1;
+    }
+    if (w->cfg->trace_entries && trace_ring_init(&w->trace, (size_t)w->cfg->trace_entries) != 0) {
+        perror("trace_ring_init");
+        return -1;
+    }
+    if (w->cfg->busy_poll_us && lowlat_epoll_busy_poll(w->epfd, w->cfg->busy_poll_us) < 0 && id == 0) {
+        fprintf(w->logf, "busy-poll: epoll busy polling unavailable (%s), spinning in userspace only\n",
+                strerror(errno));
+    }
     struct epoll_event ev;
     ev.events = EPOLLIN;
-    ev.data.fd = listen_fd;
-    if (epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev) < 0) {
+    ev.data.ptr = &w->notify;
+    if (listener_register(w) < 0 || epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->notify.fd, &ev) < 0) {
         perror("epoll_ctl: listen_fd");
-        close(listen_fd);
-        close(epfd);
+        return -1;
+    }
+    return 0;
+}
+
+/* Signals are blocked in the workers so that they always interrupt the main
+ * thread's epoll_wait(). */
+static int start_workers(server_t *srv) {
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int rc = 0;
+    for (int i = 0; i < srv->nworkers; ++i) {
+        if (pthread_create(&srv->workers[i].thread, NULL, worker_main, &srv->workers[i]) != 0) {
+            perror("pthread_create");
+            srv->nworkers = i;
+            rc = -1;
+            break;
+        }
+        atomic_fetch_add(&live_workers, 1);
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    return rc;
+}
+
+int main(int argc, char **argv) {
+    server_config_t cfg;
+    config_defaults(&cfg);
+    if (config_parse_args(&cfg, argc, argv) != 0) {
+        usage(argv[0]);
+        return 2;
+    }
+    /* resolved now: after an upgrade the path names the new binary */
+    char self_exe[PATH_MAX];
+    ssize_t sl = readlink("/proc/self/exe", self_exe, sizeof(self_exe) - 1);
+    if (sl < 0) sl = 0;
+    self_exe[sl] = '\0';
+
+    // open simple logfile
+    FILE *logf = fopen(cfg.logfile, "ae");
+    if (!logf) logf = stderr;
+
+    // handle signals for graceful shutdown
+    signal(SIGINT, handle_sigint);
+    signal(SIGTERM, handle_sigint);
+    signal(SIGHUP, handle_upgrade);
+    signal(SIGUSR2, handle_upgrade);
+    signal(SIGUSR1, handle_dump);
+    /* avoid SIGPIPE killing the process on write to closed socket */
+    signal(SIGPIPE, SIG_IGN);
+    server_t srv;
+    memset(&srv, 0, sizeof(srv));
+    srv.cfg = &cfg;
+    srv.logf = logf;
+    /* pinned workers get a listener each, steered to their CPU */
+    int steer = cfg.cpu_count > 0 && cfg.workers > 1;
+    srv.nlisteners = acquire_listeners(cfg.port, srv.listen_fds, steer ? cfg.workers : 1, logf);
+    if (srv.nlisteners == 0) return 1;
+    for (int i = 0; i < srv.nlisteners; ++i) {
+        if (steer && srv.nlisteners > 1 && lowlat_steer_listener(srv.listen_fds[i], cfg.cpus[i % cfg.cpu_count]) < 0) {
+            fprintf(logf, "cannot steer listener %d: %s\n", i, strerror(errno));
+        }
+        if (cfg.busy_poll_us && lowlat_socket_busy_poll(srv.listen_fds[i], cfg.busy_poll_us) < 0 && i == 0) {
+            fprintf(logf, "busy-poll: SO_BUSY_POLL unavailable: %s\n", strerror(errno));
+        }
+    }
+    atomic_init(&srv.running, 1);
+    srv.shed_len = (size_t)snprintf(srv.shed_response, sizeof(srv.shed_response),
+                                    "HTTP/1.1 503 Service Unavailable\r\nRetry-After: %d\r\nContent-Length: 0\r\n"
+                                    "Connection: close\r\n\r\n",
+                                    cfg.retry_after);
+    if (cfg.rate_limit > 0) {
+        double burst = cfg.rate_burst > 0 ? cfg.rate_burst : cfg.rate_limit;
+        srv.ratelimit = ratelimit_new(65536, cfg.rate_limit, burst < 1 ? 1 : burst);
+        if (!srv.ratelimit) {
+            perror("ratelimit_new");
+            return 1;
+        }
+    }
+    if (cfg.docroot_pack) {
+        if (pack_open(&srv.pack, cfg.docroot_pack) != 0) {
+            fprintf(stderr, "%s: %s\n", cfg.docroot_pack, errno == EINVAL ? "not a docroot archive" : strerror(errno));
+            return 1;
+        }
+        fprintf(logf, "serving %u files from %s\n", srv.pack.hdr->nfiles, cfg.docroot_pack);
+    }
+    /* the storage directory itself may be created; subdirectories must exist */
+    if (cfg.upload_path && mkdir(cfg.upload_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf(stderr, "%s: %s\n", cfg.upload_dir, strerror(errno));
         return 1;
     }
+    if (cfg.events_path) {
+        srv.sse = sse_hub_new((size_t)cfg.events_replay);
+        if (!srv.sse) {
+            perror("sse_hub_new");
+            return 1;
+        }
+    }
+    if (cfg.cache_ttl_ms) {
+        srv.cache = microcache_new((size_t)cfg.cache_entries, cfg.cache_ttl_ms, cfg.cache_stale_ms);
+        if (!srv.cache) {
+            perror("microcache_new");
+            return 1;
+        }
+    }
+    /* the archive is served without file system calls, but cache fills
+     * still run on the I/O threads */
+    if (cfg.io_threads && (!cfg.docroot_pack || srv.cache)) {
+        srv.iopool = iopool_new(cfg.io_threads);
+        if (!srv.iopool) {
+            perror("iopool_new");
+            return 1;
+        }
+    }
+    srv.nworkers = cfg.workers;
+    srv.workers = calloc((size_t)srv.nworkers, sizeof(worker_t));
+    if (!srv.workers) return 1;
+    for (int i = 0; i < srv.nworkers; ++i) {
+        if (worker_setup(&srv, &srv.workers[i], i) != 0) return 1;
+    }
 
-    fprintf(logf, "Listening on 0.0.0.0:8080 (epoll)\n");
+    fprintf(logf, "Listening on 0.0.0.0:%u (epoll, %d workers, %d listeners%s)\n", (unsigned)cfg.port, srv.nworkers,
+            srv.nlisteners, cfg.busy_poll_us ? ", busy polling" : "");
+    if (srv.iopool) fprintf(logf, "static files read by %d I/O threads\n", cfg.io_threads);
+    if (srv.cache) {
+        fprintf(logf, "generated responses cached for %d ms (stale for %d ms more)\n", cfg.cache_ttl_ms,
+                cfg.cache_stale_ms);
+    }
+    if (cfg.ws_path) fprintf(logf, "websocket channels below %s\n", cfg.ws_path);
+    if (cfg.upload_path) {
+        fprintf(logf, "uploads below %s stored in %s (up to %d MB)\n", cfg.upload_path, cfg.upload_dir,
+                cfg.upload_max_mb);
+    }
+    if (cfg.events_path) {
+        fprintf(logf, "event streams below %s (replaying %d events)\n", cfg.events_path, cfg.events_replay);
+    }
+    for (int i = 0; i < cfg.route_count; ++i) {
+        fprintf(logf, "proxy %s -> %s:%u\n", cfg.routes[i].prefix, cfg.routes[i].host, (unsigned)cfg.routes[i].port);
+    }
     fflush(logf);
+    if (start_workers(&srv) != 0) running = 0;
+    write_pidfile(cfg.pidfile);
+    /* if we were started by an upgrade, the old process may now stop accepting */
+    upgrade_ready();
 
-    struct epoll_event events[64];
+    /* the main thread only handles signals and the upgrade handshake */
+    int ctl_epfd = epoll_create1(EPOLL_CLOEXEC);
+    ev_source_t upgrade_ctl = { EV_CONTROL, -1 };
+    pid_t upgrade_child = -1;
+    struct epoll_event ev;
+    struct epoll_event events[4];
     while (running) {
-        int n = epoll_wait(epfd, events, 64, -1);
-        if (n < 0) {
-            if (errno == EINTR) {
-                if (!running) break;
-                continue;
+        if (upgrade_requested) {
+            upgrade_requested = 0;
+            if (upgrade_ctl.fd < 0 && !atomic_load(&srv.draining)) {
+                upgrade_ctl.fd = upgrade_start(self_exe, argv, srv.listen_fds, srv.nlisteners, &upgrade_child);
+                ev.events = EPOLLIN;
+                ev.data.ptr = &upgrade_ctl;
+                if (upgrade_ctl.fd < 0 || epoll_ctl(ctl_epfd, EPOLL_CTL_ADD, upgrade_ctl.fd, &ev) < 0) {
+                    fprintf(logf, "upgrade: cannot start %s: %s\n", self_exe, strerror(errno));
+                    if (upgrade_ctl.fd >= 0) close(upgrade_ctl.fd);
+                    upgrade_ctl.fd = -1;
+                } else {
+                    fprintf(logf, "upgrade: started %s (pid %ld)\n", self_exe, (long)upgrade_child);
+                }
+                fflush(logf);
             }
+        }
+        if (dump_requested) {
+            dump_requested = 0;
+            if (!cfg.trace_entries) fprintf(logf, "trace: flight recorder is off (-T)\n");
+            fflush(logf);
+            atomic_fetch_add(&srv.trace_dump_gen, 1);
+            notify_workers(&srv);
+        }
+        if (atomic_load(&live_workers) == 0) break;
+        /* while draining, poll for the workers to finish */
+        int timeout = atomic_load(&srv.draining) ? 100 : -1;
+        int n = epoll_wait(ctl_epfd, events, 4, timeout);
+        if (n < 0) {
+            if (errno == EINTR) continue;
             perror("epoll_wait");
             break;
         }
         for (int i = 0; i < n; ++i) {
-            if (events[i].data.fd == listen_fd) {
-                // accept loop
-                for (;;) {
-                    int client = accept(listen_fd, NULL, NULL);
-                    if (client < 0) {
-                        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-                        perror("accept");
-                        break;
-                    }
-                    if (set_nonblocking(client) < 0) {
-                        close(client);
-                        continue;
-                    }
-                    connection_t *conn = calloc(1, sizeof(connection_t));
-                    if (!conn) {
-                        close(client);
-                        continue;
-                    }
-                    conn->fd = client;
-                    http_parser_init(&conn->parser);
-                    conn->buflen = 0;
-                    fprintf(logf, "accepted fd=%d\n", client);
-                    fflush(logf);
-                    struct epoll_event cev;
-                    /* use level-triggering for simplicity; edge-triggering requires careful draining */
-                    cev.events = EPOLLIN;
-                    cev.data.ptr = conn;
-                    if (epoll_ctl(epfd, EPOLL_CTL_ADD, client, &cev) < 0) {
-                        perror("epoll_ctl: client add");
-                        close(client);
-                        free(conn);
-                    }
-                }
+            ev_source_t *src = events[i].data.ptr;
+            if (src->kind != EV_CONTROL) continue;
+            char b = 0;
+            ssize_t r = read(src->fd, &b, 1);
+            if (r < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+            epoll_ctl(ctl_epfd, EPOLL_CTL_DEL, src->fd, NULL);
+            close(src->fd);
+            src->fd = -1;
+            if (r == 1 && b == 'R') {
+                srv.drain_deadline = now_ms() + (long long)cfg.drain_timeout * 1000;
+                atomic_store(&srv.draining, 1);
+                fprintf(logf, "upgrade: new process ready, draining %ld connections (deadline %ds)\n",
+                        atomic_load(&srv.conn_count), cfg.drain_timeout);
+                fflush(logf);
+                notify_workers(&srv);
             } else {
-                // handle client read
-                connection_t *conn = (connection_t *)events[i].data.ptr;
-                if (!conn) continue;
-                int client = conn->fd;
-                /* if socket is writable, try to flush pending write buffer */
-                if (events[i].events & EPOLLOUT) {
-                    while (conn->woff < conn->wlen) {
-                        ssize_t s = send(client, conn->wbuf + conn->woff, conn->wlen - conn->woff, 0);
-                        if (s > 0) {
-                            conn->woff += (size_t)s;
-                            continue;
-                        }
-                        if (s < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
-                        /* on error, drop connection */
-                        conn->should_close = 1;
-                        break;
-                    }
-                    if (conn->woff == conn->wlen) {
-                        free(conn->wbuf);
-                        conn->wbuf = NULL;
-                        conn->wlen = conn->woff = 0;
-                        /* remove EPOLLOUT interest */
-                        struct epoll_event mev;
-                        mev.events = EPOLLIN;
-                        mev.data.ptr = conn;
-                        epoll_ctl(epfd, EPOLL_CTL_MOD, client, &mev);
-                        if (conn->should_close) {
-                            epoll_ctl(epfd, EPOLL_CTL_DEL, client, NULL);
-                            http_parser_destroy(&conn->parser);
-                            close(client);
-                            free(conn);
-                            continue;
-                        }
-                    }
-                }
-                ssize_t r = 0;
-                int done = 0;
-                for (;;) {
-                    r = recv(client, conn->buf + conn->buflen, sizeof(conn->buf) - conn->buflen - 1, 0);
-                    if (r > 0) {
-                        conn->buflen += r;
-                        if (conn->buflen >= sizeof(conn->buf) - 1) break;
-                        continue;
-                    } else if (r == 0) {
-                        done = 1; // peer closed
-                        break;
-                    } else {
-                        if (errno == EAGAIN || errno == EWOULDBLOCK) break;
-                        done = 1;
-                        break;
-                    }
-                }
-                conn->buf[conn->buflen] = '\0';
-                size_t consumed = 0;
-                int pres = http_parser_execute(&conn->parser, conn->buf, conn->buflen, &consumed);
-                if (pres == 1) {
-                    // Serve static files for GET, otherwise respond with hello
-                    const char *method = http_parser_method(&conn->parser) ?: "";
-                    const char *path = http_parser_path(&conn->parser) ?: "/";
-                    /* determine whether the client requested to close the connection */
-                    int req_close = 0;
-                    const char *ver = http_parser_version(&conn->parser) ?: "";
-                    int hcount = http_parser_header_count(&conn->parser);
-                    for (int hi = 0; hi < hcount; ++hi) {
-                        const char *hn = http_parser_header_name(&conn->parser, hi);
-                        const char *hv = http_parser_header_value(&conn->parser, hi);
-                        if (hn && hv && strcasecmp(hn, "Connection") == 0) {
-                            if (strcasecmp(hv, "close") == 0) req_close = 1;
-                            if (strcasecmp(hv, "keep-alive") == 0) req_close = 0;
-                        }
-                    }
-                    /* HTTP/1.0 defaults to close unless 'Connection: keep-alive' present */
-                    if (strncmp(ver, "HTTP/1.0", 8) == 0 && hcount == 0) req_close = 1;
-                    /* set per-connection close flag according to request */
-                    conn->should_close = req_close;
-                    if (strcmp(method, "GET") == 0) {
-                        char fullpath[PATH_MAX];
-                        if (safe_resolve_path("www", path, fullpath, sizeof(fullpath)) == 0) {
-                            struct stat st;
-                            if (stat(fullpath, &st) == 0 && S_ISREG(st.st_mode)) {
-                                FILE *f = fopen(fullpath, "rb");
-                                if (f) {
-                                    size_t sz = (size_t)st.st_size;
-                                    char *buf = malloc(sz);
-                                    if (buf && fread(buf, 1, sz, f) == sz) {
-                                        const char *ctype = mime_type_for_path(fullpath);
-                                        char hdr[256];
-                                        const char *connval = conn->should_close ? "close" : "keep-alive";
-                                        int hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n", ctype, sz, connval);
-                                        /* send header+body using robust writer that handles partial writes */
-                                        /* try header then body; if queued, mark should_close and let EPOLLOUT flush */
-                                        size_t total_hdr = (size_t)hlen;
-                                        /* attempt to send header */
-                                        ssize_t hs = send(client, hdr, total_hdr, 0);
-                                        if (hs < 0 && !(errno == EAGAIN || errno == EWOULDBLOCK)) {
-                                            /* fatal send error */
-                                            free(buf);
-                                            fclose(f);
-                                            done = 1;
-                                        } else {
-                                            size_t sent_hdr = hs > 0 ? (size_t)hs : 0;
-                                            if (sent_hdr < total_hdr) {
-                                                /* queue remaining header + body */
-                                                size_t rem = total_hdr - sent_hdr + sz;
-                                                char *w = malloc(rem);
-                                                if (w) {
-                                                    memcpy(w, hdr + sent_hdr, total_hdr - sent_hdr);
-                                                    memcpy(w + (total_hdr - sent_hdr), buf, sz);
-                                                    free(buf);
-                                                    fclose(f);
-                                                    conn->wbuf = w;
-                                                    conn->wlen = rem;
-                                                    conn->woff = 0;
-                                                    conn->should_close = 1;
-                                                    /* enable EPOLLOUT */
-                                                    struct epoll_event mev;
-                                                    mev.events = EPOLLIN | EPOLLOUT;
-                                                    mev.data.ptr = conn;
-                                                    epoll_ctl(epfd, EPOLL_CTL_MOD, client, &mev);
-                                                } else {
-                                                    free(buf);
-                                                    fclose(f);
-                                                }
-                                            } else {
-                                                /* header fully sent, now send body */
-                                                ssize_t bs = send(client, buf, sz, 0);
-                                                if (bs < 0 && !(errno == EAGAIN || errno == EWOULDBLOCK)) {
-                                                    free(buf);
-                                                    fclose(f);
-                                                    done = 1;
-                                                } else if (bs < (ssize_t)sz) {
-                                                    size_t rem = (size_t)sz - (bs > 0 ? (size_t)bs : 0);
-                                                    char *w = malloc(rem);
-                                                    if (w) {
-                                                        size_t sentb = bs > 0 ? (size_t)bs : 0;
-                                                        memcpy(w, buf + sentb, rem);
-                                                        free(buf);
-                                                        fclose(f);
-                                                        conn->wbuf = w;
-                                                        conn->wlen = rem;
-                                                        conn->woff = 0;
-                                                        conn->should_close = 1;
-                                                        struct epoll_event mev;
-                                                        mev.events = EPOLLIN | EPOLLOUT;
-                                                        mev.data.ptr = conn;
-                                                        epoll_ctl(epfd, EPOLL_CTL_MOD, client, &mev);
-                                                    } else {
-                                                        free(buf);
-                                                        fclose(f);
-                                                    }
-                                                } else {
-                                                    free(buf);
-                                                    fclose(f);
-                                                    if (conn->should_close) done = 1;
-                                                    else {
-                                                        /* prepare for next request on this connection */
-                                                        http_parser_destroy(&conn->parser);
-                                                        http_parser_init(&conn->parser);
-                                                    }
-                                                }
-                                            }
-                                        }
-                                    } else {
-                                        free(buf);
-                                        fclose(f);
-                                        if (conn->should_close) done = 1;
-                                        else {
-                                            http_parser_destroy(&conn->parser);
-                                            http_parser_init(&conn->parser);
-                                        }
-                                    }
-                            }
-                        }
-                    }
-                    if (!done) {
-                        const char *resp = response;
-                        size_t rlen = strlen(resp);
-                        /* prepare response header with appropriate Connection value */
-                        const char *connval = conn->should_close ? "close" : "keep-alive";
-                        char hdr[256];
-                        int hlen = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; charset=utf-8\r\nContent-Length: %zu\r\nConnection: %s\r\n\r\n", rlen, connval);
-                        /* send header */
-                        ssize_t hs = send(client, hdr, (size_t)hlen, 0);
-                        if (hs < 0 && !(errno == EAGAIN || errno == EWOULDBLOCK)) {
-                            done = 1;
-                        } else {
-                            size_t sent_hdr = hs > 0 ? (size_t)hs : 0;
-                            if (sent_hdr < (size_t)hlen) {
-                                /* queue remaining header + body */
-                                size_t rem = (size_t)hlen - sent_hdr + rlen;
-                                char *w = malloc(rem);
-                                if (w) {
-                                    memcpy(w, hdr + sent_hdr, (size_t)hlen - sent_hdr);
-                                    memcpy(w + ((size_t)hlen - sent_hdr), resp, rlen);
-                                    conn->wbuf = w;
-                                    conn->wlen = rem;
-                                    conn->woff = 0;
-                                    /* ensure EPOLLOUT is enabled */
-                                    struct epoll_event mev;
-                                    mev.events = EPOLLIN | EPOLLOUT;
-                                    mev.data.ptr = conn;
-                                    epoll_ctl(epfd, EPOLL_CTL_MOD, client, &mev);
-                                } else {
-                                    done = 1;
-                                }
-                            } else {
-                                /* header fully sent -> send body */
-                                ssize_t bs = send(client, resp, rlen, 0);
-                                if (bs < 0 && !(errno == EAGAIN || errno == EWOULDBLOCK)) {
-                                    done = 1;
-                                } else if (bs < (ssize_t)rlen) {
-                                    size_t rem = rlen - (bs > 0 ? (size_t)bs : 0);
-                                    char *w = malloc(rem);
-                                    if (w) {
-                                        size_t sentb = bs > 0 ? (size_t)bs : 0;
-                                        memcpy(w, resp + sentb, rem);
-                                        conn->wbuf = w;
-                                        conn->wlen = rem;
-                                        conn->woff = 0;
-                                        struct epoll_event mev;
-                                        mev.events = EPOLLIN | EPOLLOUT;
-                                        mev.data.ptr = conn;
-                                        epoll_ctl(epfd, EPOLL_CTL_MOD, client, &mev);
-                                    } else {
-                                        done = 1;
-                                    }
-                                } else {
-                                    /* fully sent */
-                                    if (conn->should_close) done = 1;
-                                    else {
-                                        http_parser_destroy(&conn->parser);
-                                        http_parser_init(&conn->parser);
-                                    }
-                                }
-                            }
-                        }
-                    }
-                    fprintf(logf, "served fd=%d %s %s\n", client, method, path);
-                    fflush(logf);
-                } else if (pres == -1) {
-                    const char *err = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
-                    /* try to send error; if partial, queue and mark close */
-                    size_t elen = strlen(err);
-                    ssize_t es = send(client, err, elen, 0);
-                    if (es < 0 && !(errno == EAGAIN || errno == EWOULDBLOCK)) {
-                        done = 1;
-                    } else if (es < (ssize_t)elen) {
-                        size_t rem = elen - (es > 0 ? (size_t)es : 0);
-                        char *w = malloc(rem);
-                        if (w) {
-                            size_t sent = es > 0 ? (size_t)es : 0;
-                            memcpy(w, err + sent, rem);
-                            conn->wbuf = w;
-                            conn->wlen = rem;
-                            conn->woff = 0;
-                            conn->should_close = 1;
-                            struct epoll_event mev;
-                            mev.events = EPOLLIN | EPOLLOUT;
-                            mev.data.ptr = conn;
-                            epoll_ctl(epfd, EPOLL_CTL_MOD, client, &mev);
-                        } else {
-                            done = 1;
-                        }
-                    } else {
-                        done = 1;
-                    }
-                    fprintf(logf, "bad request fd=%d\n", client);
-                    fflush(logf);
-                }
-                // Remove consumed bytes from buffer
-                if (consumed > 0 && consumed <= conn->buflen) {
-                    memmove(conn->buf, conn->buf + consumed, conn->buflen - consumed);
-                    conn->buflen -= consumed;
-                }
-                if (done) {
-                    /* if there is pending write buffered, leave connection open until flushed */
-                    if (conn->wbuf && conn->wlen > conn->woff) {
-                        conn->should_close = 1;
-                        /* ensure EPOLLOUT interest is set (already done when queued above) */
-                    } else {
-                        epoll_ctl(epfd, EPOLL_CTL_DEL, client, NULL);
-                        http_parser_destroy(&conn->parser);
-                        close(client);
-                        free(conn);
-                    }
-                }
+                /* the new process died before it was ready: keep serving */
+                waitpid(upgrade_child, NULL, WNOHANG);
+                fprintf(logf, "upgrade: new process failed, still serving\n");
+                fflush(logf);
             }
         }
     }
@@ -469,14 +1502,36 @@ int main(void) {
     fprintf(logf, "shutting down\n");
     fflush(logf);
 
-    close(epfd);
-    close(listen_fd);
+    atomic_store(&srv.running, 0);
+    notify_workers(&srv);
+    for (int i = 0; i < srv.nworkers; ++i) pthread_join(srv.workers[i].thread, NULL);
+    /* jobs still running complete into the stopped workers' lists */
+    iopool_free(srv.iopool);
+    /* a cache fill dropped there still wakes requests parked on any worker */
+    for (int dropped = 1; dropped;) {
+        dropped = 0;
+        for (int i = 0; i < srv.nworkers; ++i) dropped += iopool_worker_drain(&srv.workers[i]);
+    }
+    for (int i = 0; i < cfg.workers; ++i) {
+        worker_t *w = &srv.workers[i];
+        free(w->graveyard);
+        trace_ring_free(&w->trace);
+        /* after every worker has stopped: any of them could still broadcast */
+        ws_shutdown(w);
+        sse_shutdown(w);
+        upload_shutdown(w);
+        iopool_worker_shutdown(w);
+        if (w->epfd >= 0) close(w->epfd);
+        if (w->notify.fd >= 0) close(w->notify.fd);
+    }
+    free(srv.workers);
+    sse_hub_free(srv.sse);
+    microcache_free(srv.cache);
+    ratelimit_free(srv.ratelimit);
+    pack_close(&srv.pack);
+    for (int i = 0; i < srv.nlisteners; ++i) close(srv.listen_fds[i]);
+    close(ctl_epfd);
+    if (upgrade_ctl.fd >= 0) close(upgrade_ctl.fd);
     if (logf && logf != stderr) fclose(logf);
     return 0;
 }
-
-
-
-}
-
-
@@ -0,0 +1,376 @@
+#define _GNU_SOURCE
+#include "microcache.h"
+#include <ctype.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fsutils.h"
+
+#define MC_KEY_MAX (PATH_MAX + 32)
+#define MC_VKEY_MAX 1024
+
+/* One stored response, or a claimed key whose first fill is in flight. */
+struct mc_variant_s {
+    struct mc_base_s *base;
+    char *vkey; /* request values of the Vary headers, "\n"-joined */
+    char *vary; /* the Vary names vkey was built from */
+    shared_buf_t *resp; /* NULL until the first fill is in */
+    size_t head_len;
+    long long fresh_until, stale_until;
+    int filling;          /* a fill (first or refresh) is in flight */
+    mc_waiter_t *waiters; /* parked behind it */
+    struct mc_variant_s *next;          /* the base's variants */
+    struct mc_variant_s *older, *newer; /* stored responses, oldest fill first */
+};
+
+/* A method and path; its variants differ in the values of the Vary headers. */
+typedef struct mc_base_s {
+    char *key; /* "GET /normalized/path?query" */
+    uint64_t hash;
+    char *vary; /* lower-cased names of the last stored response's Vary header */
+    struct mc_variant_s *variants;
+    struct mc_base_s *next; /* hash chain */
+} mc_base_t;
+
+typedef struct mc_variant_s mc_variant_t;
+
+struct microcache_s {
+    pthread_mutex_t lock;
+    mc_base_t **buckets;
+    size_t nbuckets; /* power of two */
+    size_t stored, max_entries;
+    mc_variant_t *oldest, *newest;
+    int ttl_ms, stale_ms;
+    atomic_ulong hits, stale, misses, coalesced, refreshes;
+};
+
+static uint64_t hash_key(const char *s) {
+    uint64_t h = 1469598103934665603ULL; /* FNV-1a */
+    for (; *s; ++s) h = (h ^ (unsigned char)*s) * 1099511628211ULL;
+    return h;
+}
+
+/* "METHOD /normalized/path?query". Returns 0, or -1 if the path cannot be
+ * normalized. */
+static int base_key(const mc_request_t *req, char *out, size_t outlen) {
+    char path[PATH_MAX];
+    char norm[PATH_MAX];
+    const char *q = strchr(req->path, '?');
+    size_t pl = q ? (size_t)(q - req->path) : strlen(req->path);
+    if (pl >= sizeof(path)) return -1;
+    memcpy(path, req->path, pl);
+    path[pl] = '\0';
+    if (normalize_request_path(path, norm, sizeof(norm)) != 0) return -1;
+    int n = snprintf(out, outlen, "%s %s%s", req->method, norm, q ? q : "");
+    return n > 0 && (size_t)n < outlen ? 0 : -1;
+}
+
+/* Vary header as stored: lower-case names, no blanks, comma separated.
+ * Returns 0, or -1 for "*" or a list that does not fit. */
+static int normalize_vary(const char *vary, char *out, size_t outlen) {
+    size_t o = 0;
+    out[0] = '\0';
+    if (!vary) return 0;
+    for (const char *p = vary; *p;) {
+        while (*p == ' ' || *p == '\t' || *p == ',') ++p;
+        if (!*p) break;
+        if (*p == '*') return -1;
+        if (o && o + 1 < outlen) out[o++] = ',';
+        while (*p && *p != ',' && *p != ' ' && *p != '\t') {
+            if (o + 1 >= outlen) return -1;
+            out[o++] = (char)tolower((unsigned char)*p++);
+        }
+        while (*p && *p != ',') ++p;
+    }
+    out[o] = '\0';
+    return 0;
+}
+
+/* The request's values of the headers in vary. Returns 0, or -1 if they do
+ * not fit. */
+static int variant_key(const char *vary, const mc_request_t *req, char *out, size_t outlen) {
+    size_t o = 0;
+    out[0] = '\0';
+    const char *p = vary;
+    while (*p) {
+        const char *end = strchr(p, ',');
+        size_t nl = end ? (size_t)(end - p) : strlen(p);
+        char name[128];
+        if (nl >= sizeof(name)) return -1;
+        memcpy(name, p, nl);
+        name[nl] = '\0';
+        const char *v = req->header ? req->header(req->arg, name) : NULL;
+        int n = snprintf(out + o, outlen - o, "%s\n", v ? v : "");
+        if (n < 0 || (size_t)n >= outlen - o) return -1;
+        o += (size_t)n;
+        p += nl;
+        if (*p == ',') ++p;
+    }
+    return 0;
+}
+
+microcache_t *microcache_new(size_t max_entries, int ttl_ms, int stale_ms) {
+    microcache_t *mc = calloc(1, sizeof(*mc));
+    if (!mc) return NULL;
+    mc->nbuckets = 16;
+    while (mc->nbuckets < max_entries * 2) mc->nbuckets *= 2;
+    mc->buckets = calloc(mc->nbuckets, sizeof(*mc->buckets));
+    if (!mc->buckets) {
+        free(mc);
+        return NULL;
+    }
+    pthread_mutex_init(&mc->lock, NULL);
+    mc->max_entries = max_entries;
+    mc->ttl_ms = ttl_ms;
+    mc->stale_ms = stale_ms;
+    return mc;
+}
+
+static void free_base(mc_base_t *b) {
+    free(b->key);
+    free(b->vary);
+    free(b);
+}
+
+static void free_variant(mc_variant_t *v) {
+    if (v->resp) shared_buf_unref(v->resp);
+    free(v->vkey);
+    free(v->vary);
+    free(v);
+}
+
+void microcache_free(microcache_t *mc) {
+    if (!mc) return;
+    for (size_t i = 0; i < mc->nbuckets; ++i) {
+        mc_base_t *b = mc->buckets[i];
+        while (b) {
+            mc_base_t *next = b->next;
+            mc_variant_t *v = b->variants;
+            while (v) {
+                mc_variant_t *vn = v->next;
+                free_variant(v);
+                v = vn;
+            }
+            free_base(b);
+            b = next;
+        }
+    }
+    free(mc->buckets);
+    pthread_mutex_destroy(&mc->lock);
+    free(mc);
+}
+
+/* ---- with mc->lock held ---- */
+
+static mc_base_t *find_base(microcache_t *mc, const char *key, uint64_t hash) {
+    for (mc_base_t *b = mc->buckets[hash & (mc->nbuckets - 1)]; b; b = b->next) {
+        if (b->hash == hash && strcmp(b->key, key) == 0) return b;
+    }
+    return NULL;
+}
+
+static void fifo_unlink(microcache_t *mc, mc_variant_t *v) {
+    if (v->older) v->older->newer = v->newer;
+    else if (mc->oldest == v) mc->oldest = v->newer;
+    else return; /* not stored */
+    if (v->newer) v->newer->older = v->older;
+    else mc->newest = v->older;
+    v->older = v->newer = NULL;
+    mc->stored--;
+}
+
+static void fifo_push(microcache_t *mc, mc_variant_t *v) {
+    v->older = mc->newest;
+    v->newer = NULL;
+    if (mc->newest) mc->newest->newer = v;
+    else mc->oldest = v;
+    mc->newest = v;
+    mc->stored++;
+}
+
+/* Drop a variant nobody is filling, and its base once empty. */
+static void remove_variant(microcache_t *mc, mc_variant_t *v) {
+    mc_base_t *b = v->base;
+    fifo_unlink(mc, v);
+    for (mc_variant_t **pp = &b->variants; *pp; pp = &(*pp)->next) {
+        if (*pp == v) {
+            *pp = v->next;
+            break;
+        }
+    }
+    free_variant(v);
+    if (b->variants) return;
+    for (mc_base_t **pp = &mc->buckets[b->hash & (mc->nbuckets - 1)]; *pp; pp = &(*pp)->next) {
+        if (*pp == b) {
+            *pp = b->next;
+            break;
+        }
+    }
+    free_base(b);
+}
+
+/* A claimed, empty variant; the base is created if missing. */
+static mc_variant_t *claim_variant(microcache_t *mc, mc_base_t *b, const char *key, uint64_t hash, const char *vkey) {
+    mc_variant_t *v = calloc(1, sizeof(*v));
+    if (!v) return NULL;
+    if (!b) {
+        b = calloc(1, sizeof(*b));
+        if (!b || !(b->key = strdup(key)) || !(b->vary = strdup(""))) {
+            if (b) free(b->key);
+            free(b);
+            free(v);
+            return NULL;
+        }
+        b->hash = hash;
+        b->next = mc->buckets[hash & (mc->nbuckets - 1)];
+        mc->buckets[hash & (mc->nbuckets - 1)] = b;
+    }
+    v->vkey = strdup(vkey);
+    v->vary = strdup(b->vary);
+    v->base = b;
+    v->next = b->variants;
+    b->variants = v;
+    v->filling = 1;
+    if (!v->vkey || !v->vary) {
+        v->filling = 0;
+        remove_variant(mc, v);
+        return NULL;
+    }
+    return v;
+}
+
+int microcache_lookup(microcache_t *mc, const mc_request_t *req, long long now, int flags, mc_waiter_t *waiter,
+                      shared_buf_t **resp, size_t *head_len, mc_fill_t **fill) {
+    char key[MC_KEY_MAX];
+    char vkey[MC_VKEY_MAX];
+    if (base_key(req, key, sizeof(key)) != 0) return MC_UNCACHEABLE;
+    uint64_t hash = hash_key(key);
+    int rc = MC_MISS;
+    pthread_mutex_lock(&mc->lock);
+    mc_base_t *b = find_base(mc, key, hash);
+    mc_variant_t *v = NULL;
+    if (b) {
+        if (variant_key(b->vary, req, vkey, sizeof(vkey)) != 0) {
+            pthread_mutex_unlock(&mc->lock);
+            return MC_UNCACHEABLE;
+        }
+        for (v = b->variants; v; v = v->next) {
+            if (strcmp(v->vary, b->vary) == 0 && strcmp(v->vkey, vkey) == 0) break;
+        }
+    } else {
+        vkey[0] = '\0';
+    }
+    if (v && v->resp && now < v->fresh_until) {
+        rc = MC_HIT;
+        if (!(flags & MC_WOKEN)) atomic_fetch_add_explicit(&mc->hits, 1, memory_order_relaxed);
+    } else if (v && v->resp && now < v->stale_until) {
+        rc = MC_STALE;
+        atomic_fetch_add_explicit(&mc->stale, 1, memory_order_relaxed);
+        if (!v->filling) {
+            v->filling = 1;
+            *fill = v;
+            atomic_fetch_add_explicit(&mc->refreshes, 1, memory_order_relaxed);
+        }
+    } else if (v && v->filling) {
+        rc = MC_PENDING;
+        if (waiter) {
+            waiter->next = v->waiters;
+            v->waiters = waiter;
+            atomic_fetch_add_explicit(&mc->coalesced, 1, memory_order_relaxed);
+        }
+    } else if (flags & MC_CLAIM) {
+        /* missing, or expired with nobody refilling it */
+        if (v) v->filling = 1;
+        else v = claim_variant(mc, b, key, hash, vkey);
+        if (v) {
+            *fill = v;
+            atomic_fetch_add_explicit(&mc->misses, 1, memory_order_relaxed);
+        }
+    }
+    if (rc == MC_HIT || rc == MC_STALE) {
+        shared_buf_ref(v->resp);
+        *resp = v->resp;
+        *head_len = v->head_len;
+    }
+    pthread_mutex_unlock(&mc->lock);
+    return rc;
+}
+
+void microcache_fill(microcache_t *mc, mc_fill_t *v, const mc_request_t *req, const char *vary, shared_buf_t *resp,
+                     size_t head_len, long long now) {
+    char names[MC_VKEY_MAX];
+    char vkey[MC_VKEY_MAX];
+    pthread_mutex_lock(&mc->lock);
+    mc_base_t *b = v->base;
+    mc_waiter_t *waiters = v->waiters;
+    v->waiters = NULL;
+    v->filling = 0;
+    int store = resp && normalize_vary(vary, names, sizeof(names)) == 0;
+    /* the key must be built from the names this response varies on */
+    if (store && strcmp(names, v->vary) != 0) {
+        store = req && variant_key(names, req, vkey, sizeof(vkey)) == 0;
+        char *nv = store ? strdup(names) : NULL;
+        char *nk = store ? strdup(vkey) : NULL;
+        if (nv && nk) {
+            free(v->vary);
+            free(v->vkey);
+            v->vary = nv;
+            v->vkey = nk;
+        } else {
+            free(nv);
+            free(nk);
+            store = 0;
+        }
+    }
+    if (store && strcmp(names, b->vary) != 0) {
+        char *nv = strdup(names);
+        if (nv) {
+            free(b->vary);
+            b->vary = nv;
+        } else {
+            store = 0;
+        }
+    }
+    if (store) {
+        if (v->resp) shared_buf_unref(v->resp);
+        shared_buf_ref(resp);
+        v->resp = resp;
+        v->head_len = head_len;
+        v->fresh_until = now + mc->ttl_ms;
+        v->stale_until = v->fresh_until + mc->stale_ms;
+        fifo_unlink(mc, v);
+        fifo_push(mc, v);
+        /* variants keyed by an older Vary list, or a duplicate of this one */
+        for (mc_variant_t *o = b->variants, *next; o; o = next) {
+            next = o->next;
+            if (o != v && !o->filling && (strcmp(o->vary, b->vary) != 0 || strcmp(o->vkey, v->vkey) == 0)) {
+                remove_variant(mc, o);
+            }
+        }
+        while (mc->stored > mc->max_entries) {
+            mc_variant_t *old = mc->oldest;
+            while (old && old->filling) old = old->newer;
+            if (!old || old == v) break;
+            remove_variant(mc, old);
+        }
+    } else if (resp || !v->resp) {
+        /* a failed first fill, or a response that cannot be stored under
+         * this key; a failed refresh keeps serving the stale copy */
+        remove_variant(mc, v);
+    }
+    pthread_mutex_unlock(&mc->lock);
+    while (waiters) {
+        mc_waiter_t *next = waiters->next;
+        waiters->wake(waiters);
+        waiters = next;
+    }
+}
+
+void microcache_stats(microcache_t *mc, mc_stats_t *out) {
+    out->hits = atomic_load_explicit(&mc->hits, memory_order_relaxed);
+    out->stale = atomic_load_explicit(&mc->stale, memory_order_relaxed);
+    out->misses = atomic_load_explicit(&mc->misses, memory_order_relaxed);
+    out->coalesced = atomic_load_explicit(&mc->coalesced, memory_order_relaxed);
+    out->refreshes = atomic_load_explicit(&mc->refreshes, memory_order_relaxed);
+}
@@ -0,0 +1,86 @@
+#ifndef MICROCACHE_H
+#define MICROCACHE_H
+
+#include <stddef.h>
+#include "conn.h"
+
+/*
+ * Micro-cache for generated (non-file) responses, shared by all workers.
+ *
+ * Entries are keyed by method, normalized path (query included) and the
+ * values of the request headers the response named in Vary. They stay fresh
+ * for ttl_ms. For stale_ms after that they are still served while one
+ * request refills them in the background (stale-while-revalidate).
+ *
+ * Misses are coalesced. The first miss for a key claims it and runs the
+ * handler. Requests for that key arriving meanwhile attach a waiter and are
+ * woken once the fill is in, so N concurrent misses run the handler once.
+ *
+ * A response is stored rendered, minus its Connection line: the status line
+ * and headers (head_len bytes), then the body, in one shared buffer that
+ * hits send by reference.
+ */
+
+typedef struct microcache_s microcache_t;
+typedef struct mc_variant_s mc_fill_t; /* a claimed entry, handed back to microcache_fill() */
+
+/* The request being looked up. */
+typedef struct mc_request_s {
+    const char *method;
+    const char *path; /* as requested; normalized by the cache */
+    /* value of a request header, or NULL; called with the cache locked */
+    const char *(*header)(void *arg, const char *name);
+    void *arg;
+} mc_request_t;
+
+/* A request parked behind a fill. wake() is called once, without the cache
+ * locked, on whatever thread completed the fill; the waiter then looks the
+ * key up again. */
+typedef struct mc_waiter_s {
+    void (*wake)(struct mc_waiter_s *waiter);
+    struct mc_waiter_s *next;
+} mc_waiter_t;
+
+enum {
+    MC_MISS,    /* not cached (with MC_CLAIM: *fill set, run the handler) */
+    MC_HIT,     /* *resp and *head_len set to a fresh response (a reference) */
+    MC_STALE,   /* like MC_HIT, past its TTL; *fill set if the caller refreshes */
+    MC_PENDING, /* a fill is in flight: waiter attached, or NULL passed */
+    MC_UNCACHEABLE /* the path cannot be a key */
+};
+
+/* flags of microcache_lookup() */
+#define MC_CLAIM 1 /* claim a missing key */
+#define MC_WOKEN 2 /* a woken waiter: counted as coalesced already */
+
+typedef struct mc_stats_s {
+    unsigned long hits, stale, misses, coalesced, refreshes;
+} mc_stats_t;
+
+/* At most max_entries responses are kept (the oldest fill goes first).
+ * Returns NULL if out of memory. */
+microcache_t *microcache_new(size_t max_entries, int ttl_ms, int stale_ms);
+void microcache_free(microcache_t *mc);
+
+/*
+ * Look up req at time now (monotonic ms). On MC_HIT and MC_STALE the caller
+ * owns a reference to *resp. On MC_PENDING the waiter is attached if one was
+ * passed; with NULL the caller may allocate one and look up again. Whoever
+ * gets a *fill must call microcache_fill() with it exactly once.
+ */
+int microcache_lookup(microcache_t *mc, const mc_request_t *req, long long now, int flags, mc_waiter_t *waiter,
+                      shared_buf_t **resp, size_t *head_len, mc_fill_t **fill);
+
+/*
+ * Complete a fill: store resp (a new reference is taken; NULL means the
+ * handler failed and nothing is stored) and wake the waiters. vary is the
+ * response's Vary header or NULL. req is the request that claimed the key,
+ * or NULL if it is gone or the fill is a background refresh. A response that
+ * varies on headers that cannot be read from req is not stored.
+ */
+void microcache_fill(microcache_t *mc, mc_fill_t *fill, const mc_request_t *req, const char *vary,
+                     shared_buf_t *resp, size_t head_len, long long now);
+
+void microcache_stats(microcache_t *mc, mc_stats_t *out);
+
+#endif
@@ -0,0 +1,427 @@
+#define _GNU_SOURCE
+#include "pack.h"
+#include "fsutils.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint64_t pack_hash(const char *s, size_t len) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)s[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+int pack_open(pack_t *p, const char *path) {
+    memset(p, 0, sizeof(*p));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)st.st_size;
+    if (size < sizeof(pack_header_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    /* shared and read-only: every worker and process serves from the same page cache */
+    void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return -1;
+    const pack_header_t *h = base;
+    uint64_t nb = h->nbuckets;
+    int ok = memcmp(h->magic, PACK_MAGIC, 8) == 0 && h->version == PACK_VERSION && h->size == size && nb &&
+             (nb & (nb - 1)) == 0 && nb >= h->nfiles && h->buckets_off % 8 == 0 && h->entries_off % 8 == 0 &&
+             h->buckets_off <= size && nb * sizeof(uint32_t) <= size - h->buckets_off && h->entries_off <= size &&
+             (uint64_t)h->nfiles * sizeof(pack_entry_t) <= size - h->entries_off;
+    if (!ok) {
+        munmap(base, size);
+        errno = EINVAL;
+        return -1;
+    }
+    p->base = base;
+    p->size = size;
+    p->hdr = h;
+    return 0;
+}
+
+void pack_close(pack_t *p) {
+    if (p->base) munmap((void *)p->base, p->size);
+    memset(p, 0, sizeof(*p));
+}
+
+static int in_bounds(const pack_t *p, uint64_t off, uint64_t len) {
+    return off <= p->size && len <= p->size - off;
+}
+
+const pack_entry_t *pack_lookup(const pack_t *p, const char *path, size_t len) {
+    const pack_header_t *h = p->hdr;
+    const uint32_t *buckets = (const uint32_t *)(p->base + h->buckets_off);
+    const pack_entry_t *entries = (const pack_entry_t *)(p->base + h->entries_off);
+    uint64_t hash = pack_hash(path, len);
+    uint32_t mask = h->nbuckets - 1;
+    for (uint32_t i = (uint32_t)hash & mask, n = 0; n < h->nbuckets; i = (i + 1) & mask, ++n) {
+        uint32_t b = buckets[i];
+        if (b == 0 || b > h->nfiles) return NULL;
+        const pack_entry_t *e = &entries[b - 1];
+        if (e->hash != hash || e->path_len != len) continue;
+        if (!in_bounds(p, e->path_off, len) || memcmp(pack_ptr(p, e->path_off), path, len) != 0) continue;
+        if (!in_bounds(p, e->head_off, e->head_len) || !in_bounds(p, e->body_off, e->body_len)) return NULL;
+        if (e->etag_off < e->head_off || e->etag_off + e->etag_len > e->head_off + e->head_len) return NULL;
+        return e;
+    }
+    return NULL;
+}
+
+int pack_render_head(char *buf, size_t len, const char *path, uint64_t size, const char *etag) {
+    return snprintf(buf, len, "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nContent-Length: %" PRIu64 "\r\nETag: %s\r\n",
+                    mime_type_for_path(path), size, etag);
+}
+
+/* ---- building and verifying ---- */
+
+typedef struct pack_file_s {
+    char *path; /* key, "/a/b.html" */
+    char *full; /* on disk */
+    uint64_t size;
+    char etag[24];
+    char head[512];
+    int head_len;
+} pack_file_t;
+
+typedef struct file_list_s {
+    pack_file_t *v;
+    size_t n, cap;
+} file_list_t;
+
+static int list_add(file_list_t *l, const char *key, const char *full, uint64_t size) {
+    if (l->n == l->cap) {
+        size_t ncap = l->cap ? l->cap * 2 : 64;
+        pack_file_t *nv = realloc(l->v, ncap * sizeof(*nv));
+        if (!nv) return -1;
+        l->v = nv;
+        l->cap = ncap;
+    }
+    pack_file_t *f = &l->v[l->n];
+    memset(f, 0, sizeof(*f));
+    f->path = strdup(key);
+    f->full = strdup(full);
+    f->size = size;
+    if (!f->path || !f->full) return -1;
+    l->n++;
+    return 0;
+}
+
+static void list_free(file_list_t *l) {
+    for (size_t i = 0; i < l->n; ++i) {
+        free(l->v[i].path);
+        free(l->v[i].full);
+    }
+    free(l->v);
+}
+
+/* Collect regular files below root/rel, the way safe_resolve_path() would
+ * reach them: symlinks are followed as long as they stay inside root. */
+static int walk(file_list_t *l, const char *root_real, const char *root, const char *rel, int depth, FILE *err) {
+    char dirpath[PATH_MAX];
+    if (snprintf(dirpath, sizeof(dirpath), "%s%s", root, rel) >= (int)sizeof(dirpath)) return -1;
+    DIR *d = opendir(dirpath);
+    if (!d) {
+        fprintf(err, "%s: %s\n", dirpath, strerror(errno));
+        return -1;
+    }
+    int rc = 0;
+    struct dirent *de;
+    while (rc == 0 && (de = readdir(d))) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        char key[PATH_MAX], full[PATH_MAX], real[PATH_MAX];
+        if (snprintf(key, sizeof(key), "%s/%s", rel, de->d_name) >= (int)sizeof(key) ||
+            snprintf(full, sizeof(full), "%s%s", root, key) >= (int)sizeof(full)) {
+            fprintf(err, "%s%s/%s: path too long\n", root, rel, de->d_name);
+            rc = -1;
+            break;
+        }
+        struct stat st;
+        if (stat(full, &st) != 0 || !realpath(full, real)) continue; /* dangling symlink */
+        size_t rl = strlen(root_real);
+        if (strncmp(real, root_real, rl) != 0 || (real[rl] != '/' && real[rl] != '\0')) {
+            fprintf(err, "skipping %s: outside %s\n", full, root);
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            if (depth >= 32) {
+                fprintf(err, "%s: too deep\n", full);
+                rc = -1;
+            } else {
+                rc = walk(l, root_real, root, key, depth + 1, err);
+            }
+        } else if (S_ISREG(st.st_mode)) {
+            if (list_add(l, key, full, (uint64_t)st.st_size) != 0) rc = -1;
+        }
+    }
+    closedir(d);
+    return rc;
+}
+
+static int cmp_path(const void *a, const void *b) {
+    return strcmp(((const pack_file_t *)a)->path, ((const pack_file_t *)b)->path);
+}
+
+static int collect(file_list_t *l, const char *dir, FILE *err) {
+    memset(l, 0, sizeof(*l));
+    char root_real[PATH_MAX];
+    if (!realpath(dir, root_real)) {
+        fprintf(err, "%s: %s\n", dir, strerror(errno));
+        return -1;
+    }
+    /* keys start with '/', so strip a trailing one from the root */
+    char root[PATH_MAX];
+    snprintf(root, sizeof(root), "%s", dir);
+    size_t n = strlen(root);
+    while (n > 1 && root[n - 1] == '/') root[--n] = '\0';
+    if (walk(l, root_real, root, "", 0, err) != 0) return -1;
+    if (l->n) qsort(l->v, l->n, sizeof(pack_file_t), cmp_path);
+    return 0;
+}
+
+/* ETag: FNV-1a of the contents. Reads the file once. */
+static int file_etag(pack_file_t *f, FILE *err) {
+    FILE *in = fopen(f->full, "rbe");
+    if (!in) {
+        fprintf(err, "%s: %s\n", f->full, strerror(errno));
+        return -1;
+    }
+    uint64_t h = 14695981039346656037ull;
+    uint64_t total = 0;
+    unsigned char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        for (size_t i = 0; i < n; ++i) {
+            h ^= buf[i];
+            h *= 1099511628211ull;
+        }
+        total += n;
+    }
+    fclose(in);
+    if (total != f->size) {
+        fprintf(err, "%s: changed while packing\n", f->full);
+        return -1;
+    }
+    snprintf(f->etag, sizeof(f->etag), "\"%016" PRIx64 "\"", h);
+    f->head_len = pack_render_head(f->head, sizeof(f->head), f->path, f->size, f->etag);
+    return f->head_len > 0 && f->head_len < (int)sizeof(f->head) ? 0 : -1;
+}
+
+static uint64_t align_up(uint64_t v, uint64_t a) {
+    return (v + a - 1) / a * a;
+}
+
+static int write_at(int fd, uint64_t off, const void *buf, size_t len) {
+    const char *p = buf;
+    while (len) {
+        ssize_t n = pwrite(fd, p, len, (off_t)off);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        off += (uint64_t)n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+static int copy_body(int fd, uint64_t off, const pack_file_t *f, FILE *err) {
+    FILE *in = fopen(f->full, "rbe");
+    if (!in) {
+        fprintf(err, "%s: %s\n", f->full, strerror(errno));
+        return -1;
+    }
+    char buf[65536];
+    uint64_t total = 0;
+    size_t n;
+    int rc = 0;
+    while (rc == 0 && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        rc = write_at(fd, off + total, buf, n);
+        total += n;
+    }
+    fclose(in);
+    if (rc == 0 && total != f->size) {
+        fprintf(err, "%s: changed while packing\n", f->full);
+        rc = -1;
+    }
+    return rc;
+}
+
+long pack_build(const char *dir, const char *out, FILE *err) {
+    file_list_t l;
+    if (collect(&l, dir, err) != 0) {
+        list_free(&l);
+        return -1;
+    }
+    if (l.n > UINT32_MAX / 4) {
+        fprintf(err, "%s: too many files\n", dir);
+        list_free(&l);
+        return -1;
+    }
+    for (size_t i = 0; i < l.n; ++i) {
+        if (file_etag(&l.v[i], err) != 0) {
+            list_free(&l);
+            return -1;
+        }
+    }
+
+    /* layout */
+    pack_header_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, PACK_MAGIC, 8);
+    h.version = PACK_VERSION;
+    h.nfiles = (uint32_t)l.n;
+    h.nbuckets = 8;
+    while (h.nbuckets < 2 * h.nfiles) h.nbuckets <<= 1; /* load factor <= 0.5 */
+    h.buckets_off = align_up(sizeof(h), 8);
+    h.entries_off = align_up(h.buckets_off + (uint64_t)h.nbuckets * sizeof(uint32_t), 8);
+    uint64_t off = h.entries_off + (uint64_t)l.n * sizeof(pack_entry_t);
+    pack_entry_t *entries = calloc(l.n ? l.n : 1, sizeof(pack_entry_t));
+    uint32_t *buckets = calloc(h.nbuckets, sizeof(uint32_t));
+    if (!entries || !buckets) {
+        free(entries);
+        free(buckets);
+        list_free(&l);
+        return -1;
+    }
+    for (size_t i = 0; i < l.n; ++i) {
+        pack_file_t *f = &l.v[i];
+        pack_entry_t *e = &entries[i];
+        e->path_len = (uint32_t)strlen(f->path);
+        e->hash = pack_hash(f->path, e->path_len);
+        e->path_off = off;
+        off += e->path_len;
+        e->head_off = off;
+        e->head_len = (uint32_t)f->head_len;
+        e->etag_off = off + (uint64_t)(strstr(f->head, f->etag) - f->head);
+        e->etag_len = (uint32_t)strlen(f->etag);
+        off += e->head_len;
+        uint32_t slot = (uint32_t)e->hash & (h.nbuckets - 1);
+        while (buckets[slot]) slot = (slot + 1) & (h.nbuckets - 1);
+        buckets[slot] = (uint32_t)i + 1;
+    }
+    for (size_t i = 0; i < l.n; ++i) {
+        pack_entry_t *e = &entries[i];
+        /* large bodies start on a page, small ones on a cache line */
+        off = align_up(off, l.v[i].size >= PACK_PAGE ? PACK_PAGE : PACK_ALIGN);
+        e->body_off = off;
+        e->body_len = l.v[i].size;
+        off += e->body_len;
+    }
+    h.size = off;
+
+    /* write to a temporary file and rename, so a running server never maps a partial archive */
+    char tmp[PATH_MAX];
+    long rc = -1;
+    int fd = -1;
+    if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", out) < (int)sizeof(tmp)) fd = mkostemp(tmp, O_CLOEXEC);
+    if (fd < 0) {
+        fprintf(err, "%s: %s\n", out, strerror(errno));
+    } else {
+        int ok = fchmod(fd, 0644) == 0 && ftruncate(fd, (off_t)h.size) == 0 && write_at(fd, 0, &h, sizeof(h)) == 0 &&
+                 write_at(fd, h.buckets_off, buckets, h.nbuckets * sizeof(uint32_t)) == 0 &&
+                 write_at(fd, h.entries_off, entries, l.n * sizeof(pack_entry_t)) == 0;
+        for (size_t i = 0; ok && i < l.n; ++i) {
+            ok = write_at(fd, entries[i].path_off, l.v[i].path, entries[i].path_len) == 0 &&
+                 write_at(fd, entries[i].head_off, l.v[i].head, entries[i].head_len) == 0 &&
+                 copy_body(fd, entries[i].body_off, &l.v[i], err) == 0;
+        }
+        if (ok && fsync(fd) == 0 && close(fd) == 0) {
+            fd = -1;
+            if (rename(tmp, out) == 0) rc = (long)l.n;
+        }
+        if (rc < 0) {
+            fprintf(err, "%s: write failed: %s\n", out, strerror(errno));
+            if (fd >= 0) close(fd);
+            unlink(tmp);
+        }
+    }
+    free(entries);
+    free(buckets);
+    list_free(&l);
+    return rc;
+}
+
+static int same_file(const pack_t *p, const pack_entry_t *e, const pack_file_t *f) {
+    if (e->body_len != f->size || e->head_len != (uint32_t)f->head_len) return 0;
+    if (memcmp(pack_ptr(p, e->head_off), f->head, e->head_len) != 0) return 0;
+    FILE *in = fopen(f->full, "rbe");
+    if (!in) return 0;
+    char buf[65536];
+    uint64_t off = 0;
+    size_t n;
+    int same = 1;
+    while (same && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        same = off + n <= e->body_len && memcmp(pack_ptr(p, e->body_off + off), buf, n) == 0;
+        off += n;
+    }
+    fclose(in);
+    return same && off == e->body_len;
+}
+
+long pack_verify(const pack_t *p, const char *dir, FILE *err) {
+    file_list_t l;
+    long bad = 0;
+    if (collect(&l, dir, err) != 0) {
+        list_free(&l);
+        return 1;
+    }
+    for (size_t i = 0; i < l.n; ++i) {
+        pack_file_t *f = &l.v[i];
+        if (file_etag(f, err) != 0) {
+            bad++;
+            continue;
+        }
+        const pack_entry_t *e = pack_lookup(p, f->path, strlen(f->path));
+        if (!e) {
+            fprintf(err, "missing: %s\n", f->path);
+            bad++;
+        } else if (!same_file(p, e, f)) {
+            fprintf(err, "differs: %s\n", f->path);
+            bad++;
+        }
+    }
+    /* entries without a file, or not reachable through the index */
+    const pack_entry_t *entries = (const pack_entry_t *)(p->base + p->hdr->entries_off);
+    for (uint32_t i = 0; i < p->hdr->nfiles; ++i) {
+        const pack_entry_t *e = &entries[i];
+        if (!in_bounds(p, e->path_off, e->path_len)) {
+            fprintf(err, "entry %u: path out of bounds\n", i);
+            bad++;
+            continue;
+        }
+        const char *path = pack_ptr(p, e->path_off);
+        if (pack_lookup(p, path, e->path_len) != e) {
+            fprintf(err, "not reachable through the index: %.*s\n", (int)e->path_len, path);
+            bad++;
+        }
+        pack_file_t key = { 0 };
+        char buf[PATH_MAX];
+        snprintf(buf, sizeof(buf), "%.*s", (int)e->path_len, path);
+        key.path = buf;
+        if (!l.n || !bsearch(&key, l.v, l.n, sizeof(pack_file_t), cmp_path)) {
+            fprintf(err, "extra: %s\n", buf);
+            bad++;
+        }
+    }
+    list_free(&l);
+    return bad;
+}
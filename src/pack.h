@@ -0,0 +1,91 @@
+#ifndef PACK_H
+#define PACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Packed docroot: a read-only archive of a directory tree that the server
+ * mmaps and serves from without touching the filesystem.
+ *
+ *   pack_header_t                       at offset 0
+ *   uint32_t buckets[nbuckets]          hash index: entry number + 1, 0 = empty
+ *   pack_entry_t entries[nfiles]        sorted by path
+ *   paths and pre-rendered headers
+ *   file bodies                         PACK_ALIGN aligned, page aligned from PACK_PAGE bytes
+ *
+ * Keys are normalized request paths ("/index.html", "/css/site.css"), see
+ * normalize_request_path(). Lookups hash the key with pack_hash() and probe
+ * linearly, so opening and lookup cost do not grow with the number of files.
+ * Integers are stored in host byte order: build the archive on the same
+ * architecture that serves it.
+ */
+
+#define PACK_MAGIC "CHSPACK1"
+#define PACK_VERSION 1
+#define PACK_ALIGN 64
+#define PACK_PAGE 4096
+
+typedef struct pack_header_s {
+    char magic[8];
+    uint32_t version;
+    uint32_t nfiles;
+    uint32_t nbuckets; /* power of two */
+    uint32_t reserved;
+    uint64_t buckets_off;
+    uint64_t entries_off;
+    uint64_t size; /* of the whole archive */
+    uint64_t reserved2[3];
+} pack_header_t;
+
+typedef struct pack_entry_s {
+    uint64_t hash;
+    uint64_t path_off;
+    uint64_t head_off; /* status line and headers, up to but excluding Connection and the blank line */
+    uint64_t etag_off; /* quoted ETag value inside the head */
+    uint64_t body_off;
+    uint64_t body_len;
+    uint32_t path_len;
+    uint32_t head_len;
+    uint32_t etag_len;
+    uint32_t reserved;
+} pack_entry_t;
+
+typedef struct pack_s {
+    const uint8_t *base; /* NULL when no archive is open */
+    size_t size;
+    const pack_header_t *hdr;
+} pack_t;
+
+/* FNV-1a, the hash of the index. */
+uint64_t pack_hash(const char *s, size_t len);
+
+/* Map an archive read-only and check its header. The contents are only
+ * checked when an entry is looked up. Returns 0, or -1 with errno set
+ * (EINVAL for a file that is not a valid archive). */
+int pack_open(pack_t *p, const char *path);
+void pack_close(pack_t *p);
+
+/* Find the entry for a normalized path. Returns NULL if there is none or if
+ * it points outside the archive. */
+const pack_entry_t *pack_lookup(const pack_t *p, const char *path, size_t len);
+
+static inline const char *pack_ptr(const pack_t *p, uint64_t off) {
+    return (const char *)p->base + off;
+}
+
+/* Render the stored head for a file. Returns its length like snprintf. */
+int pack_render_head(char *buf, size_t len, const char *path, uint64_t size, const char *etag);
+
+/* Pack every regular file below dir into out (written to a temporary file
+ * and renamed). Symlinks that leave dir are skipped. Problems are reported
+ * on err. Returns the number of files, or -1. */
+long pack_build(const char *dir, const char *out, FILE *err);
+
+/* Compare an archive with the tree it was built from: every file present
+ * with the same bytes and head, nothing extra, every entry reachable through
+ * the index. Differences are reported on err. Returns their number. */
+long pack_verify(const pack_t *p, const char *dir, FILE *err);
+
+#endif
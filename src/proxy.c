@@ -0,0 +1,836 @@
+#define _GNU_SOURCE
+#include "proxy.h"
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Upper bound for an upstream response head; larger heads get a 502. */
+#define PROXY_MAX_RESP_HEAD 8192
+/* Longest chunk-size or trailer line we accept */
+#define PROXY_MAX_CHUNK_LINE 1024
+
+enum proxy_state {
+    PX_CONNECTING,
+    PX_SEND_REQ,
+    PX_READ_HEAD,
+    PX_BODY
+};
+
+enum chunk_state {
+    CH_SIZE,
+    CH_DATA,
+    CH_DATA_CRLF,
+    CH_TRAILER
+};
+
+typedef struct proxy_exchange_s {
+    upstream_pool_t *pool;
+    upstream_conn_t *up;
+    int state;
+    int head_request;
+    int retried;
+    /* request head plus body bytes that were already read with it; kept
+     * until the response starts so a stale pooled socket can be retried */
+    char *head;
+    size_t head_len;
+    size_t head_off;       /* bytes of head written into req_pipe */
+    size_t req_body_left;  /* body bytes still to splice from the client */
+    int body_spliced;      /* some body bytes were taken from the client socket */
+    size_t req_pipe_bytes;
+    /* response */
+    proxy_resp_head_t resp;
+    int resp_started;      /* response bytes were forwarded to the client */
+    int resp_done;         /* everything has been read from the upstream */
+    size_t resp_left;      /* Content-Length or current chunk remaining */
+    int chunk_state;
+    size_t resp_pipe_bytes;
+} proxy_exchange_t;
+
+static const char *hop_by_hop[] = {
+    "Connection", "Keep-Alive", "Proxy-Connection", "TE", "Trailer",
+    "Transfer-Encoding", "Upgrade", "Expect", NULL
+};
+
+static int is_hop_by_hop(const char *name, size_t len) {
+    for (int i = 0; hop_by_hop[i]; ++i) {
+        if (strlen(hop_by_hop[i]) == len && strncasecmp(name, hop_by_hop[i], len) == 0) return 1;
+    }
+    return 0;
+}
+
+static int parse_size(const char *s, size_t len, size_t *out) {
+    if (len == 0) return -1;
+    size_t v = 0;
+    for (size_t i = 0; i < len; ++i) {
+        if (!isdigit((unsigned char)s[i])) return -1;
+        if (v > ((size_t)-1 - 9) / 10) return -1;
+        v = v * 10 + (size_t)(s[i] - '0');
+    }
+    *out = v;
+    return 0;
+}
+
+/* ---- pure helpers (unit tested) ---- */
+
+int proxy_parse_chunk_size(const char *line, size_t len, size_t *size) {
+    size_t v = 0;
+    size_t i = 0;
+    while (i < len && isxdigit((unsigned char)line[i])) {
+        if (v > ((size_t)-1 >> 4)) return -1;
+        int c = tolower((unsigned char)line[i]);
+        v = (v << 4) | (size_t)(isdigit(c) ? c - '0' : c - 'a' + 10);
+        i++;
+    }
+    if (i == 0) return -1;
+    /* optional whitespace and chunk extensions, then CRLF */
+    while (i < len && (line[i] == ' ' || line[i] == '\t')) i++;
+    if (i < len && line[i] == ';') {
+        while (i < len && line[i] != '\r') i++;
+    }
+    if (i + 2 != len || line[i] != '\r' || line[i + 1] != '\n') return -1;
+    *size = v;
+    return 0;
+}
+
+int proxy_rewrite_response_head(const char *head, size_t len, int head_request,
+                                int client_close, proxy_resp_head_t *info,
+                                char *out, size_t outlen) {
+    memset(info, 0, sizeof(*info));
+    const char *end = head + len;
+    const char *eol = memmem(head, len, "\r\n", 2);
+    if (!eol || len < 12 || strncmp(head, "HTTP/1.", 7) != 0) return -1;
+    if (head[8] != ' ' || !isdigit((unsigned char)head[9]) || !isdigit((unsigned char)head[10]) ||
+        !isdigit((unsigned char)head[11])) return -1;
+    info->status = (head[9] - '0') * 100 + (head[10] - '0') * 10 + (head[11] - '0');
+    int http10 = head[7] == '0';
+    int keep_alive = 0, has_length = 0, chunked = 0;
+
+    size_t off = 0;
+    /* status line with the version normalized to HTTP/1.1 */
+    size_t sl = (size_t)(eol - head) - 8;
+    if (off + 8 + sl + 2 > outlen) return -1;
+    memcpy(out + off, "HTTP/1.1", 8);
+    memcpy(out + off + 8, head + 8, sl);
+    off += 8 + sl;
+    memcpy(out + off, "\r\n", 2);
+    off += 2;
+
+    const char *line = eol + 2;
+    while (line < end) {
+        const char *le = memmem(line, (size_t)(end - line), "\r\n", 2);
+        if (!le) return -1;
+        if (le == line) break; /* blank line ends the head */
+        const char *colon = memchr(line, ':', (size_t)(le - line));
+        if (!colon) return -1;
+        size_t nlen = (size_t)(colon - line);
+        const char *v = colon + 1;
+        while (v < le && (*v == ' ' || *v == '\t')) v++;
+        size_t vlen = (size_t)(le - v);
+        while (vlen > 0 && (v[vlen - 1] == ' ' || v[vlen - 1] == '\t')) vlen--;
+        if (nlen == 14 && strncasecmp(line, "Content-Length", 14) == 0) {
+            if (parse_size(v, vlen, &info->content_length) != 0) return -1;
+            has_length = 1;
+        } else if (nlen == 17 && strncasecmp(line, "Transfer-Encoding", 17) == 0) {
+            /* chunked must be the final coding */
+            if (vlen >= 7 && strncasecmp(v + vlen - 7, "chunked", 7) == 0) chunked = 1;
+            else return -1;
+        } else if (nlen == 10 && strncasecmp(line, "Connection", 10) == 0) {
+            if (memmem(v, vlen, "close", 5)) info->upstream_close = 1;
+            if (vlen == 10 && strncasecmp(v, "keep-alive", 10) == 0) keep_alive = 1;
+        }
+        /* Transfer-Encoding is forwarded: the chunked framing passes through unchanged */
+        if (!is_hop_by_hop(line, nlen) || (nlen == 17 && chunked)) {
+            size_t ll = (size_t)(le - line) + 2;
+            if (off + ll > outlen) return -1;
+            memcpy(out + off, line, ll);
+            off += ll;
+        }
+        line = le + 2;
+    }
+    if (line >= end) return -1;
+    if (http10 && !keep_alive) info->upstream_close = 1;
+
+    if (head_request || (info->status >= 100 && info->status < 200) || info->status == 204 ||
+        info->status == 304) {
+        info->mode = PROXY_RESP_NONE;
+    } else if (chunked) {
+        info->mode = PROXY_RESP_CHUNKED;
+    } else if (has_length) {
+        info->mode = PROXY_RESP_LENGTH;
+    } else {
+        info->mode = PROXY_RESP_EOF;
+        info->upstream_close = 1;
+    }
+    /* interim (1xx) responses never carry a Connection header */
+    if (info->status >= 200) {
+        const char *connval = (client_close || info->mode == PROXY_RESP_EOF) ? "close" : "keep-alive";
+        int n = snprintf(out + off, outlen - off, "Connection: %s\r\n\r\n", connval);
+        if (n < 0 || (size_t)n >= outlen - off) return -1;
+        off += (size_t)n;
+    } else {
+        if (off + 2 > outlen) return -1;
+        memcpy(out + off, "\r\n", 2);
+        off += 2;
+    }
+    return (int)off;
+}
+
+int proxy_build_request_head(http_parser_t *p, char *out, size_t outlen) {
+    const char *method = http_parser_method(p);
+    const char *path = http_parser_path(p);
+    if (!method || !path) return -1;
+    int n = snprintf(out, outlen, "%s %s HTTP/1.1\r\n", method, path);
+    if (n < 0 || (size_t)n >= outlen) return -1;
+    size_t off = (size_t)n;
+    int hcount = http_parser_header_count(p);
+    for (int i = 0; i < hcount; ++i) {
+        const char *hn = http_parser_header_name(p, i);
+        const char *hv = http_parser_header_value(p, i);
+        if (!hn || !hv || is_hop_by_hop(hn, strlen(hn))) continue;
+        n = snprintf(out + off, outlen - off, "%s: %s\r\n", hn, hv);
+        if (n < 0 || (size_t)n >= outlen - off) return -1;
+        off += (size_t)n;
+    }
+    n = snprintf(out + off, outlen - off, "Connection: keep-alive\r\n\r\n");
+    if (n < 0 || (size_t)n >= outlen - off) return -1;
+    return (int)(off + (size_t)n);
+}
+
+/* ---- upstream pool ---- */
+
+int proxy_init(worker_t *w) {
+    const server_config_t *cfg = w->cfg;
+    w->pools = NULL;
+    if (cfg->route_count == 0) return 0;
+    w->pools = calloc((size_t)cfg->route_count, sizeof(upstream_pool_t));
+    if (!w->pools) return -1;
+    for (int i = 0; i < cfg->route_count; ++i) {
+        upstream_pool_t *pool = &w->pools[i];
+        const proxy_route_t *r = &cfg->routes[i];
+        pool->route = r;
+        pool->max_idle = cfg->upstream_max_idle;
+        pool->addr.sin_family = AF_INET;
+        pool->addr.sin_port = htons(r->port);
+        if (inet_pton(AF_INET, r->host, &pool->addr.sin_addr) == 1) {
+            pool->addr_ok = 1;
+            continue;
+        }
+        /* resolved once at startup; the event loop never blocks on DNS */
+        struct addrinfo hints, *res = NULL;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(r->host, NULL, &hints, &res) == 0 && res) {
+            pool->addr.sin_addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+            pool->addr_ok = 1;
+            freeaddrinfo(res);
+        } else {
+            fprintf(w->logf, "proxy: cannot resolve %s\n", r->host);
+        }
+    }
+    return 0;
+}
+
+static void upstream_set_events(worker_t *w, upstream_conn_t *u, uint32_t want) {
+    if (want == u->events) return;
+    struct epoll_event ev;
+    ev.events = want;
+    ev.data.ptr = u;
+    if (epoll_ctl(w->epfd, EPOLL_CTL_MOD, u->fd, &ev) == 0) u->events = want;
+}
+
+static void upstream_destroy(worker_t *w, upstream_conn_t *u) {
+    if (u->fd < 0) return;
+    epoll_ctl(w->epfd, EPOLL_CTL_DEL, u->fd, NULL);
+    close(u->fd);
+    u->fd = -1;
+    for (int i = 0; i < 2; ++i) {
+        if (u->req_pipe[i] >= 0) close(u->req_pipe[i]);
+        if (u->resp_pipe[i] >= 0) close(u->resp_pipe[i]);
+    }
+    worker_defer_free(w, u);
+}
+
+static void pool_unlink_idle(upstream_pool_t *pool, upstream_conn_t *u) {
+    for (upstream_conn_t **pp = &pool->idle; *pp; pp = &(*pp)->next_idle) {
+        if (*pp == u) {
+            *pp = u->next_idle;
+            u->next_idle = NULL;
+            pool->idle_count--;
+            return;
+        }
+    }
+}
+
+void proxy_shutdown(worker_t *w) {
+    if (!w->pools) return;
+    for (int i = 0; i < w->cfg->route_count; ++i) {
+        upstream_pool_t *pool = &w->pools[i];
+        while (pool->idle) {
+            upstream_conn_t *u = pool->idle;
+            pool_unlink_idle(pool, u);
+            upstream_destroy(w, u);
+        }
+    }
+    free(w->pools);
+    w->pools = NULL;
+}
+
+static upstream_conn_t *upstream_connect(worker_t *w, upstream_pool_t *pool) {
+    if (!pool->addr_ok) return NULL;
+    upstream_conn_t *u = calloc(1, sizeof(*u));
+    if (!u) return NULL;
+    u->kind = EV_UPSTREAM;
+    u->pool = pool;
+    u->req_pipe[0] = u->req_pipe[1] = u->resp_pipe[0] = u->resp_pipe[1] = -1;
+    u->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (u->fd < 0) {
+        free(u);
+        return NULL;
+    }
+    if (pipe2(u->req_pipe, O_NONBLOCK | O_CLOEXEC) < 0 || pipe2(u->resp_pipe, O_NONBLOCK | O_CLOEXEC) < 0) {
+        goto fail;
+    }
+    int cap = fcntl(u->resp_pipe[1], F_GETPIPE_SZ);
+    u->pipe_cap = cap > 0 ? (size_t)cap : 65536;
+    if (connect(u->fd, (struct sockaddr *)&pool->addr, sizeof(pool->addr)) < 0) {
+        if (errno != EINPROGRESS) goto fail;
+        u->connecting = 1;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLOUT;
+    ev.data.ptr = u;
+    if (epoll_ctl(w->epfd, EPOLL_CTL_ADD, u->fd, &ev) < 0) goto fail;
+    u->events = EPOLLOUT;
+    return u;
+fail:
+    close(u->fd);
+    for (int i = 0; i < 2; ++i) {
+        if (u->req_pipe[i] >= 0) close(u->req_pipe[i]);
+        if (u->resp_pipe[i] >= 0) close(u->resp_pipe[i]);
+    }
+    free(u);
+    return NULL;
+}
+
+static upstream_conn_t *pool_acquire(worker_t *w, upstream_pool_t *pool) {
+    upstream_conn_t *u = pool->idle;
+    if (u) {
+        pool_unlink_idle(pool, u);
+        upstream_set_events(w, u, EPOLLOUT);
+        return u;
+    }
+    return upstream_connect(w, pool);
+}
+
+static void pool_release(worker_t *w, upstream_conn_t *u, int reusable) {
+    upstream_pool_t *pool = u->pool;
+    u->client = NULL;
+    if (!reusable || pool->idle_count >= pool->max_idle) {
+        upstream_destroy(w, u);
+        return;
+    }
+    u->requests++;
+    u->next_idle = pool->idle;
+    pool->idle = u;
+    pool->idle_count++;
+    /* idle sockets are watched for the upstream closing them */
+    upstream_set_events(w, u, EPOLLIN | EPOLLRDHUP);
+}
+
+upstream_pool_t *proxy_match(worker_t *w, const char *path) {
+    const proxy_route_t *r = config_match_route(w->cfg, path);
+    if (!r) return NULL;
+    return &w->pools[r - w->cfg->routes];
+}
+
+/* ---- exchange ---- */
+
+static void exchange_free(proxy_exchange_t *x) {
+    free(x->head);
+    free(x);
+}
+
+/* Detach the finished exchange from its client and recycle the upstream. */
+static void exchange_finish(worker_t *w, connection_t *c, int reusable) {
+    proxy_exchange_t *x = c->proxy;
+    if (x->up) pool_release(w, x->up, reusable);
+    c->proxy = NULL;
+    exchange_free(x);
+    c->read_paused = 0;
+    c->want_write = 0;
+    conn_update_events(w, c);
+}
+
+void proxy_abort(worker_t *w, connection_t *c) {
+    proxy_exchange_t *x = c->proxy;
+    if (!x) return;
+    if (x->up) {
+        x->up->client = NULL;
+        upstream_destroy(w, x->up);
+    }
+    c->proxy = NULL;
+    exchange_free(x);
+}
+
+static void client_update_events(worker_t *w, connection_t *c) {
+    proxy_exchange_t *x = c->proxy;
+    size_t cap = x->up ? x->up->pipe_cap : 0;
+    c->read_paused = !(x->state == PX_SEND_REQ && x->req_body_left > 0 && x->req_pipe_bytes < cap);
+    c->want_write = x->resp_pipe_bytes > 0;
+    conn_update_events(w, c);
+}
+
+static void upstream_update_events(worker_t *w, proxy_exchange_t *x) {
+    upstream_conn_t *u = x->up;
+    uint32_t want = 0;
+    switch (x->state) {
+    case PX_CONNECTING:
+        want = EPOLLOUT;
+        break;
+    case PX_SEND_REQ:
+        if (x->req_pipe_bytes > 0 || x->head_off < x->head_len) want = EPOLLOUT;
+        break;
+    case PX_READ_HEAD:
+        want = EPOLLIN;
+        break;
+    case PX_BODY:
+        if (!x->resp_done && x->resp_pipe_bytes + PROXY_MAX_CHUNK_LINE < u->pipe_cap) want = EPOLLIN;
+        break;
+    }
+    upstream_set_events(w, u, want);
+}
+
+static void exchange_update_events(worker_t *w, connection_t *c) {
+    proxy_exchange_t *x = c->proxy;
+    if (x->up) upstream_update_events(w, x);
+    client_update_events(w, c);
+}
+
+/* Answer the client locally (502 etc.) and end the exchange. */
+static void exchange_fail(worker_t *w, connection_t *c, const char *status) {
+    proxy_exchange_t *x = c->proxy;
+    /* the request body may be half read: only keep the client if it was not */
+    if (x->req_body_left > 0) c->should_close = 1;
+    if (x->up) {
+        x->up->client = NULL;
+        upstream_destroy(w, x->up);
+        x->up = NULL;
+    }
+    char resp[160];
+    int n = snprintf(resp, sizeof(resp), "HTTP/1.1 %s\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+                     status, c->should_close ? "close" : "keep-alive");
+    fprintf(w->logf, "proxy fd=%d upstream %s:%u failed: %s\n", c->fd, x->pool->route->host,
+            (unsigned)x->pool->route->port, status);
+    fflush(w->logf);
+    exchange_finish(w, c, 0);
+    if (conn_send(w, c, resp, (size_t)n) < 0) conn_close(w, c);
+}
+
+static int exchange_attach(worker_t *w, connection_t *c, upstream_conn_t *u) {
+    proxy_exchange_t *x = c->proxy;
+    x->up = u;
+    u->client = c;
+    x->head_off = 0;
+    x->req_pipe_bytes = 0;
+    x->state = u->connecting ? PX_CONNECTING : PX_SEND_REQ;
+    exchange_update_events(w, c);
+    return 0;
+}
+
+/*
+ * The upstream socket failed before any response byte was forwarded. A socket
+ * taken from the pool may simply have been closed by the upstream while idle,
+ * so retry once on a fresh connection when the whole request is still in hand.
+ * Returns 1 if the client's exchange ended (c->proxy cleared or c closed).
+ */
+static int exchange_upstream_error(worker_t *w, connection_t *c) {
+    proxy_exchange_t *x = c->proxy;
+    upstream_conn_t *u = x->up;
+    if (x->resp_started) {
+        conn_close(w, c);
+        return 1;
+    }
+    int was_pooled = u->requests > 0;
+    u->client = NULL;
+    upstream_destroy(w, u);
+    x->up = NULL;
+    if (was_pooled && !x->retried && !x->body_spliced) {
+        x->retried = 1;
+        upstream_conn_t *nu = upstream_connect(w, x->pool);
+        if (nu) {
+            exchange_attach(w, c, nu);
+            return 0;
+        }
+    }
+    exchange_fail(w, c, "502 Bad Gateway");
+    return 1;
+}
+
+int proxy_start(worker_t *w, connection_t *c, upstream_pool_t *pool) {
+    http_parser_t *p = &c->parser;
+    size_t content_length = 0;
+    int expect_continue = 0;
+    int hcount = http_parser_header_count(p);
+    for (int i = 0; i < hcount; ++i) {
+        const char *hn = http_parser_header_name(p, i);
+        const char *hv = http_parser_header_value(p, i);
+        if (!hn || !hv) continue;
+        if (strcasecmp(hn, "Content-Length") == 0) {
+            if (parse_size(hv, strlen(hv), &content_length) != 0) {
+                c->should_close = 1;
+                const char *bad = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+                if (conn_send(w, c, bad, strlen(bad)) < 0) conn_close(w, c);
+                return 1;
+            }
+        } else if (strcasecmp(hn, "Transfer-Encoding") == 0) {
+            /* request bodies must be Content-Length framed to be spliced */
+            c->should_close = 1;
+            const char *nl = "HTTP/1.1 411 Length Required\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+            if (conn_send(w, c, nl, strlen(nl)) < 0) conn_close(w, c);
+            return 1;
+        } else if (strcasecmp(hn, "Expect") == 0 && strcasecmp(hv, "100-continue") == 0) {
+            expect_continue = 1;
+        }
+    }
+
+    proxy_exchange_t *x = calloc(1, sizeof(*x));
+    char head[HTTPP_MAX_BUF + 256];
+    int hlen = x ? proxy_build_request_head(p, head, sizeof(head)) : -1;
+    size_t early = content_length < c->buflen ? content_length : c->buflen;
+    if (hlen > 0) x->head = malloc((size_t)hlen + early);
+    if (!x || hlen < 0 || !x->head) {
+        if (x) exchange_free(x);
+        c->should_close = 1;
+        const char *err = "HTTP/1.1 500 Internal Server Error\r\nConnection: close\r\nContent-Length: 0\r\n\r\n";
+        if (conn_send(w, c, err, strlen(err)) < 0) conn_close(w, c);
+        return 1;
+    }
+    /* body bytes that arrived together with the header block */
+    memcpy(x->head, head, (size_t)hlen);
+    memcpy(x->head + hlen, c->buf, early);
+    x->head_len = (size_t)hlen + early;
+    memmove(c->buf, c->buf + early, c->buflen - early);
+    c->buflen -= early;
+    x->req_body_left = content_length - early;
+    x->pool = pool;
+    x->head_request = strcmp(http_parser_method(p), "HEAD") == 0;
+    c->proxy = x;
+
+    if (expect_continue && x->req_body_left > 0) {
+        /* Expect is not forwarded; let the client start sending right away */
+        const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+        if (conn_send(w, c, cont, strlen(cont)) < 0) {
+            conn_close(w, c);
+            return 0;
+        }
+    }
+
+    upstream_conn_t *u = pool_acquire(w, pool);
+    if (!u) {
+        exchange_fail(w, c, "502 Bad Gateway");
+        return 1;
+    }
+    exchange_attach(w, c, u);
+    return 0;
+}
+
+/* Move request bytes head/client -> req_pipe -> upstream.
+ * Returns -1 on upstream error, -2 if the client went away, 0 otherwise. */
+static int pump_request(connection_t *c) {
+    proxy_exchange_t *x = c->proxy;
+    upstream_conn_t *u = x->up;
+    for (;;) {
+        int progress = 0;
+        if (x->head_off < x->head_len) {
+            ssize_t n = write(u->req_pipe[1], x->head + x->head_off, x->head_len - x->head_off);
+            if (n > 0) {
+                x->head_off += (size_t)n;
+                x->req_pipe_bytes += (size_t)n;
+                progress = 1;
+            }
+        } else if (x->req_body_left > 0 && x->req_pipe_bytes < u->pipe_cap) {
+            size_t want = u->pipe_cap - x->req_pipe_bytes;
+            if (want > x->req_body_left) want = x->req_body_left;
+            ssize_t n = splice(c->fd, NULL, u->req_pipe[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                x->req_body_left -= (size_t)n;
+                x->req_pipe_bytes += (size_t)n;
+                x->body_spliced = 1;
+                progress = 1;
+            } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                return -2;
+            }
+        }
+        if (x->req_pipe_bytes > 0) {
+            ssize_t n = splice(u->req_pipe[0], NULL, u->fd, NULL, x->req_pipe_bytes,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                x->req_pipe_bytes -= (size_t)n;
+                progress = 1;
+            } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                return -1;
+            }
+        }
+        if (!progress) break;
+    }
+    if (x->head_off == x->head_len && x->req_body_left == 0 && x->req_pipe_bytes == 0) {
+        x->state = PX_READ_HEAD;
+    }
+    return 0;
+}
+
+/* Peek a CRLF-terminated line from the upstream socket without consuming it.
+ * Returns its length, 0 if incomplete, -1 on EOF/error/overlong line. */
+static ssize_t peek_line(int fd, char *buf, size_t cap) {
+    ssize_t n = recv(fd, buf, cap, MSG_PEEK);
+    if (n == 0) return -1;
+    if (n < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    char *le = memmem(buf, (size_t)n, "\r\n", 2);
+    if (!le) return (size_t)n == cap ? -1 : 0;
+    return (le - buf) + 2;
+}
+
+/* Consume a line that was peeked and copy it into the response pipe. */
+static int forward_line(proxy_exchange_t *x, const char *line, size_t len) {
+    char sink[PROXY_MAX_CHUNK_LINE];
+    if (recv(x->up->fd, sink, len, 0) != (ssize_t)len) return -1;
+    if (write(x->up->resp_pipe[1], line, len) != (ssize_t)len) return -1;
+    x->resp_pipe_bytes += len;
+    return 0;
+}
+
+/* Fill the response pipe from the upstream socket honoring the framing.
+ * Returns 1 on progress, 0 if blocked, -1 on upstream error. */
+static int fill_response(proxy_exchange_t *x) {
+    upstream_conn_t *u = x->up;
+    size_t room = u->pipe_cap - x->resp_pipe_bytes;
+    if (x->resp_done || room < PROXY_MAX_CHUNK_LINE) return 0;
+    if (x->resp.mode == PROXY_RESP_LENGTH || x->resp.mode == PROXY_RESP_EOF ||
+        (x->resp.mode == PROXY_RESP_CHUNKED && x->chunk_state == CH_DATA)) {
+        size_t want = room;
+        if (x->resp.mode != PROXY_RESP_EOF && want > x->resp_left) want = x->resp_left;
+        ssize_t n = splice(u->fd, NULL, u->resp_pipe[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            x->resp_pipe_bytes += (size_t)n;
+            if (x->resp.mode != PROXY_RESP_EOF) {
+                x->resp_left -= (size_t)n;
+                if (x->resp_left == 0) {
+                    if (x->resp.mode == PROXY_RESP_LENGTH) x->resp_done = 1;
+                    else x->chunk_state = CH_DATA_CRLF;
+                }
+            }
+            return 1;
+        }
+        if (n == 0) {
+            if (x->resp.mode == PROXY_RESP_EOF) {
+                x->resp_done = 1;
+                return 1;
+            }
+            return -1; /* truncated body */
+        }
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    /* chunk framing lines are small and copied through userspace */
+    char line[PROXY_MAX_CHUNK_LINE];
+    ssize_t ll = peek_line(u->fd, line, x->chunk_state == CH_DATA_CRLF ? 2 : sizeof(line));
+    if (ll <= 0) return (int)ll;
+    switch (x->chunk_state) {
+    case CH_SIZE: {
+        size_t sz;
+        if (proxy_parse_chunk_size(line, (size_t)ll, &sz) != 0) return -1;
+        if (forward_line(x, line, (size_t)ll) != 0) return -1;
+        x->resp_left = sz;
+        x->chunk_state = sz ? CH_DATA : CH_TRAILER;
+        return 1;
+    }
+    case CH_DATA_CRLF:
+        if (ll != 2) return -1;
+        if (forward_line(x, line, 2) != 0) return -1;
+        x->chunk_state = CH_SIZE;
+        return 1;
+    case CH_TRAILER:
+        if (forward_line(x, line, (size_t)ll) != 0) return -1;
+        if (ll == 2) x->resp_done = 1;
+        return 1;
+    }
+    return -1;
+}
+
+/* Returns -1 on upstream error, -2 on client error, 1 when the response is
+ * complete, 0 otherwise. */
+static int pump_response(connection_t *c) {
+    proxy_exchange_t *x = c->proxy;
+    upstream_conn_t *u = x->up;
+    for (;;) {
+        int progress = 0;
+        int r = fill_response(x);
+        if (r < 0) return -1;
+        if (r > 0) progress = 1;
+        /* anything queued in c->wbuf (100 Continue) must reach the client first */
+        if (x->resp_pipe_bytes > 0 && c->woff == c->wlen) {
+            ssize_t n = splice(u->resp_pipe[0], NULL, c->fd, NULL, x->resp_pipe_bytes,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                x->resp_pipe_bytes -= (size_t)n;
+                x->resp_started = 1;
+                progress = 1;
+            } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+                return -2;
+            }
+        }
+        if (!progress) break;
+    }
+    return x->resp_done && x->resp_pipe_bytes == 0;
+}
+
+/* Read the upstream response head with MSG_PEEK so that no body byte is
+ * pulled into userspace. Returns 1 when the head was handled, 0 if more data
+ * is needed, -1 on upstream error. */
+static int read_response_head(worker_t *w, connection_t *c) {
+    proxy_exchange_t *x = c->proxy;
+    upstream_conn_t *u = x->up;
+    char head[PROXY_MAX_RESP_HEAD];
+    ssize_t n = recv(u->fd, head, sizeof(head), MSG_PEEK);
+    if (n == 0) return -1;
+    if (n < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    char *end = memmem(head, (size_t)n, "\r\n\r\n", 4);
+    if (!end) {
+        if ((size_t)n == sizeof(head)) {
+            exchange_fail(w, c, "502 Bad Gateway");
+            return 1;
+        }
+        return 0;
+    }
+    size_t hlen = (size_t)(end - head) + 4;
+    char out[PROXY_MAX_RESP_HEAD + 64];
+    int olen = proxy_rewrite_response_head(head, hlen, x->head_request, c->should_close, &x->resp, out,
+                                           sizeof(out));
+    if (olen < 0 || recv(u->fd, head, hlen, 0) != (ssize_t)hlen) {
+        x->resp_started = 1; /* never retry a request the upstream answered */
+        exchange_fail(w, c, "502 Bad Gateway");
+        return 1;
+    }
+    /* the head goes through the response pipe so it stays ordered with the body */
+    if (write(u->resp_pipe[1], out, (size_t)olen) != olen) return -1;
+    x->resp_pipe_bytes += (size_t)olen;
+    x->resp_started = 1;
+    if (x->resp.status < 200) {
+        /* interim response: forward it and wait for the final head */
+        return 1;
+    }
+    free(x->head);
+    x->head = NULL;
+    if (x->resp.mode == PROXY_RESP_EOF) c->should_close = 1;
+    x->resp_left = x->resp.content_length;
+    x->chunk_state = CH_SIZE;
+    x->resp_done = x->resp.mode == PROXY_RESP_NONE ||
+                   (x->resp.mode == PROXY_RESP_LENGTH && x->resp_left == 0);
+    x->state = PX_BODY;
+    return 1;
+}
+
+/*
+ * Drive the exchange as far as the sockets allow.
+ * Returns 1 if the exchange completed, 0 if still in flight or the client was
+ * closed or answered with an error (c->proxy cleared, c->fd may be -1).
+ */
+static int exchange_progress(worker_t *w, connection_t *c) {
+    for (;;) {
+        proxy_exchange_t *x = c->proxy;
+        if (!x || c->fd < 0) return 0;
+        if (x->state == PX_SEND_REQ) {
+            int r = pump_request(c);
+            if (r == -2) {
+                conn_close(w, c);
+                return 0;
+            }
+            if (r == -1) {
+                if (exchange_upstream_error(w, c)) return c->fd >= 0 && !c->proxy;
+                continue;
+            }
+            if (x->state == PX_SEND_REQ) break;
+        }
+        if (x->state == PX_READ_HEAD) {
+            int r = read_response_head(w, c);
+            if (r < 0) {
+                if (exchange_upstream_error(w, c)) return c->fd >= 0 && !c->proxy;
+                continue;
+            }
+            if (!c->proxy) return c->fd >= 0; /* answered with an error */
+            if (r == 0) break;
+            continue;
+        }
+        if (x->state == PX_BODY) {
+            int r = pump_response(c);
+            if (r == -2) {
+                conn_close(w, c);
+                return 0;
+            }
+            if (r == -1) {
+                /* part of the response is already on the wire: just cut the client */
+                x->resp_started = 1;
+                exchange_upstream_error(w, c);
+                return 0;
+            }
+            if (r == 1) {
+                exchange_finish(w, c, !x->resp.upstream_close);
+                return 1;
+            }
+        }
+        break;
+    }
+    exchange_update_events(w, c);
+    return 0;
+}
+
+int proxy_on_client_event(worker_t *w, connection_t *c, uint32_t events) {
+    if (events & (EPOLLERR | EPOLLHUP)) {
+        conn_close(w, c);
+        return 0;
+    }
+    if ((events & EPOLLOUT) && c->woff < c->wlen) {
+        if (conn_flush(w, c) < 0) {
+            conn_close(w, c);
+            return 0;
+        }
+    }
+    return exchange_progress(w, c);
+}
+
+connection_t *proxy_on_upstream_event(worker_t *w, upstream_conn_t *u, uint32_t events) {
+    if (u->fd < 0) return NULL;
+    connection_t *c = u->client;
+    if (!c) {
+        /* idle pooled socket: the upstream closed it (or sent garbage) */
+        pool_unlink_idle(u->pool, u);
+        upstream_destroy(w, u);
+        return NULL;
+    }
+    proxy_exchange_t *x = c->proxy;
+    if (x->state == PX_CONNECTING) {
+        int err = 0;
+        socklen_t elen = sizeof(err);
+        if (getsockopt(u->fd, SOL_SOCKET, SO_ERROR, &err, &elen) < 0 || err != 0 || (events & EPOLLERR)) {
+            exchange_upstream_error(w, c);
+            return c->fd >= 0 && !c->proxy ? c : NULL;
+        }
+        u->connecting = 0;
+        x->state = PX_SEND_REQ;
+    } else if ((events & EPOLLERR) || ((events & EPOLLHUP) && !(u->events & EPOLLIN))) {
+        /* nothing would read the socket to notice the failure; level-triggered
+         * HUP would otherwise keep firing */
+        if (x->state == PX_BODY) x->resp_started = 1;
+        if (exchange_upstream_error(w, c)) return c->fd >= 0 && !c->proxy ? c : NULL;
+        return NULL;
+    }
+    return exchange_progress(w, c) ? c : NULL;
+}
@@ -0,0 +1,102 @@
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <netinet/in.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "conn.h"
+
+/*
+ * Reverse proxy: requests matching a configured path prefix are forwarded to
+ * an upstream server. Upstream sockets live in the same epoll set as client
+ * connections and are kept in a per-route keep-alive pool. Request and
+ * response bodies are moved socket -> pipe -> socket with splice(), so only
+ * the header blocks (and chunk-size lines) are ever copied into userspace.
+ */
+
+typedef struct upstream_conn_s {
+    int kind; /* EV_UPSTREAM */
+    int fd;
+    struct upstream_pool_s *pool;
+    int req_pipe[2];  /* client -> upstream */
+    int resp_pipe[2]; /* upstream -> client */
+    size_t pipe_cap;
+    uint32_t events;
+    int connecting;
+    unsigned requests;      /* requests completed on this connection */
+    connection_t *client;   /* NULL while idle in the pool */
+    struct upstream_conn_s *next_idle;
+} upstream_conn_t;
+
+typedef struct upstream_pool_s {
+    const proxy_route_t *route;
+    struct sockaddr_in addr;
+    int addr_ok;
+    upstream_conn_t *idle; /* LIFO: the most recently used socket is reused first */
+    int idle_count;
+    int max_idle;
+} upstream_pool_t;
+
+/* Response framing as read from the upstream head */
+enum proxy_resp_mode {
+    PROXY_RESP_NONE = 0, /* no body (HEAD, 1xx, 204, 304) */
+    PROXY_RESP_LENGTH,   /* Content-Length */
+    PROXY_RESP_CHUNKED,  /* Transfer-Encoding: chunked */
+    PROXY_RESP_EOF       /* delimited by upstream close */
+};
+
+typedef struct proxy_resp_head_s {
+    int status;
+    int mode;             /* enum proxy_resp_mode */
+    size_t content_length;
+    int upstream_close;   /* upstream will not keep the connection open */
+} proxy_resp_head_t;
+
+/* Create one pool per configured route; resolves upstream addresses. Returns 0/-1. */
+int proxy_init(worker_t *w);
+
+/* Close every pooled upstream connection and free the pools. */
+void proxy_shutdown(worker_t *w);
+
+/*
+ * Start forwarding the request just parsed on c (the header block has already
+ * been removed from c->buf). Any error response is queued on c.
+ * Returns 0 if the exchange is in flight (c->proxy set) or 1 if the request
+ * was answered locally.
+ */
+int proxy_start(worker_t *w, connection_t *c, upstream_pool_t *pool);
+
+/* Find the pool for a request path, or NULL if it is not proxied. */
+upstream_pool_t *proxy_match(worker_t *w, const char *path);
+
+/* Handle an epoll event on a client that has an exchange in flight.
+ * Returns 1 when the exchange finished and c is ready for its next request,
+ * 0 otherwise (c may have been closed: check c->fd). */
+int proxy_on_client_event(worker_t *w, connection_t *c, uint32_t events);
+
+/* Handle an epoll event on an upstream socket. Returns the client whose
+ * exchange finished as a result, or NULL. */
+connection_t *proxy_on_upstream_event(worker_t *w, upstream_conn_t *u, uint32_t events);
+
+/* Drop the exchange of a client that is being closed. */
+void proxy_abort(worker_t *w, connection_t *c);
+
+/*
+ * Parse an upstream response head (up to and including CRLFCRLF) and build the
+ * head forwarded to the client into out (hop-by-hop headers replaced by a
+ * Connection header). Returns the length written to out, or -1 if the head is
+ * malformed or does not fit.
+ */
+int proxy_rewrite_response_head(const char *head, size_t len, int head_request,
+                                int client_close, proxy_resp_head_t *info,
+                                char *out, size_t outlen);
+
+/* Build the request head sent upstream from a parsed client request: the
+ * request line and end-to-end headers, plus "Connection: keep-alive".
+ * Returns the length written to out, or -1 if it does not fit. */
+int proxy_build_request_head(http_parser_t *p, char *out, size_t outlen);
+
+/* Parse a chunk-size line ("1a;ext=x\r\n"). Returns 0 and sets *size, or -1. */
+int proxy_parse_chunk_size(const char *line, size_t len, size_t *size);
+
+#endif
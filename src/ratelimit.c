@@ -0,0 +1,99 @@
+#define _GNU_SOURCE
+#include "ratelimit.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+#define TOKEN 1000000 /* a request, in micro-tokens */
+
+typedef struct rl_slot_s {
+    uint32_t key;
+    uint32_t stamp; /* now_ms of the last update, truncated; 0 = never used */
+    int64_t tokens; /* micro-tokens */
+} rl_slot_t;
+
+typedef struct rl_group_s {
+    pthread_mutex_t lock;
+    rl_slot_t slot[RATELIMIT_GROUP];
+} rl_group_t;
+
+struct ratelimit_s {
+    rl_group_t *groups;
+    size_t ngroups; /* power of two */
+    int shift;      /* 32 - log2(ngroups), for Fibonacci hashing */
+    int64_t refill; /* micro-tokens per millisecond == milli-tokens per second */
+    int64_t cap;    /* micro-tokens */
+};
+
+ratelimit_t *ratelimit_new(size_t slots, double rate, double burst) {
+    if (!(rate > 0) || !(burst >= 1)) return NULL;
+    ratelimit_t *rl = calloc(1, sizeof(*rl));
+    if (!rl) return NULL;
+    size_t ng = 1;
+    int bits = 0;
+    while (ng * RATELIMIT_GROUP < slots && bits < 24) {
+        ng <<= 1;
+        bits++;
+    }
+    rl->ngroups = ng;
+    rl->shift = 32 - bits;
+    /* keep the capacity far from the int64_t range; a refill above it fills
+     * the bucket within a millisecond either way */
+    if (burst > 1e9) burst = 1e9;
+    rl->cap = (int64_t)(burst * TOKEN + 0.5);
+    rl->refill = rate * 1000 >= rl->cap ? rl->cap : (int64_t)(rate * 1000 + 0.5);
+    if (rl->refill < 1) rl->refill = 1;
+    rl->groups = calloc(ng, sizeof(rl_group_t));
+    if (!rl->groups) {
+        free(rl);
+        return NULL;
+    }
+    for (size_t i = 0; i < ng; ++i) pthread_mutex_init(&rl->groups[i].lock, NULL);
+    return rl;
+}
+
+void ratelimit_free(ratelimit_t *rl) {
+    if (!rl) return;
+    for (size_t i = 0; i < rl->ngroups; ++i) pthread_mutex_destroy(&rl->groups[i].lock);
+    free(rl->groups);
+    free(rl);
+}
+
+/* Bucket level after refilling up to now; saturates at cap. The gap is
+ * checked before multiplying: a long-idle slot at a high rate would
+ * overflow the product. */
+static int64_t refilled(const ratelimit_t *rl, const rl_slot_t *s, uint32_t now) {
+    uint32_t elapsed = now - s->stamp;
+    if (elapsed > (rl->cap - s->tokens) / rl->refill) return rl->cap;
+    return s->tokens + (int64_t)elapsed * rl->refill;
+}
+
+int ratelimit_allow(ratelimit_t *rl, uint32_t key, uint64_t now_ms) {
+    uint32_t now = (uint32_t)now_ms | 1; /* keep 0 as the "unused" marker */
+    size_t gi = rl->shift >= 32 ? 0 : (size_t)((key * 2654435769u) >> rl->shift);
+    rl_group_t *g = &rl->groups[gi];
+    pthread_mutex_lock(&g->lock);
+    rl_slot_t *hit = NULL, *reuse = NULL, *oldest = NULL;
+    for (int i = 0; i < RATELIMIT_GROUP; ++i) {
+        rl_slot_t *s = &g->slot[i];
+        if (s->stamp && s->key == key) {
+            hit = s;
+            break;
+        }
+        /* a never-used slot or a bucket that has refilled completely carries no state */
+        if (!reuse && (!s->stamp || refilled(rl, s, now) >= rl->cap)) reuse = s;
+        if (!oldest || (uint32_t)(now - s->stamp) > (uint32_t)(now - oldest->stamp)) oldest = s;
+    }
+    if (!hit) {
+        hit = reuse ? reuse : oldest;
+        hit->key = key;
+        hit->tokens = rl->cap;
+        hit->stamp = now;
+    } else {
+        hit->tokens = refilled(rl, hit, now);
+        hit->stamp = now;
+    }
+    int ok = hit->tokens >= TOKEN;
+    if (ok) hit->tokens -= TOKEN;
+    pthread_mutex_unlock(&g->lock);
+    return ok;
+}
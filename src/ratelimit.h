@@ -0,0 +1,30 @@
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Per-client token buckets in a fixed-size open-addressing table shared by
+ * all workers. Keys hash to a group of RATELIMIT_GROUP slots that is probed
+ * linearly under a per-group lock. There is no sweeper: a slot whose bucket
+ * would have refilled completely is indistinguishable from an empty one and
+ * is simply reused by the next key that probes it. When every slot of a
+ * group is in active use, the least recently touched one is evicted.
+ */
+
+#define RATELIMIT_GROUP 8
+
+typedef struct ratelimit_s ratelimit_t;
+
+/* slots is rounded up to a power-of-two number of groups. rate is the
+ * refill in tokens per second, burst the bucket capacity; both may be
+ * fractional (buckets count micro-tokens, so 0.2 is one request per 5s). */
+ratelimit_t *ratelimit_new(size_t slots, double rate, double burst);
+void ratelimit_free(ratelimit_t *rl);
+
+/* Take one token for key at now_ms (any monotonic millisecond clock).
+ * Returns 1 if allowed, 0 if the key is over its rate. */
+int ratelimit_allow(ratelimit_t *rl, uint32_t key, uint64_t now_ms);
+
+#endif
@@ -0,0 +1,399 @@
+#define _GNU_SOURCE
+#include "sse.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SSE_MAX_EVENT_NAME 64
+
+/* ---- event format ---- */
+
+typedef struct out_s {
+    char *p;
+    size_t cap, len;
+} out_t;
+
+static void put(out_t *o, const char *s, size_t n) {
+    if (o->len < o->cap) memcpy(o->p + o->len, s, o->len + n <= o->cap ? n : o->cap - o->len);
+    o->len += n;
+}
+
+size_t sse_format(char *out, size_t outlen, uint64_t id, const char *event, const char *data, size_t len) {
+    out_t o = { out, out ? outlen : 0, 0 };
+    char num[32];
+    int n = snprintf(num, sizeof(num), "id: %llu\n", (unsigned long long)id);
+    put(&o, num, (size_t)n);
+    if (event && *event) {
+        put(&o, "event: ", 7);
+        put(&o, event, strlen(event));
+        put(&o, "\n", 1);
+    }
+    /* a field cannot hold a line break: each line of data is a field of its
+     * own, and the client joins them again with "\n" */
+    size_t i = 0;
+    for (;;) {
+        size_t start = i;
+        while (i < len && data[i] != '\n' && data[i] != '\r') i++;
+        put(&o, "data: ", 6);
+        put(&o, data + start, i - start);
+        put(&o, "\n", 1);
+        if (i == len) break;
+        if (data[i] == '\r' && i + 1 < len && data[i + 1] == '\n') i++;
+        i++;
+    }
+    put(&o, "\n", 1);
+    return o.len;
+}
+
+/* ---- hub ---- */
+
+typedef struct sse_event_s {
+    uint64_t id;
+    uint64_t channel;
+    shared_buf_t *buf;
+} sse_event_t;
+
+struct sse_hub_s {
+    /* held while an event is numbered and handed to the workers, so every
+     * inbox sees ids in increasing order */
+    pthread_mutex_t lock;
+    uint64_t seq;         /* id of the newest event */
+    sse_event_t *ring;    /* the last cap events, oldest at head */
+    size_t cap, head, len;
+};
+
+sse_hub_t *sse_hub_new(size_t replay) {
+    sse_hub_t *hub = calloc(1, sizeof(*hub));
+    if (!hub) return NULL;
+    if (replay && !(hub->ring = calloc(replay, sizeof(*hub->ring)))) {
+        free(hub);
+        return NULL;
+    }
+    hub->cap = replay;
+    pthread_mutex_init(&hub->lock, NULL);
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    hub->seq = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+    return hub;
+}
+
+void sse_hub_free(sse_hub_t *hub) {
+    if (!hub) return;
+    for (size_t i = 0; i < hub->len; ++i) shared_buf_unref(hub->ring[(hub->head + i) % hub->cap].buf);
+    free(hub->ring);
+    pthread_mutex_destroy(&hub->lock);
+    free(hub);
+}
+
+static void ring_push(sse_hub_t *hub, uint64_t id, uint64_t channel, shared_buf_t *b) {
+    if (!hub->cap) return;
+    sse_event_t *e;
+    if (hub->len == hub->cap) {
+        e = &hub->ring[hub->head];
+        shared_buf_unref(e->buf);
+        hub->head = (hub->head + 1) % hub->cap;
+    } else {
+        e = &hub->ring[(hub->head + hub->len++) % hub->cap];
+    }
+    shared_buf_ref(b);
+    e->id = id;
+    e->channel = channel;
+    e->buf = b;
+}
+
+/* ---- connections ---- */
+
+typedef struct sse_conn_s {
+    connection_t *conn;
+    uint64_t channel;              /* hash of the request path */
+    uint64_t last_id;              /* newest event already queued or skipped */
+    int done;                      /* close the socket once the output is flushed */
+    struct sse_conn_s *prev, *next; /* worker's subscribers */
+} sse_conn_t;
+
+typedef struct sse_pending_s {
+    shared_buf_t *event;
+    uint64_t channel;
+    uint64_t id;
+} sse_pending_t;
+
+typedef struct sse_worker_s {
+    sse_conn_t *subs;
+    size_t nsubs;
+    /* events from any thread; swapped with work by the owner */
+    pthread_mutex_t lock;
+    sse_pending_t *inbox;
+    size_t inbox_len, inbox_cap;
+    sse_pending_t *work;
+    size_t work_cap;
+} sse_worker_t;
+
+int sse_init(worker_t *w) {
+    sse_worker_t *sw = calloc(1, sizeof(*sw));
+    if (!sw) return -1;
+    pthread_mutex_init(&sw->lock, NULL);
+    w->sse = sw;
+    return 0;
+}
+
+void sse_shutdown(worker_t *w) {
+    sse_worker_t *sw = w->sse;
+    if (!sw) return;
+    for (size_t i = 0; i < sw->inbox_len; ++i) shared_buf_unref(sw->inbox[i].event);
+    free(sw->inbox);
+    free(sw->work);
+    pthread_mutex_destroy(&sw->lock);
+    free(sw);
+    w->sse = NULL;
+}
+
+static const char *request_header(connection_t *c, const char *name) {
+    int hcount = http_parser_header_count(&c->parser);
+    for (int i = 0; i < hcount; ++i) {
+        const char *hn = http_parser_header_name(&c->parser, i);
+        if (hn && strcasecmp(hn, name) == 0) return http_parser_header_value(&c->parser, i);
+    }
+    return NULL;
+}
+
+static int reply(worker_t *w, connection_t *c, const char *status, const char *extra, const char *body) {
+    char resp[512];
+    size_t blen = body ? strlen(body) : 0;
+    int n = snprintf(resp, sizeof(resp), "HTTP/1.1 %s\r\n%s%sContent-Length: %zu\r\nConnection: %s\r\n\r\n%s",
+                     status, extra, body ? "Content-Type: text/plain; charset=utf-8\r\n" : "", blen,
+                     c->should_close ? "close" : "keep-alive", body ? body : "");
+    return conn_send(w, c, resp, (size_t)n);
+}
+
+/*
+ * The event type from the query string ("event=NAME"). Names are limited to
+ * a safe character set since they are written into the stream verbatim.
+ * Returns 0 with name set (empty if absent), -1 if the name is not allowed.
+ */
+static int query_event(const char *path, char name[SSE_MAX_EVENT_NAME + 1]) {
+    name[0] = '\0';
+    const char *q = strchr(path, '?');
+    while (q) {
+        q++;
+        if (strncmp(q, "event=", 6) == 0) {
+            q += 6;
+            size_t n = strcspn(q, "&");
+            if (n > SSE_MAX_EVENT_NAME) return -1;
+            for (size_t i = 0; i < n; ++i) {
+                if (!isalnum((unsigned char)q[i]) && !strchr("_.-", q[i])) return -1;
+            }
+            memcpy(name, q, n);
+            name[n] = '\0';
+            return 0;
+        }
+        q = strchr(q, '&');
+    }
+    return 0;
+}
+
+/* POST: the buffered body becomes one event; the reply carries its id. */
+static int publish(worker_t *w, connection_t *c, const char *path) {
+    char name[SSE_MAX_EVENT_NAME + 1];
+    if (query_event(path, name) != 0) return reply(w, c, "400 Bad Request", "", "invalid event name\n");
+    uint64_t id = sse_publish(w->srv, path, name, c->buf, c->body_len);
+    if (!id) return reply(w, c, "500 Internal Server Error", "", NULL);
+    char body[32];
+    snprintf(body, sizeof(body), "%llu\n", (unsigned long long)id);
+    return reply(w, c, "200 OK", "", body);
+}
+
+/* GET: answer with an open-ended stream, replay what the client missed and
+ * register for what comes next. */
+static int subscribe(worker_t *w, connection_t *c, const char *path) {
+    if (w->draining) {
+        /* the successor takes new subscribers */
+        char extra[64];
+        snprintf(extra, sizeof(extra), "Retry-After: %d\r\n", w->cfg->retry_after);
+        return reply(w, c, "503 Service Unavailable", extra, NULL);
+    }
+    sse_conn_t *s = calloc(1, sizeof(*s));
+    if (!s) return -1;
+    /* no Content-Length: the stream ends when the connection does */
+    static const char head[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                               "Connection: close\r\n\r\n";
+    if (conn_send(w, c, head, sizeof(head) - 1) < 0) {
+        free(s);
+        return -1;
+    }
+    s->conn = c;
+    s->channel = conn_channel(path);
+    const char *lei = request_header(c, "Last-Event-ID");
+    uint64_t last = 0;
+    int resume = 0;
+    if (lei && isdigit((unsigned char)*lei)) {
+        char *end;
+        errno = 0;
+        last = strtoull(lei, &end, 10);
+        resume = !*end && !errno;
+    }
+    sse_hub_t *hub = w->srv->sse;
+    pthread_mutex_lock(&hub->lock);
+    if (resume && last < hub->seq) {
+        for (size_t i = 0; i < hub->len; ++i) {
+            sse_event_t *e = &hub->ring[(hub->head + i) % hub->cap];
+            if (e->id > last && e->channel == s->channel && conn_queue_shared(c, e->buf) < 0) break;
+        }
+    }
+    /* anything older is either replayed above or not wanted; events already
+     * waiting in this worker's inbox are skipped by the fan-out */
+    s->last_id = hub->seq;
+    pthread_mutex_unlock(&hub->lock);
+    sse_worker_t *sw = w->sse;
+    s->next = sw->subs;
+    if (sw->subs) sw->subs->prev = s;
+    sw->subs = s;
+    sw->nsubs++;
+    c->sse = s;
+    c->should_close = 0;
+    return conn_pending(c) && conn_flush(w, c) < 0 ? -1 : 0;
+}
+
+int sse_request(worker_t *w, connection_t *c, const char *path) {
+    const char *method = http_parser_method(&c->parser) ?: "";
+    if (strcmp(method, "GET") == 0) return subscribe(w, c, path);
+    if (strcmp(method, "POST") == 0) return publish(w, c, path);
+    return reply(w, c, "405 Method Not Allowed", "Allow: GET, POST\r\n", NULL);
+}
+
+void sse_abort(worker_t *w, connection_t *c) {
+    sse_conn_t *s = c->sse;
+    sse_worker_t *sw = w->sse;
+    if (s->prev) s->prev->next = s->next;
+    else sw->subs = s->next;
+    if (s->next) s->next->prev = s->prev;
+    sw->nsubs--;
+    c->sse = NULL;
+    /* the fan-out loop may still be looking at it */
+    worker_defer_free(w, s);
+}
+
+void sse_on_client_event(worker_t *w, connection_t *c, uint32_t events) {
+    if (events & EPOLLOUT) {
+        int fr = conn_flush(w, c);
+        if (fr < 0 || (fr == 1 && c->sse->done)) {
+            conn_close(w, c);
+            return;
+        }
+    }
+    if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return;
+    /* the client has nothing more to say; whatever it sends is discarded, a
+     * bounded amount per event like any other read */
+    for (int i = 0; i < 16; ++i) {
+        ssize_t r = recv(c->fd, c->buf, sizeof(c->buf), 0);
+        if (r > 0) continue;
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        /* EOF or error: the subscriber went away */
+        conn_close(w, c);
+        return;
+    }
+}
+
+/* ---- fan-out ---- */
+
+uint64_t sse_publish(server_t *srv, const char *channel, const char *event, const char *data, size_t len) {
+    sse_hub_t *hub = srv->sse;
+    if (!hub) return 0;
+    /* sized for the longest id, formatted once the id is known */
+    size_t max = sse_format(NULL, 0, UINT64_MAX, event, data, len);
+    shared_buf_t *b = shared_buf_new(NULL, max);
+    if (!b) return 0;
+    uint64_t ch = conn_channel(channel);
+    int wake[CONFIG_MAX_WORKERS] = { 0 };
+    pthread_mutex_lock(&hub->lock);
+    uint64_t id = ++hub->seq;
+    b->len = sse_format(b->data, max, id, event, data, len);
+    ring_push(hub, id, ch, b);
+    for (int i = 0; i < srv->nworkers; ++i) {
+        sse_worker_t *sw = srv->workers[i].sse;
+        if (!sw) continue;
+        pthread_mutex_lock(&sw->lock);
+        if (sw->inbox_len == sw->inbox_cap) {
+            size_t ncap = sw->inbox_cap ? sw->inbox_cap * 2 : 64;
+            sse_pending_t *ni = realloc(sw->inbox, ncap * sizeof(*ni));
+            if (!ni) {
+                pthread_mutex_unlock(&sw->lock);
+                fprintf(srv->logf, "events: worker %d misses event %llu: out of memory\n", i,
+                        (unsigned long long)id);
+                continue;
+            }
+            sw->inbox = ni;
+            sw->inbox_cap = ncap;
+        }
+        shared_buf_ref(b);
+        sw->inbox[sw->inbox_len].event = b;
+        sw->inbox[sw->inbox_len].channel = ch;
+        sw->inbox[sw->inbox_len].id = id;
+        /* one wakeup per batch: a non-empty inbox is already signalled */
+        wake[i] = sw->inbox_len++ == 0;
+        pthread_mutex_unlock(&sw->lock);
+    }
+    pthread_mutex_unlock(&hub->lock);
+    shared_buf_unref(b);
+    for (int i = 0; i < srv->nworkers; ++i) {
+        uint64_t one = 1;
+        if (wake[i] && write(srv->workers[i].notify.fd, &one, sizeof(one)) < 0) perror("sse notify");
+    }
+    return id;
+}
+
+void sse_worker_notified(worker_t *w) {
+    sse_worker_t *sw = w->sse;
+    if (!sw) return;
+    pthread_mutex_lock(&sw->lock);
+    sse_pending_t *batch = sw->inbox;
+    size_t n = sw->inbox_len, cap = sw->inbox_cap;
+    sw->inbox = sw->work;
+    sw->inbox_cap = sw->work_cap;
+    sw->inbox_len = 0;
+    pthread_mutex_unlock(&sw->lock);
+    sw->work = batch;
+    sw->work_cap = cap;
+    if (!n) return;
+    size_t limit = (size_t)w->cfg->events_backlog_kb * 1024;
+    /* queue the whole batch on each subscriber, then write it with one writev */
+    for (sse_conn_t *s = sw->subs, *next; s; s = next) {
+        next = s->next;
+        connection_t *c = s->conn;
+        if (s->done) continue;
+        int queued = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (batch[i].id <= s->last_id || batch[i].channel != s->channel) continue;
+            if (c->sq_bytes > limit) {
+                /* it can reconnect with Last-Event-ID once it catches up */
+                fprintf(w->logf, "events fd=%d dropped: %zu bytes behind\n", c->fd, c->sq_bytes);
+                fflush(w->logf);
+                conn_close(w, c);
+                queued = 0;
+                break;
+            }
+            if (conn_queue_shared(c, batch[i].event) < 0) break;
+            s->last_id = batch[i].id;
+            queued = 1;
+        }
+        if (queued && conn_flush(w, c) < 0) conn_close(w, c);
+    }
+    for (size_t i = 0; i < n; ++i) shared_buf_unref(batch[i].event);
+}
+
+void sse_drain(worker_t *w) {
+    sse_worker_t *sw = w->sse;
+    if (!sw) return;
+    for (sse_conn_t *s = sw->subs, *next; s; s = next) {
+        next = s->next;
+        s->done = 1;
+        if (!conn_pending(s->conn)) conn_close(w, s->conn);
+    }
+}
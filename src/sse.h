@@ -0,0 +1,65 @@
+#ifndef SSE_H
+#define SSE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "conn.h"
+
+/*
+ * Server-Sent Events. A GET below cfg->events_path becomes a streaming
+ * text/event-stream response: the head has no Content-Length, the connection
+ * never returns to the request parser, and events are appended to its write
+ * queue until either side closes. A POST to the same path publishes its body
+ * as one event (query "?event=NAME" sets the event type). Every path is a
+ * channel.
+ *
+ * An event is serialized once into a shared_buf_t. Each subscriber's write
+ * queue references it, with no per-subscriber copy. Events carry
+ * increasing ids; the last cfg->events_replay of them stay in a ring shared by
+ * all workers, so a client reconnecting with Last-Event-ID gets what it
+ * missed. Ids start at the wall clock in microseconds, so they keep growing
+ * across an upgrade even though the ring does not survive it.
+ */
+
+typedef struct sse_hub_s sse_hub_t;
+
+/* The process-wide id sequence and replay ring (replay may be 0). */
+sse_hub_t *sse_hub_new(size_t replay);
+void sse_hub_free(sse_hub_t *hub);
+
+/*
+ * Serialize an event: "id:", an optional "event:" line, and one "data:" line
+ * per line of data (any of CRLF, LF, CR ends a line). Writes at most outlen
+ * bytes to out (which may be NULL) and returns the full length.
+ */
+size_t sse_format(char *out, size_t outlen, uint64_t id, const char *event, const char *data, size_t len);
+
+/* Publish to every subscriber of channel (a request path) on every worker.
+ * Callable from any thread. Returns the event id, or 0 if out of memory. */
+uint64_t sse_publish(server_t *srv, const char *channel, const char *event, const char *data, size_t len);
+
+/* Per-worker subscriber list and inbox. Returns 0/-1. */
+int sse_init(worker_t *w);
+void sse_shutdown(worker_t *w);
+
+/*
+ * Handle a request below cfg->events_path whose body (c->body_len bytes) is
+ * buffered at the start of c->buf. A GET turns c into a subscriber (c->sse
+ * set). Returns 0, or -1 on a fatal send error.
+ */
+int sse_request(worker_t *w, connection_t *c, const char *path);
+
+/* Handle an epoll event on a subscriber. May close c. */
+void sse_on_client_event(worker_t *w, connection_t *c, uint32_t events);
+
+/* Deliver the events queued for this worker. */
+void sse_worker_notified(worker_t *w);
+
+/* End every stream once its queued events are written; clients reconnect
+ * (to the successor) with Last-Event-ID. */
+void sse_drain(worker_t *w);
+
+/* Drop the subscriber state of a connection that is being closed. */
+void sse_abort(worker_t *w, connection_t *c);
+
+#endif
@@ -0,0 +1,67 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *phase_names[TRACE_NPHASES] = {
+    "accept", "first_byte", "header", "parsed", "resolved", "io", "queued", "flushed",
+};
+
+int trace_ring_init(trace_ring_t *r, size_t cap) {
+    r->slots = calloc(cap, sizeof(trace_slot_t));
+    if (!r->slots) return -1;
+    r->cap = cap;
+    atomic_init(&r->head, 0);
+    return 0;
+}
+
+void trace_ring_free(trace_ring_t *r) {
+    free(r->slots);
+    r->slots = NULL;
+    r->cap = 0;
+}
+
+void trace_ring_push(trace_ring_t *r, const trace_rec_t *rec) {
+    size_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+    trace_slot_t *s = &r->slots[h % r->cap];
+    /* seqlock: readers retry or skip a slot whose sequence is odd or moved */
+    unsigned seq = atomic_load_explicit(&s->seq, memory_order_relaxed);
+    atomic_store_explicit(&s->seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&s->rec, rec, sizeof(*rec));
+    atomic_store_explicit(&s->seq, seq + 2, memory_order_release);
+    atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+int trace_format(const trace_rec_t *rec, char *buf, size_t len) {
+    uint64_t base = 0;
+    for (int i = 0; i < TRACE_NPHASES && !base; ++i) base = rec->t[i];
+    int off = snprintf(buf, len, "fd=%d %s %s", rec->fd, rec->method[0] ? rec->method : "-",
+                       rec->path[0] ? rec->path : "-");
+    for (int i = 0; i < TRACE_NPHASES; ++i) {
+        if (!rec->t[i] || off < 0 || (size_t)off >= len) continue;
+        off += snprintf(buf + off, len - (size_t)off, " %s=+%lluus", phase_names[i],
+                        (unsigned long long)((rec->t[i] - base) / 1000));
+    }
+    return off;
+}
+
+size_t trace_ring_dump(trace_ring_t *r, int worker_id, FILE *out) {
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t first = head > r->cap ? head - r->cap : 0;
+    size_t lines = 0;
+    char line[512];
+    for (size_t i = first; i < head; ++i) {
+        trace_slot_t *s = &r->slots[i % r->cap];
+        trace_rec_t rec;
+        unsigned seq = atomic_load_explicit(&s->seq, memory_order_acquire);
+        if (seq & 1) continue;
+        memcpy(&rec, &s->rec, sizeof(rec));
+        atomic_thread_fence(memory_order_acquire);
+        if (atomic_load_explicit(&s->seq, memory_order_relaxed) != seq) continue;
+        trace_format(&rec, line, sizeof(line));
+        fprintf(out, "worker=%d %s\n", worker_id, line);
+        lines++;
+    }
+    return lines;
+}
@@ -0,0 +1,88 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/*
+ * Per-request phase timestamps. Each worker keeps the last N finished
+ * requests in a fixed-size ring (the flight recorder), which can be dumped
+ * to the log on SIGUSR1 or served from an endpoint while the server runs.
+ *
+ * The same points are USDT probes (provider c_http_server) when sys/sdt.h is
+ * available; an unattached probe is a single nop.
+ */
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_HAVE_USDT 1
+#endif
+#endif
+
+#ifdef TRACE_HAVE_USDT
+#define TRACE_PROBE1(name, a) DTRACE_PROBE1(c_http_server, name, a)
+#define TRACE_PROBE2(name, a, b) DTRACE_PROBE2(c_http_server, name, a, b)
+#define TRACE_PROBE3(name, a, b, c) DTRACE_PROBE3(c_http_server, name, a, b, c)
+#else
+#define TRACE_PROBE1(name, a) do { } while (0)
+#define TRACE_PROBE2(name, a, b) do { } while (0)
+#define TRACE_PROBE3(name, a, b, c) do { } while (0)
+#endif
+
+enum trace_phase {
+    TRACE_ACCEPT,     /* connection accepted (first request only) */
+    TRACE_FIRST_BYTE, /* first bytes of the request read */
+    TRACE_HEADER,     /* read that completed the header block */
+    TRACE_PARSED,     /* parser returned the request */
+    TRACE_RESOLVED,   /* docroot path resolved */
+    TRACE_IO,         /* file read */
+    TRACE_QUEUED,     /* response handed to the socket */
+    TRACE_FLUSHED,    /* last response byte written */
+    TRACE_NPHASES
+};
+
+typedef struct trace_rec_s {
+    uint64_t t[TRACE_NPHASES]; /* CLOCK_MONOTONIC ns, 0 = phase not reached */
+    int fd;
+    char method[8];
+    char path[64];
+} trace_rec_t;
+
+typedef struct trace_slot_s {
+    atomic_uint seq; /* odd while being written */
+    trace_rec_t rec;
+} trace_slot_t;
+
+/* Written only by the owning worker; any thread may read it. */
+typedef struct trace_ring_s {
+    trace_slot_t *slots;
+    size_t cap;
+    atomic_size_t head; /* records pushed so far */
+} trace_ring_t;
+
+static inline uint64_t trace_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+int trace_ring_init(trace_ring_t *r, size_t cap);
+void trace_ring_free(trace_ring_t *r);
+
+/* Copy rec into the ring, overwriting the oldest record when full. */
+void trace_ring_push(trace_ring_t *r, const trace_rec_t *rec);
+
+/* Write one line per recorded request, oldest first, each prefixed with
+ * "worker=<id>". Records overwritten during the dump are skipped. Returns
+ * the number of lines written. */
+size_t trace_ring_dump(trace_ring_t *r, int worker_id, FILE *out);
+
+/* Format rec as "fd=.. METHOD PATH phase=+us ..." relative to its first
+ * timestamp. Returns the length like snprintf. */
+int trace_format(const trace_rec_t *rec, char *buf, size_t len);
+
+#endif
@@ -0,0 +1,136 @@
+#define _GNU_SOURCE
+#include "upgrade.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int control_fd = -1;
+
+int upgrade_send_fds(int sock, const int *fds, int nfds) {
+    if (nfds <= 0 || nfds > UPGRADE_MAX_FDS) return -1;
+    char ctrl[CMSG_SPACE(sizeof(int) * UPGRADE_MAX_FDS)];
+    memset(ctrl, 0, sizeof(ctrl));
+    unsigned char count = (unsigned char)nfds;
+    struct iovec iov = { &count, 1 };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * (size_t)nfds);
+    struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(int) * (size_t)nfds);
+    memcpy(CMSG_DATA(cm), fds, sizeof(int) * (size_t)nfds);
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    return n == 1 ? 0 : -1;
+}
+
+int upgrade_recv_fds(int sock, int *fds, int max) {
+    char ctrl[CMSG_SPACE(sizeof(int) * UPGRADE_MAX_FDS)];
+    unsigned char count = 0;
+    struct iovec iov = { &count, 1 };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n != 1) return -1;
+    int got = 0;
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+        int nfd = (int)((cm->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        int *in = (int *)CMSG_DATA(cm);
+        for (int i = 0; i < nfd; ++i) {
+            if (got < max) fds[got++] = in[i];
+            else close(in[i]);
+        }
+    }
+    if (got != count) {
+        for (int i = 0; i < got; ++i) close(fds[i]);
+        return -1;
+    }
+    return got;
+}
+
+int upgrade_inherit(int *fds, int max) {
+    const char *env = getenv(UPGRADE_ENV);
+    if (!env) return 0;
+    int fd = atoi(env);
+    unsetenv(UPGRADE_ENV);
+    if (fd <= 2 || fcntl(fd, F_GETFD) < 0) return -1;
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    int n = upgrade_recv_fds(fd, fds, max);
+    if (n < 0) {
+        close(fd);
+        return -1;
+    }
+    control_fd = fd;
+    return n;
+}
+
+void upgrade_ready(void) {
+    if (control_fd < 0) return;
+    char ok = 'R';
+    ssize_t n;
+    do {
+        n = write(control_fd, &ok, 1);
+    } while (n < 0 && errno == EINTR);
+    close(control_fd);
+    control_fd = -1;
+}
+
+int upgrade_start(const char *exe, char **argv, const int *fds, int nfds, pid_t *child) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) return -1;
+    /* the child environment is built before fork(): only async-signal-safe
+     * calls are allowed between fork() and exec in a threaded process */
+    extern char **environ;
+    size_t envc = 0;
+    while (environ[envc]) envc++;
+    char **envp = calloc(envc + 2, sizeof(char *));
+    char var[sizeof(UPGRADE_ENV) + 16];
+    if (!envp) goto fail;
+    snprintf(var, sizeof(var), "%s=%d", UPGRADE_ENV, sv[1]);
+    size_t j = 0;
+    for (size_t i = 0; i < envc; ++i) {
+        if (strncmp(environ[i], UPGRADE_ENV "=", sizeof(UPGRADE_ENV)) != 0) envp[j++] = environ[i];
+    }
+    envp[j++] = var;
+    envp[j] = NULL;
+    pid_t pid = fork();
+    if (pid < 0) goto fail;
+    if (pid == 0) {
+        /* only the control socket survives the exec; everything else is CLOEXEC */
+        fcntl(sv[1], F_SETFD, 0);
+        execve(exe, argv, envp);
+        _exit(127);
+    }
+    free(envp);
+    close(sv[1]);
+    if (upgrade_send_fds(sv[0], fds, nfds) < 0) {
+        close(sv[0]);
+        return -1;
+    }
+    fcntl(sv[0], F_SETFL, fcntl(sv[0], F_GETFL) | O_NONBLOCK);
+    *child = pid;
+    return sv[0];
+fail:
+    free(envp);
+    close(sv[0]);
+    close(sv[1]);
+    return -1;
+}
@@ -0,0 +1,43 @@
+#ifndef UPGRADE_H
+#define UPGRADE_H
+
+#include <sys/types.h>
+
+/*
+ * Zero-downtime binary upgrade / config reload.
+ *
+ * The running server forks and execs its binary again with one end of a
+ * Unix socketpair inherited (fd number in UPGRADE_ENV). The listening
+ * sockets are sent over it with SCM_RIGHTS, so the kernel accept queue is
+ * never closed. Once the new process is serving it writes a single byte
+ * back; only then does the old process stop accepting and drain. If the new
+ * process dies before that, the old one keeps serving.
+ */
+
+#define UPGRADE_ENV "C_HTTP_SERVER_UPGRADE_FD"
+#define UPGRADE_MAX_FDS 64
+
+/* Send fds over a Unix socket. Returns 0/-1. */
+int upgrade_send_fds(int sock, const int *fds, int nfds);
+
+/* Receive up to max fds (marked close-on-exec). Returns the count, -1 on error. */
+int upgrade_recv_fds(int sock, int *fds, int max);
+
+/*
+ * In a freshly exec'd process: if started by an upgrade, receive the
+ * listening sockets into fds. Returns the count (0 if this is a normal start)
+ * or -1 on error. The control socket stays open until upgrade_ready().
+ */
+int upgrade_inherit(int *fds, int max);
+
+/* Tell the old process that we are accepting. No-op on a normal start. */
+void upgrade_ready(void);
+
+/*
+ * Start the new process: exec `exe` with `argv` and hand it the listening
+ * sockets. Returns the parent's end of the control socket (readable once the
+ * child is ready, EOF if it failed) and sets *child, or -1 on error.
+ */
+int upgrade_start(const char *exe, char **argv, const int *fds, int nfds, pid_t *child);
+
+#endif
@@ -0,0 +1,282 @@
+#define _GNU_SOURCE
+#include "upload.h"
+#include "fsutils.h"
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* bytes moved per splice() pair; larger pipes mean fewer syscalls */
+#define UPLOAD_PIPE_SIZE (1 << 20)
+
+typedef struct upload_s {
+    int fd;                /* temporary file */
+    size_t left;           /* body bytes still to arrive */
+    size_t total;
+    int existed;           /* the target is being replaced */
+    char tmp[PATH_MAX];
+    char dest[PATH_MAX];
+} upload_t;
+
+static const char *request_header(connection_t *c, const char *name) {
+    int hcount = http_parser_header_count(&c->parser);
+    for (int i = 0; i < hcount; ++i) {
+        const char *hn = http_parser_header_name(&c->parser, i);
+        if (hn && strcasecmp(hn, name) == 0) return http_parser_header_value(&c->parser, i);
+    }
+    return NULL;
+}
+
+static int reply(worker_t *w, connection_t *c, const char *status, const char *extra) {
+    char resp[256];
+    int n = snprintf(resp, sizeof(resp), "HTTP/1.1 %s\r\n%sContent-Length: 0\r\nConnection: %s\r\n\r\n", status,
+                     extra, c->should_close ? "close" : "keep-alive");
+    return conn_send(w, c, resp, (size_t)n);
+}
+
+/* Refuse before the body is read: it is still on the wire, so the
+ * connection cannot be reused. */
+static int refuse(worker_t *w, connection_t *c, const char *status) {
+    c->should_close = 1;
+    fprintf(w->logf, "upload fd=%d refused: %s\n", c->fd, status);
+    fflush(w->logf);
+    return reply(w, c, status, "");
+}
+
+static void discard(upload_t *up) {
+    if (up->fd >= 0) close(up->fd);
+    unlink(up->tmp);
+    free(up);
+}
+
+void upload_abort(worker_t *w, connection_t *c) {
+    upload_t *up = c->upload;
+    fprintf(w->logf, "upload fd=%d aborted: %zu of %zu bytes received\n", c->fd, up->total - up->left, up->total);
+    fflush(w->logf);
+    discard(up);
+    c->upload = NULL;
+}
+
+void upload_shutdown(worker_t *w) {
+    if (!w->upload_pipe_cap) return;
+    close(w->upload_pipe[0]);
+    close(w->upload_pipe[1]);
+    w->upload_pipe_cap = 0;
+}
+
+static int ensure_pipe(worker_t *w) {
+    if (w->upload_pipe_cap) return 0;
+    if (pipe2(w->upload_pipe, O_NONBLOCK | O_CLOEXEC) < 0) return -1;
+    /* best effort: above /proc/sys/fs/pipe-max-size this fails for
+     * unprivileged processes and the default size is kept */
+    fcntl(w->upload_pipe[1], F_SETPIPE_SZ, UPLOAD_PIPE_SIZE);
+    int cap = fcntl(w->upload_pipe[1], F_GETPIPE_SZ);
+    w->upload_pipe_cap = cap > 0 ? (size_t)cap : 65536;
+    return 0;
+}
+
+/* Write out bytes that arrived with the header block. Returns 0/-1. */
+static int write_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+    return 0;
+}
+
+/* An I/O error on the file: disk full is the client's concern, anything
+ * else is ours. */
+static const char *io_status(int err) {
+    return err == ENOSPC || err == EDQUOT ? "507 Insufficient Storage" : "500 Internal Server Error";
+}
+
+/* The last byte is in: move the file into place and answer. Returns 0/-1
+ * like conn_send(). */
+static int finish(worker_t *w, connection_t *c) {
+    upload_t *up = c->upload;
+    c->upload = NULL;
+    int rc = close(up->fd);
+    up->fd = -1;
+    if (rc != 0 || rename(up->tmp, up->dest) != 0) {
+        int err = errno;
+        fprintf(w->logf, "upload fd=%d: cannot store %s: %s\n", c->fd, up->dest, strerror(err));
+        fflush(w->logf);
+        discard(up);
+        return refuse(w, c, io_status(err));
+    }
+    fprintf(w->logf, "uploaded fd=%d %s (%zu bytes)\n", c->fd, up->dest, up->total);
+    fflush(w->logf);
+    int existed = up->existed;
+    free(up);
+    return reply(w, c, existed ? "204 No Content" : "201 Created", "");
+}
+
+/* The file failed mid-body: drop it and answer; the rest of the body is
+ * never read, so the connection closes. */
+static int fail(worker_t *w, connection_t *c, int err) {
+    fprintf(w->logf, "upload fd=%d: writing %s: %s\n", c->fd, c->upload->tmp, strerror(err));
+    discard(c->upload);
+    c->upload = NULL;
+    return refuse(w, c, io_status(err));
+}
+
+/* upload_start() result of a request answered with rc (0/-1 from conn_send) */
+static int answer(int rc) {
+    return rc < 0 ? -1 : 1;
+}
+
+/* upload_on_client_event() result of an upload answered with rc */
+static int answered(worker_t *w, connection_t *c, int rc) {
+    if (rc < 0) {
+        conn_close(w, c);
+        return 0;
+    }
+    return 1;
+}
+
+int upload_start(worker_t *w, connection_t *c, const char *path) {
+    const char *method = http_parser_method(&c->parser) ?: "";
+    if (strcmp(method, "PUT") != 0 && strcmp(method, "POST") != 0) {
+        return answer(reply(w, c, "405 Method Not Allowed", "Allow: PUT, POST\r\n"));
+    }
+    /* bodies are spliced by length: it has to be known up front */
+    if (request_header(c, "Transfer-Encoding")) return answer(refuse(w, c, "411 Length Required"));
+    const char *cl = request_header(c, "Content-Length");
+    if (!cl) return answer(refuse(w, c, "411 Length Required"));
+    char *end;
+    errno = 0;
+    unsigned long long len = strtoull(cl, &end, 10);
+    if (!isdigit((unsigned char)*cl) || *end || errno) return answer(refuse(w, c, "400 Bad Request"));
+    if (len > (unsigned long long)w->cfg->upload_max_mb << 20) {
+        return answer(refuse(w, c, "413 Content Too Large"));
+    }
+
+    /* the path below the prefix, without the query, names the file */
+    const char *prefix = w->cfg->upload_path;
+    size_t plen = strlen(prefix);
+    const char *rel = path + plen - (prefix[plen - 1] == '/');
+    char key[PATH_MAX];
+    size_t klen = strcspn(rel, "?");
+    if (klen >= sizeof(key)) return answer(refuse(w, c, "414 URI Too Long"));
+    memcpy(key, rel, klen);
+    key[klen] = '\0';
+    upload_t *up = calloc(1, sizeof(*up));
+    if (!up) return -1;
+    up->fd = -1;
+    const char *name = NULL;
+    if (safe_resolve_new_path(w->cfg->upload_dir, key, up->dest, sizeof(up->dest)) == 0) {
+        name = strrchr(up->dest, '/') + 1;
+    }
+    /* dot files are reserved for the temporaries */
+    if (!name || name[0] == '.') {
+        free(up);
+        return answer(refuse(w, c, "403 Forbidden"));
+    }
+    struct stat st;
+    if (lstat(up->dest, &st) == 0) {
+        if (S_ISDIR(st.st_mode)) {
+            free(up);
+            return answer(refuse(w, c, "409 Conflict"));
+        }
+        up->existed = 1;
+    }
+    /* a temporary in the target's directory, so the rename stays on one
+     * filesystem and is atomic */
+    snprintf(up->tmp, sizeof(up->tmp), "%.*s.%s.XXXXXX", (int)(name - up->dest), up->dest, name);
+    up->fd = mkostemp(up->tmp, O_CLOEXEC);
+    if (up->fd < 0) {
+        int err = errno;
+        fprintf(w->logf, "upload fd=%d: cannot create %s: %s\n", c->fd, up->tmp, strerror(err));
+        up->tmp[0] = '\0';
+        discard(up);
+        return answer(refuse(w, c, io_status(err)));
+    }
+    fchmod(up->fd, 0644);
+    /* reserve the space now: a full disk is reported before the body is sent */
+    if (len > 0 && fallocate(up->fd, 0, 0, (off_t)len) < 0 && (errno == ENOSPC || errno == EDQUOT)) {
+        int err = errno;
+        discard(up);
+        return answer(refuse(w, c, io_status(err)));
+    }
+    up->total = up->left = (size_t)len;
+    c->upload = up;
+
+    size_t early = up->left < c->buflen ? up->left : c->buflen;
+    if (early > 0) {
+        if (write_all(up->fd, c->buf, early) < 0) return answer(fail(w, c, errno));
+        memmove(c->buf, c->buf + early, c->buflen - early);
+        c->buflen -= early;
+        up->left -= early;
+    }
+    if (!up->left) return answer(finish(w, c));
+    const char *expect = request_header(c, "Expect");
+    if (expect && strcasecmp(expect, "100-continue") == 0) {
+        const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+        if (conn_send(w, c, cont, strlen(cont)) < 0) return -1;
+    }
+    return 0;
+}
+
+/* Move the body pipe -> file until the n bytes just spliced in are out.
+ * Returns 0, or -1 with errno set. */
+static int drain_pipe(worker_t *w, int fd, size_t n) {
+    while (n > 0) {
+        ssize_t m = splice(w->upload_pipe[0], NULL, fd, NULL, n, SPLICE_F_MOVE);
+        if (m < 0 && errno == EINTR) continue;
+        if (m <= 0) {
+            if (m == 0) errno = EIO;
+            return -1;
+        }
+        n -= (size_t)m;
+    }
+    return 0;
+}
+
+int upload_on_client_event(worker_t *w, connection_t *c, uint32_t events) {
+    if (events & EPOLLERR) {
+        conn_close(w, c);
+        return 0;
+    }
+    /* a 100 Continue that did not fit the socket */
+    if ((events & EPOLLOUT) && conn_pending(c) && conn_flush(w, c) < 0) {
+        conn_close(w, c);
+        return 0;
+    }
+    if (!(events & (EPOLLIN | EPOLLHUP))) return 0;
+    upload_t *up = c->upload;
+    if (ensure_pipe(w) < 0) return answered(w, c, fail(w, c, errno));
+    /* a bounded amount per event keeps one upload from starving the other
+     * connections; level triggering brings us back */
+    for (int i = 0; i < 16 && up->left > 0; ++i) {
+        size_t want = up->left < w->upload_pipe_cap ? up->left : w->upload_pipe_cap;
+        ssize_t n = splice(c->fd, NULL, w->upload_pipe[1], NULL, want, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return 0;
+        if (n <= 0) {
+            /* the client went away mid-body */
+            conn_close(w, c);
+            return 0;
+        }
+        if (drain_pipe(w, up->fd, (size_t)n) < 0) {
+            int err = errno;
+            /* whatever is left in the pipe belongs to this upload */
+            upload_shutdown(w);
+            return answered(w, c, fail(w, c, err));
+        }
+        up->left -= (size_t)n;
+    }
+    if (up->left > 0) return 0;
+    return answered(w, c, finish(w, c));
+}
@@ -0,0 +1,34 @@
+#ifndef UPLOAD_H
+#define UPLOAD_H
+
+#include "conn.h"
+
+/*
+ * Uploads. A PUT or POST below cfg->upload_path stores its body as a file
+ * below cfg->upload_dir. The body moves socket -> pipe -> file with
+ * splice(), so it never passes through userspace (only bytes that arrived
+ * together with the header block are written from the connection buffer).
+ * It goes to a temporary file next to the target, which is renamed over the
+ * target once the last byte is in: readers see the old file or the new one,
+ * never a partial one.
+ */
+
+/*
+ * Handle a request below cfg->upload_path. Returns 1 if it was answered
+ * (refused, or the whole body had already arrived), 0 while the body is
+ * being received (c->upload set; continues in upload_on_client_event()), -1
+ * on a fatal send error.
+ */
+int upload_start(worker_t *w, connection_t *c, const char *path);
+
+/* Handle an epoll event while receiving. Returns 1 once the upload has been
+ * answered and the connection can go on to its next request. May close c. */
+int upload_on_client_event(worker_t *w, connection_t *c, uint32_t events);
+
+/* Drop an unfinished upload (the temporary file is removed). */
+void upload_abort(worker_t *w, connection_t *c);
+
+/* Release the worker's splice pipe. */
+void upload_shutdown(worker_t *w);
+
+#endif
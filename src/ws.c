@@ -0,0 +1,684 @@
+#define _GNU_SOURCE
+#include "ws.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WS_SIMD 1
+#endif
+
+/* ---- frame codec ---- */
+
+int ws_parse_header(const uint8_t *b, size_t len, ws_frame_t *f) {
+    if (len < 2) return 0;
+    if (b[0] & 0x70) return -1; /* no extension negotiated: RSV bits must be clear */
+    f->fin = b[0] >> 7;
+    f->opcode = b[0] & 0x0f;
+    switch (f->opcode) {
+    case WS_OP_CONT:
+    case WS_OP_TEXT:
+    case WS_OP_BINARY:
+    case WS_OP_CLOSE:
+    case WS_OP_PING:
+    case WS_OP_PONG:
+        break;
+    default:
+        return -1;
+    }
+    f->masked = b[1] >> 7;
+    uint64_t n = b[1] & 0x7f;
+    /* control frames are never fragmented and carry at most 125 bytes */
+    if (f->opcode >= WS_OP_CLOSE && (!f->fin || n > 125)) return -1;
+    size_t h = 2;
+    if (n == 126) {
+        if (len < 4) return 0;
+        n = (uint64_t)b[2] << 8 | b[3];
+        h = 4;
+    } else if (n == 127) {
+        if (len < 10) return 0;
+        n = 0;
+        for (int i = 0; i < 8; ++i) n = n << 8 | b[2 + i];
+        if (n >> 63) return -1;
+        h = 10;
+    }
+    if (f->masked) {
+        if (len < h + 4) return 0;
+        memcpy(f->mask, b + h, 4);
+        h += 4;
+    } else {
+        memset(f->mask, 0, sizeof(f->mask));
+    }
+    f->len = n;
+    f->hlen = h;
+    return 1;
+}
+
+size_t ws_encode_header(uint8_t *out, int opcode, uint64_t len) {
+    out[0] = (uint8_t)(0x80 | opcode);
+    if (len < 126) {
+        out[1] = (uint8_t)len;
+        return 2;
+    }
+    if (len <= 0xffff) {
+        out[1] = 126;
+        out[2] = (uint8_t)(len >> 8);
+        out[3] = (uint8_t)len;
+        return 4;
+    }
+    out[1] = 127;
+    for (int i = 0; i < 8; ++i) out[2 + i] = (uint8_t)(len >> (56 - 8 * i));
+    return 10;
+}
+
+#ifdef WS_SIMD
+/* The key repeats every 4 bytes, so a vector holding it 4 or 8 times lines
+ * up with every 16- or 32-byte block. Each returns the bytes it handled. */
+__attribute__((target("avx2"))) static size_t mask_avx2(uint8_t *p, size_t len, uint32_t key) {
+    __m256i k = _mm256_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(p + i));
+        _mm256_storeu_si256((__m256i *)(p + i), _mm256_xor_si256(v, k));
+    }
+    return i;
+}
+
+__attribute__((target("sse2"))) static size_t mask_sse2(uint8_t *p, size_t len, uint32_t key) {
+    __m128i k = _mm_set1_epi32((int)key);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i));
+        _mm_storeu_si128((__m128i *)(p + i), _mm_xor_si128(v, k));
+    }
+    return i;
+}
+#endif
+
+void ws_mask(uint8_t *data, size_t len, const uint8_t key[4], uint64_t pos) {
+    /* rotate the key so that k[0] applies to data[0] */
+    uint8_t k[8];
+    for (int i = 0; i < 8; ++i) k[i] = key[(pos + (uint64_t)i) & 3];
+    size_t i = 0;
+#ifdef WS_SIMD
+    if (len >= 16) {
+        uint32_t k32;
+        memcpy(&k32, k, 4);
+        if (__builtin_cpu_supports("avx2")) i = mask_avx2(data, len, k32);
+        else if (__builtin_cpu_supports("sse2")) i = mask_sse2(data, len, k32);
+    }
+#endif
+    /* i is a multiple of 8 here, so the key phase is unchanged */
+    uint64_t k64;
+    memcpy(&k64, k, 8);
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, 8);
+        v ^= k64;
+        memcpy(data + i, &v, 8);
+    }
+    for (; i < len; ++i) data[i] ^= k[i & 3];
+}
+
+int ws_utf8_valid(const uint8_t *data, size_t len) {
+    size_t i = 0;
+    while (i < len) {
+        /* runs of ASCII, the common case, eight bytes at a time */
+        uint64_t v;
+        if (i + 8 <= len && (memcpy(&v, data + i, 8), !(v & 0x8080808080808080ull))) {
+            i += 8;
+            continue;
+        }
+        uint8_t b = data[i];
+        if (b < 0x80) {
+            ++i;
+            continue;
+        }
+        size_t n;
+        uint32_t cp, min;
+        if ((b & 0xe0) == 0xc0) n = 1, cp = b & 0x1f, min = 0x80;
+        else if ((b & 0xf0) == 0xe0) n = 2, cp = b & 0x0f, min = 0x800;
+        else if ((b & 0xf8) == 0xf0) n = 3, cp = b & 0x07, min = 0x10000;
+        else return 0;
+        if (len - i - 1 < n) return 0;
+        for (size_t k = 1; k <= n; ++k) {
+            if ((data[i + k] & 0xc0) != 0x80) return 0;
+            cp = cp << 6 | (data[i + k] & 0x3f);
+        }
+        if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) return 0;
+        i += n + 1;
+    }
+    return 1;
+}
+
+/* ---- handshake ---- */
+
+static uint32_t rol(uint32_t x, int n) {
+    return (x << n) | (x >> (32 - n));
+}
+
+static void sha1_block(uint32_t h[5], const uint8_t *p) {
+    uint32_t w[80];
+    for (int i = 0; i < 16; ++i) {
+        w[i] = (uint32_t)p[4 * i] << 24 | (uint32_t)p[4 * i + 1] << 16 | (uint32_t)p[4 * i + 2] << 8 | p[4 * i + 3];
+    }
+    for (int i = 16; i < 80; ++i) w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; ++i) {
+        uint32_t f, k;
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t t = rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+/* SHA-1 is only used for the handshake, where RFC 6455 mandates it. */
+static void sha1(const void *data, size_t len, uint8_t out[20]) {
+    uint32_t h[5] = { 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 };
+    const uint8_t *p = data;
+    size_t left = len;
+    for (; left >= 64; p += 64, left -= 64) sha1_block(h, p);
+    uint8_t tail[128];
+    memset(tail, 0, sizeof(tail));
+    memcpy(tail, p, left);
+    tail[left] = 0x80;
+    size_t tlen = left + 9 <= 64 ? 64 : 128;
+    uint64_t bits = (uint64_t)len * 8;
+    for (int i = 0; i < 8; ++i) tail[tlen - 1 - i] = (uint8_t)(bits >> (8 * i));
+    sha1_block(h, tail);
+    if (tlen == 128) sha1_block(h, tail + 64);
+    for (int i = 0; i < 5; ++i) {
+        out[4 * i] = (uint8_t)(h[i] >> 24);
+        out[4 * i + 1] = (uint8_t)(h[i] >> 16);
+        out[4 * i + 2] = (uint8_t)(h[i] >> 8);
+        out[4 * i + 3] = (uint8_t)h[i];
+    }
+}
+
+void ws_accept_key(const char *key, char out[WS_ACCEPT_LEN + 1]) {
+    static const char b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    char buf[128];
+    int n = snprintf(buf, sizeof(buf), "%s258EAFA5-E914-47DA-95CA-C5AB0DC85B11", key);
+    if (n < 0 || n >= (int)sizeof(buf)) n = (int)sizeof(buf) - 1;
+    uint8_t d[21];
+    sha1(buf, (size_t)n, d);
+    d[20] = 0;
+    /* 20 bytes: six full groups and one of two bytes, padded with '=' */
+    char *o = out;
+    for (int i = 0; i < 21; i += 3) {
+        uint32_t v = (uint32_t)d[i] << 16 | (uint32_t)d[i + 1] << 8 | (i + 2 < 21 ? d[i + 2] : 0);
+        *o++ = b64[v >> 18 & 63];
+        *o++ = b64[v >> 12 & 63];
+        *o++ = b64[v >> 6 & 63];
+        *o++ = i + 3 < 21 ? b64[v & 63] : '=';
+    }
+    *o = '\0';
+}
+
+/* ---- connections ---- */
+
+typedef struct ws_conn_s {
+    connection_t *conn;
+    uint64_t channel;               /* hash of the request path */
+    struct ws_conn_s *prev, *next;  /* worker's subscribers */
+    /* frame being received */
+    ws_frame_t frame;
+    int in_frame;                   /* header parsed, payload still arriving */
+    uint64_t frame_pos;             /* payload bytes received so far */
+    /* data message being assembled from fragments, or from a frame larger
+     * than what one read returns */
+    int msg_opcode;                 /* WS_OP_TEXT/BINARY while a message is open */
+    uint8_t *msg;
+    size_t msg_len, msg_cap;
+    uint8_t ctl[125];               /* control frame payload */
+    int closing;                    /* close frame sent: deliver nothing more */
+    int done;                       /* close the socket once the output is flushed */
+} ws_conn_t;
+
+typedef struct ws_pending_s {
+    shared_buf_t *frame;
+    uint64_t channel;
+} ws_pending_t;
+
+typedef struct ws_worker_s {
+    ws_conn_t *subs;
+    size_t nsubs;
+    /* broadcasts from any thread; swapped with work by the owner */
+    pthread_mutex_t lock;
+    ws_pending_t *inbox;
+    size_t inbox_len, inbox_cap;
+    ws_pending_t *work;
+    size_t work_cap;
+} ws_worker_t;
+
+int ws_init(worker_t *w) {
+    ws_worker_t *ww = calloc(1, sizeof(*ww));
+    if (!ww) return -1;
+    pthread_mutex_init(&ww->lock, NULL);
+    w->ws = ww;
+    return 0;
+}
+
+void ws_shutdown(worker_t *w) {
+    ws_worker_t *ww = w->ws;
+    if (!ww) return;
+    for (size_t i = 0; i < ww->inbox_len; ++i) shared_buf_unref(ww->inbox[i].frame);
+    free(ww->inbox);
+    free(ww->work);
+    pthread_mutex_destroy(&ww->lock);
+    free(ww);
+    w->ws = NULL;
+}
+
+static const char *request_header(connection_t *c, const char *name) {
+    int hcount = http_parser_header_count(&c->parser);
+    for (int i = 0; i < hcount; ++i) {
+        const char *hn = http_parser_header_name(&c->parser, i);
+        if (hn && strcasecmp(hn, name) == 0) return http_parser_header_value(&c->parser, i);
+    }
+    return NULL;
+}
+
+/* Is token one of the comma-separated values of a header? */
+static int has_token(const char *value, const char *token) {
+    size_t n = strlen(token);
+    for (const char *p = value; *p;) {
+        while (*p == ' ' || *p == '\t' || *p == ',') p++;
+        const char *end = p;
+        while (*end && *end != ',') end++;
+        const char *last = end;
+        while (last > p && (last[-1] == ' ' || last[-1] == '\t')) last--;
+        if ((size_t)(last - p) == n && strncasecmp(p, token, n) == 0) return 1;
+        p = end;
+    }
+    return 0;
+}
+
+static int reject(worker_t *w, connection_t *c, const char *status, const char *extra) {
+    char resp[256];
+    int n = snprintf(resp, sizeof(resp), "HTTP/1.1 %s\r\n%sContent-Length: 0\r\nConnection: %s\r\n\r\n", status,
+                     extra, c->should_close ? "close" : "keep-alive");
+    return conn_send(w, c, resp, (size_t)n);
+}
+
+int ws_upgrade(worker_t *w, connection_t *c, const char *path) {
+    const char *method = http_parser_method(&c->parser) ?: "";
+    const char *upgrade = request_header(c, "Upgrade");
+    const char *connection = request_header(c, "Connection");
+    const char *version = request_header(c, "Sec-WebSocket-Version");
+    const char *key = request_header(c, "Sec-WebSocket-Key");
+    if (strcmp(method, "GET") != 0 || !upgrade || !has_token(upgrade, "websocket") || !connection ||
+        !has_token(connection, "upgrade")) {
+        return reject(w, c, "426 Upgrade Required", "Upgrade: websocket\r\nConnection: Upgrade\r\n");
+    }
+    if (!version || strcmp(version, "13") != 0) {
+        return reject(w, c, "426 Upgrade Required", "Sec-WebSocket-Version: 13\r\n");
+    }
+    /* base64 of 16 random bytes */
+    if (!key || strlen(key) != 24) return reject(w, c, "400 Bad Request", "");
+    if (w->draining) {
+        /* the successor takes new subscribers */
+        char extra[64];
+        snprintf(extra, sizeof(extra), "Retry-After: %d\r\n", w->cfg->retry_after);
+        return reject(w, c, "503 Service Unavailable", extra);
+    }
+    ws_conn_t *ws = calloc(1, sizeof(*ws));
+    if (!ws) return -1;
+    char accept[WS_ACCEPT_LEN + 1];
+    ws_accept_key(key, accept);
+    char resp[160];
+    int n = snprintf(resp, sizeof(resp),
+                     "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                     "Sec-WebSocket-Accept: %s\r\n\r\n",
+                     accept);
+    if (conn_send(w, c, resp, (size_t)n) < 0) {
+        free(ws);
+        return -1;
+    }
+    ws_worker_t *ww = w->ws;
+    ws->conn = c;
+    ws->channel = conn_channel(path);
+    ws->next = ww->subs;
+    if (ww->subs) ww->subs->prev = ws;
+    ww->subs = ws;
+    ww->nsubs++;
+    c->ws = ws;
+    c->should_close = 0;
+    return 0;
+}
+
+void ws_abort(worker_t *w, connection_t *c) {
+    ws_conn_t *ws = c->ws;
+    ws_worker_t *ww = w->ws;
+    if (ws->prev) ws->prev->next = ws->next;
+    else ww->subs = ws->next;
+    if (ws->next) ws->next->prev = ws->prev;
+    ww->nsubs--;
+    free(ws->msg);
+    ws->msg = NULL;
+    c->ws = NULL;
+    /* the frame loop may still be looking at it */
+    worker_defer_free(w, ws);
+}
+
+/* Queue a server frame (close, pong) behind any pending output. */
+static int send_frame(worker_t *w, connection_t *c, int opcode, const void *payload, size_t len) {
+    uint8_t hdr[WS_MAX_HEADER];
+    size_t hlen = ws_encode_header(hdr, opcode, len);
+    struct iovec iov[2] = { { hdr, hlen }, { (void *)payload, len } };
+    return conn_sendv(w, c, iov, 2);
+}
+
+static void send_close(worker_t *w, connection_t *c, int status) {
+    ws_conn_t *ws = c->ws;
+    if (ws->closing) return;
+    ws->closing = 1;
+    uint8_t code[2] = { (uint8_t)(status >> 8), (uint8_t)status };
+    if (send_frame(w, c, WS_OP_CLOSE, code, sizeof(code)) < 0) ws->done = 1;
+}
+
+/* Protocol violation: say why and hang up without waiting for a reply. */
+static void fail(worker_t *w, connection_t *c, int status) {
+    fprintf(w->logf, "websocket fd=%d closed with %d\n", c->fd, status);
+    fflush(w->logf);
+    send_close(w, c, status);
+    c->ws->done = 1;
+}
+
+static int broadcast_channel(server_t *srv, uint64_t channel, int opcode, const void *data, size_t len);
+
+/* A complete message from a client goes to everyone on its channel. */
+static void deliver(worker_t *w, connection_t *c, int opcode, const uint8_t *data, size_t len) {
+    ws_conn_t *ws = c->ws;
+    if (ws->closing) return;
+    if (opcode == WS_OP_TEXT && !ws_utf8_valid(data, len)) {
+        fail(w, c, WS_CLOSE_INVALID);
+        return;
+    }
+    if (broadcast_channel(w->srv, ws->channel, opcode, data, len) < 0) {
+        fprintf(w->logf, "websocket: broadcast failed: out of memory\n");
+        fflush(w->logf);
+    }
+}
+
+static void on_control(worker_t *w, connection_t *c, const ws_frame_t *f) {
+    ws_conn_t *ws = c->ws;
+    switch (f->opcode) {
+    case WS_OP_PING:
+        if (!ws->closing && send_frame(w, c, WS_OP_PONG, ws->ctl, (size_t)f->len) < 0) ws->done = 1;
+        break;
+    case WS_OP_CLOSE: {
+        if (f->len == 1) {
+            fail(w, c, WS_CLOSE_PROTOCOL);
+            break;
+        }
+        if (f->len > 2 && !ws_utf8_valid(ws->ctl + 2, (size_t)f->len - 2)) {
+            fail(w, c, WS_CLOSE_INVALID);
+            break;
+        }
+        /* echo the status code; the peer closed, so do not wait any longer */
+        int status = f->len >= 2 ? ws->ctl[0] << 8 | ws->ctl[1] : WS_CLOSE_NORMAL;
+        send_close(w, c, status);
+        ws->done = 1;
+        break;
+    }
+    default: /* unsolicited pongs are allowed and ignored */
+        break;
+    }
+}
+
+/* Append payload bytes to the message being assembled. Returns 0/-1. */
+static int msg_append(ws_conn_t *ws, const uint8_t *p, size_t len) {
+    if (ws->msg_len + len > ws->msg_cap) {
+        size_t ncap = ws->msg_cap ? ws->msg_cap : 4096;
+        while (ncap < ws->msg_len + len) ncap *= 2;
+        uint8_t *nm = realloc(ws->msg, ncap);
+        if (!nm) return -1;
+        ws->msg = nm;
+        ws->msg_cap = ncap;
+    }
+    memcpy(ws->msg + ws->msg_len, p, len);
+    ws->msg_len += len;
+    return 0;
+}
+
+/* A data frame is complete: deliver the message if it was the last one. */
+static void on_data_frame(worker_t *w, connection_t *c) {
+    ws_conn_t *ws = c->ws;
+    if (!ws->frame.fin) return;
+    deliver(w, c, ws->msg_opcode, ws->msg, ws->msg_len);
+    ws->msg_opcode = 0;
+    ws->msg_len = 0;
+    /* do not keep a large buffer around for one large message */
+    if (ws->msg_cap > 65536) {
+        free(ws->msg);
+        ws->msg = NULL;
+        ws->msg_cap = 0;
+    }
+}
+
+/*
+ * The frame parser. c->buf holds whatever was read; payloads are unmasked in
+ * place and handled as they arrive, so a frame never has to fit the buffer.
+ * A complete single-frame message is broadcast straight from the buffer.
+ * Only a partial frame header is left in c->buf afterwards.
+ */
+void ws_on_input(worker_t *w, connection_t *c) {
+    ws_conn_t *ws = c->ws;
+    size_t off = 0;
+    while (c->fd >= 0 && !ws->done) {
+        uint8_t *p = (uint8_t *)c->buf + off;
+        size_t avail = c->buflen - off;
+        if (!ws->in_frame) {
+            ws_frame_t f;
+            int r = ws_parse_header(p, avail, &f);
+            if (r == 0) break;
+            /* clients must mask every frame */
+            if (r < 0 || !f.masked) {
+                fail(w, c, WS_CLOSE_PROTOCOL);
+                break;
+            }
+            if (f.opcode < WS_OP_CLOSE) {
+                /* continuations only inside a message, new messages only outside one */
+                if ((f.opcode == WS_OP_CONT) != (ws->msg_opcode != 0)) {
+                    fail(w, c, WS_CLOSE_PROTOCOL);
+                    break;
+                }
+                if (ws->msg_len + f.len > WS_MAX_MESSAGE) {
+                    fail(w, c, WS_CLOSE_TOO_BIG);
+                    break;
+                }
+                if (f.opcode != WS_OP_CONT) ws->msg_opcode = f.opcode;
+            }
+            off += f.hlen;
+            avail -= f.hlen;
+            if (f.fin && f.opcode != WS_OP_CONT && f.opcode < WS_OP_CLOSE && f.len <= avail) {
+                ws_mask(p + f.hlen, (size_t)f.len, f.mask, 0);
+                deliver(w, c, f.opcode, p + f.hlen, (size_t)f.len);
+                ws->msg_opcode = 0;
+                off += (size_t)f.len;
+                continue;
+            }
+            ws->frame = f;
+            ws->frame_pos = 0;
+            ws->in_frame = 1;
+            continue;
+        }
+        uint64_t want = ws->frame.len - ws->frame_pos;
+        size_t take = want < avail ? (size_t)want : avail;
+        if (take == 0 && want) break;
+        ws_mask(p, take, ws->frame.mask, ws->frame_pos);
+        if (ws->frame.opcode >= WS_OP_CLOSE) {
+            memcpy(ws->ctl + ws->frame_pos, p, take);
+        } else if (msg_append(ws, p, take) < 0) {
+            fail(w, c, WS_CLOSE_TOO_BIG);
+            break;
+        }
+        ws->frame_pos += take;
+        off += take;
+        if (ws->frame_pos < ws->frame.len) break;
+        ws->in_frame = 0;
+        if (ws->frame.opcode >= WS_OP_CLOSE) on_control(w, c, &ws->frame);
+        else on_data_frame(w, c);
+    }
+    if (c->fd < 0) return;
+    memmove(c->buf, c->buf + off, c->buflen - off);
+    c->buflen -= off;
+    if (ws->done) {
+        if (!conn_pending(c)) {
+            conn_close(w, c);
+            return;
+        }
+        c->read_paused = 1;
+        conn_update_events(w, c);
+    }
+}
+
+void ws_on_client_event(worker_t *w, connection_t *c, uint32_t events) {
+    if (events & EPOLLOUT) {
+        int fr = conn_flush(w, c);
+        if (fr < 0 || (fr == 1 && c->ws->done)) {
+            conn_close(w, c);
+            return;
+        }
+    }
+    if (!(events & (EPOLLIN | EPOLLHUP | EPOLLERR))) return;
+    if (c->read_paused) {
+        /* only hangups get here; the output can no longer be delivered */
+        conn_close(w, c);
+        return;
+    }
+    /* a bounded number of reads per event keeps one busy client from
+     * starving the rest; level triggering brings us back */
+    for (int i = 0; i < 16 && c->fd >= 0 && c->ws && !c->ws->done; ++i) {
+        ssize_t r = recv(c->fd, c->buf + c->buflen, sizeof(c->buf) - c->buflen, 0);
+        if (r == 0) {
+            conn_close(w, c);
+            return;
+        }
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return;
+            conn_close(w, c);
+            return;
+        }
+        c->buflen += (size_t)r;
+        ws_on_input(w, c);
+    }
+}
+
+/* ---- broadcast ---- */
+
+static int broadcast_channel(server_t *srv, uint64_t channel, int opcode, const void *data, size_t len) {
+    shared_buf_t *b = shared_buf_new(NULL, WS_MAX_HEADER + len);
+    if (!b) return -1;
+    size_t hlen = ws_encode_header((uint8_t *)b->data, opcode, len);
+    memcpy(b->data + hlen, data, len);
+    b->len = hlen + len;
+    int rc = 0;
+    for (int i = 0; i < srv->nworkers; ++i) {
+        worker_t *w = &srv->workers[i];
+        ws_worker_t *ww = w->ws;
+        if (!ww) continue;
+        pthread_mutex_lock(&ww->lock);
+        if (ww->inbox_len == ww->inbox_cap) {
+            size_t ncap = ww->inbox_cap ? ww->inbox_cap * 2 : 64;
+            ws_pending_t *ni = realloc(ww->inbox, ncap * sizeof(*ni));
+            if (!ni) {
+                pthread_mutex_unlock(&ww->lock);
+                rc = -1;
+                continue;
+            }
+            ww->inbox = ni;
+            ww->inbox_cap = ncap;
+        }
+        shared_buf_ref(b);
+        ww->inbox[ww->inbox_len].frame = b;
+        ww->inbox[ww->inbox_len].channel = channel;
+        int wake = ww->inbox_len++ == 0;
+        pthread_mutex_unlock(&ww->lock);
+        /* one wakeup per batch: a non-empty inbox is already signalled */
+        uint64_t one = 1;
+        if (wake && write(w->notify.fd, &one, sizeof(one)) < 0) perror("ws notify");
+    }
+    shared_buf_unref(b);
+    return rc;
+}
+
+int ws_broadcast(server_t *srv, const char *channel, int opcode, const void *data, size_t len) {
+    return broadcast_channel(srv, conn_channel(channel), opcode, data, len);
+}
+
+void ws_worker_notified(worker_t *w) {
+    ws_worker_t *ww = w->ws;
+    if (!ww) return;
+    pthread_mutex_lock(&ww->lock);
+    ws_pending_t *batch = ww->inbox;
+    size_t n = ww->inbox_len, cap = ww->inbox_cap;
+    ww->inbox = ww->work;
+    ww->inbox_cap = ww->work_cap;
+    ww->inbox_len = 0;
+    pthread_mutex_unlock(&ww->lock);
+    ww->work = batch;
+    ww->work_cap = cap;
+    if (!n) return;
+    /* queue the whole batch on each subscriber, then write it with one writev */
+    for (ws_conn_t *s = ww->subs, *next; s; s = next) {
+        next = s->next;
+        connection_t *c = s->conn;
+        if (s->closing) continue;
+        int queued = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (batch[i].channel != s->channel) continue;
+            if (c->sq_bytes > WS_MAX_QUEUED) {
+                fprintf(w->logf, "websocket fd=%d dropped: %zu bytes behind\n", c->fd, c->sq_bytes);
+                fflush(w->logf);
+                conn_close(w, c);
+                queued = 0;
+                break;
+            }
+            if (conn_queue_shared(c, batch[i].frame) < 0) break;
+            queued = 1;
+        }
+        if (queued && conn_flush(w, c) < 0) conn_close(w, c);
+    }
+    for (size_t i = 0; i < n; ++i) shared_buf_unref(batch[i].frame);
+}
+
+void ws_drain(worker_t *w) {
+    ws_worker_t *ww = w->ws;
+    if (!ww) return;
+    for (ws_conn_t *s = ww->subs, *next; s; s = next) {
+        next = s->next;
+        connection_t *c = s->conn;
+        send_close(w, c, WS_CLOSE_GOING_AWAY);
+        if (s->done && !conn_pending(c)) conn_close(w, c);
+    }
+}
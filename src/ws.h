@@ -0,0 +1,111 @@
+#ifndef WS_H
+#define WS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "conn.h"
+
+/*
+ * WebSocket push channels (RFC 6455). A GET below cfg->ws_path carrying the
+ * upgrade headers is answered with 101 and the connection switches to the
+ * frame parser in ws_on_client_event(). Every request path is a channel:
+ * each complete text or binary message a client sends is broadcast to all
+ * subscribers of its channel, on every worker.
+ *
+ * A broadcast is encoded once into a shared_buf_t; each subscriber's write
+ * queue holds a reference to it, so fan-out costs one pointer per receiver
+ * rather than one copy. Other workers are handed the same buffer through a
+ * per-worker inbox and their notify eventfd.
+ */
+
+#define WS_MAX_HEADER 14         /* largest frame header: 2 + 8 length + 4 mask */
+#define WS_MAX_MESSAGE (1 << 20) /* larger messages are refused with close 1009 */
+#define WS_MAX_QUEUED (4 << 20)  /* a subscriber this far behind is dropped */
+#define WS_ACCEPT_LEN 28
+
+enum ws_opcode {
+    WS_OP_CONT = 0x0,
+    WS_OP_TEXT = 0x1,
+    WS_OP_BINARY = 0x2,
+    WS_OP_CLOSE = 0x8,
+    WS_OP_PING = 0x9,
+    WS_OP_PONG = 0xA
+};
+
+/* Close status codes sent by the server */
+enum ws_status {
+    WS_CLOSE_NORMAL = 1000,
+    WS_CLOSE_GOING_AWAY = 1001,
+    WS_CLOSE_PROTOCOL = 1002,
+    WS_CLOSE_INVALID = 1007, /* a text message that is not UTF-8 */
+    WS_CLOSE_TOO_BIG = 1009
+};
+
+typedef struct ws_frame_s {
+    int fin;
+    int opcode;
+    int masked;
+    uint8_t mask[4];
+    uint64_t len;  /* payload length */
+    size_t hlen;   /* header length */
+} ws_frame_t;
+
+/*
+ * Parse a frame header from the start of buf. Returns 1 with f filled in, 0
+ * if more bytes are needed, -1 for a header no endpoint may send (reserved
+ * bits set, unknown opcode, fragmented or oversized control frame, 64-bit
+ * length with the top bit set).
+ */
+int ws_parse_header(const uint8_t *buf, size_t len, ws_frame_t *f);
+
+/* Write an unmasked (server) frame header with FIN set into out, which must
+ * hold WS_MAX_HEADER bytes. Returns its length. */
+size_t ws_encode_header(uint8_t *out, int opcode, uint64_t len);
+
+/* XOR data with a masking key, data[0] being payload byte pos. Masking and
+ * unmasking are the same operation. Uses AVX2 or SSE2 where available. */
+void ws_mask(uint8_t *data, size_t len, const uint8_t key[4], uint64_t pos);
+
+/* Is data well-formed UTF-8 (no overlong forms, surrogates or code points
+ * past U+10FFFF)? Text messages and close reasons must be. */
+int ws_utf8_valid(const uint8_t *data, size_t len);
+
+/* Sec-WebSocket-Accept value for a Sec-WebSocket-Key: base64(SHA-1(key + GUID)). */
+void ws_accept_key(const char *key, char out[WS_ACCEPT_LEN + 1]);
+
+/* Per-worker subscriber list and inbox. Returns 0/-1. */
+int ws_init(worker_t *w);
+void ws_shutdown(worker_t *w);
+
+/*
+ * Answer an upgrade request just parsed on c: 101 and c->ws set, or an error
+ * response (the connection then stays plain HTTP). Returns 0, or -1 on a
+ * fatal send error.
+ */
+int ws_upgrade(worker_t *w, connection_t *c, const char *path);
+
+/* Handle frames already buffered in c->buf (bytes sent right behind the
+ * handshake). May close c. */
+void ws_on_input(worker_t *w, connection_t *c);
+
+/* Handle an epoll event on an upgraded connection. May close c. */
+void ws_on_client_event(worker_t *w, connection_t *c, uint32_t events);
+
+/*
+ * Send a message to every subscriber of channel on every worker. The frame is
+ * encoded once here; workers pick it up from their inbox when notified.
+ * Callable from any thread. Returns 0, or -1 if out of memory.
+ */
+int ws_broadcast(server_t *srv, const char *channel, int opcode, const void *data, size_t len);
+
+/* Deliver the broadcasts queued for this worker. */
+void ws_worker_notified(worker_t *w);
+
+/* Start a close handshake (1001) on every subscriber: the process is handing
+ * its clients to a successor. */
+void ws_drain(worker_t *w);
+
+/* Drop the WebSocket state of a connection that is being closed. */
+void ws_abort(worker_t *w, connection_t *c);
+
+#endif
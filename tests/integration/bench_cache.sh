@@ -0,0 +1,55 @@
+#!/usr/bin/env bash
+# Micro-cache gain on a deliberately slow generated response (-x): the same
+# keep-alive load on one non-file path with the cache off, with a short TTL,
+# and with the same TTL plus stale-while-revalidate, then the cache counters.
+#   CONNS, DURATION, DELAY_US, TTL_MS override the defaults below.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+LOADGEN="$ROOT_DIR/tests/integration/loadgen"
+PORT=${PORT:-8082}
+CONNS=${CONNS:-32}
+DURATION=${DURATION:-5}
+DELAY_US=${DELAY_US:-2000}
+TTL_MS=${TTL_MS:-100}
+TMP="$(mktemp -d)"
+URL="http://127.0.0.1:$PORT"
+SERVER_PID=
+
+for b in "$BIN" "$LOADGEN"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+stop_server() {
+  if [ -n "$SERVER_PID" ]; then
+    kill "$SERVER_PID" 2>/dev/null || true
+    wait "$SERVER_PID" 2>/dev/null || true
+    SERVER_PID=
+  fi
+}
+trap 'stop_server; rm -rf "$TMP"' EXIT
+
+run() {
+  local name=$1
+  shift
+  "$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -w 2 -S /_status -x "$DELAY_US" "$@" &
+  SERVER_PID=$!
+  for i in $(seq 1 50); do
+    curl -s -o /dev/null "$URL/_status" && break
+    sleep 0.1
+  done
+  printf '%-10s %s\n' "$name" "$("$LOADGEN" -p "$PORT" -c "$CONNS" -d "$DURATION" -u /api/report)"
+  curl -s "$URL/_status" | awk '/^cache_/ { printf "%s%s=%s", sep, substr($1, 7), $2; sep = " " } END { if (sep) print "" }' |
+    sed 's/^/           /'
+  stop_server
+  rm -f "$TMP/server.log"
+}
+
+echo "generated response takes ${DELAY_US}us, $CONNS connections, ${DURATION}s"
+run off
+run ttl -C "$TTL_MS"
+run ttl+stale -C "$TTL_MS" -s 1000
@@ -0,0 +1,53 @@
+#!/usr/bin/env bash
+# Loopback latency benchmark: the same keep-alive load against the default
+# mode and the low-latency mode (workers pinned with -A, connections steered
+# to the pinned CPU, busy polling with -B). Prints one loadgen line per mode.
+#   CONNS, DURATION, WORKERS, BUSY_POLL_US override the defaults below.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+LOADGEN="$ROOT_DIR/tests/integration/loadgen"
+PORT=${PORT:-8097}
+CONNS=${CONNS:-8}
+DURATION=${DURATION:-5}
+NCPU=$(nproc)
+WORKERS=${WORKERS:-$(( NCPU > 1 ? NCPU / 2 : 1 ))}
+BUSY_POLL_US=${BUSY_POLL_US:-50}
+TMP="$(mktemp -d)"
+SERVER_PID=
+
+for b in "$BIN" "$LOADGEN"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+stop_server() {
+  if [ -n "$SERVER_PID" ]; then
+    kill "$SERVER_PID" 2>/dev/null || true
+    wait "$SERVER_PID" 2>/dev/null || true
+    SERVER_PID=
+  fi
+}
+trap 'stop_server; rm -rf "$TMP"' EXIT
+
+run() {
+  local name=$1
+  shift
+  "$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -w "$WORKERS" "$@" &
+  SERVER_PID=$!
+  for i in $(seq 1 50); do
+    curl -s -o /dev/null "http://127.0.0.1:$PORT/" && break
+    sleep 0.1
+  done
+  printf '%-12s %s\n' "$name" "$("$LOADGEN" -p "$PORT" -c "$CONNS" -d "$DURATION")"
+  stop_server
+}
+
+# the pinned workers take the upper CPUs, leaving the lower ones to loadgen
+FIRST=$(( NCPU > WORKERS ? NCPU - WORKERS : 0 ))
+echo "cpus=$NCPU workers=$WORKERS conns=$CONNS busy_poll_us=$BUSY_POLL_US"
+run default
+run low-latency -A "$FIRST-$(( NCPU - 1 ))" -B "$BUSY_POLL_US"
@@ -0,0 +1,52 @@
+#!/usr/bin/env bash
+# Tracing overhead: the same keep-alive load with the flight recorder off and
+# on, alternating ROUNDS times. Set BASELINE_BIN to a build without tracing
+# (e.g. the previous commit) to add it to the comparison.
+#   CONNS, DURATION, ROUNDS override the defaults below.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+LOADGEN="$ROOT_DIR/tests/integration/loadgen"
+PORT=${PORT:-8099}
+CONNS=${CONNS:-8}
+DURATION=${DURATION:-5}
+ROUNDS=${ROUNDS:-3}
+TMP="$(mktemp -d)"
+SERVER_PID=
+
+for b in "$BIN" "$LOADGEN"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+stop_server() {
+  if [ -n "$SERVER_PID" ]; then
+    kill "$SERVER_PID" 2>/dev/null || true
+    wait "$SERVER_PID" 2>/dev/null || true
+    SERVER_PID=
+  fi
+}
+trap 'stop_server; rm -rf "$TMP"' EXIT
+
+run() {
+  local name=$1 bin=$2
+  shift 2
+  "$bin" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" "$@" &
+  SERVER_PID=$!
+  for i in $(seq 1 50); do
+    curl -s -o /dev/null "http://127.0.0.1:$PORT/" && break
+    sleep 0.1
+  done
+  printf '%-10s %s\n' "$name" "$("$LOADGEN" -p "$PORT" -c "$CONNS" -d "$DURATION" -u /index.html)"
+  stop_server
+  rm -f "$TMP/server.log"
+}
+
+for r in $(seq 1 "$ROUNDS"); do
+  if [ -n "${BASELINE_BIN:-}" ]; then run baseline "$BASELINE_BIN"; fi
+  run off "$BIN"
+  run on "$BIN" -T 4096
+done
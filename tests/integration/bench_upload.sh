@@ -0,0 +1,33 @@
+#!/usr/bin/env bash
+# Upload throughput over loopback: COUNT sequential PUTs of SIZE_MB each on
+# one keep-alive connection, spliced by the server into a file below a
+# temporary storage directory (page cache; nothing is fsync'ed).
+#   SIZE_MB, COUNT, DIR override the defaults below.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+CLIENT="$ROOT_DIR/tests/integration/upload_client"
+PORT=${PORT:-8088}
+SIZE_MB=${SIZE_MB:-256}
+COUNT=${COUNT:-8}
+TMP="$(mktemp -d)"
+DIR=${DIR:-$TMP/uploads}
+
+for b in "$BIN" "$CLIENT"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+"$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -u /upload -U "$DIR" -z "$SIZE_MB" &
+PID=$!
+trap 'kill $PID 2>/dev/null || true; wait $PID 2>/dev/null || true; rm -rf "$TMP"' EXIT
+for i in $(seq 1 50); do
+  curl -s -o /dev/null "http://127.0.0.1:$PORT/" && break
+  sleep 0.1
+done
+
+printf 'upload  %s\n' "$("$CLIENT" -p "$PORT" -u /upload/bench.bin -s "$SIZE_MB" -n "$COUNT")"
+rm -f "$DIR/bench.bin"
@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+# Broadcast fan-out: CONNS local WebSocket subscribers on one channel, one of
+# them publishing MESSAGES frames of SIZE bytes. Prints broadcasts/s and
+# deliveries/s (broadcasts times subscribers).
+#   CONNS, MESSAGES, SIZE, WORKERS override the defaults below.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+CLIENT="$ROOT_DIR/tests/integration/ws_client"
+PORT=${PORT:-8098}
+CONNS=${CONNS:-10000}
+MESSAGES=${MESSAGES:-1000}
+SIZE=${SIZE:-64}
+WORKERS=${WORKERS:-1}
+TMP="$(mktemp -d)"
+
+for b in "$BIN" "$CLIENT"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+# both ends hold CONNS sockets
+ulimit -n $((CONNS + 1024)) 2>/dev/null || { echo "need ulimit -n above $CONNS"; exit 2; }
+
+"$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -w "$WORKERS" -W /ws &
+PID=$!
+trap 'kill $PID 2>/dev/null || true; wait $PID 2>/dev/null || true; rm -rf "$TMP"' EXIT
+for i in $(seq 1 50); do
+  curl -s -o /dev/null "http://127.0.0.1:$PORT/" && break
+  sleep 0.1
+done
+
+printf 'websocket  %s\n' "$("$CLIENT" -p "$PORT" -c "$CONNS" -n "$MESSAGES" -s "$SIZE" bench)"
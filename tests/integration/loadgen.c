@@ -0,0 +1,230 @@
+// Closed-loop HTTP load generator for integration tests and benchmarks.
+// Keeps C connections busy with back-to-back GETs for D seconds (reconnecting
+// whenever the server answers "Connection: close") and prints one summary
+// line:
+//   requests=N failures=F rps=R p50_us=.. p99_us=.. p999_us=.. max_us=..
+// Any connection error, truncated response or non-2xx status is a failure.
+//   usage: loadgen [-p port] [-c conns] [-d seconds] [-u path] [-n]
+//   -n: new connection per request (no keep-alive)
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct client_s {
+    int fd;
+    int connecting;
+    char buf[65536];
+    size_t len;
+    size_t sent;
+    long long t_start;
+    int in_body;
+    size_t body_left;
+    int status;
+    int close_after;
+} client_t;
+
+static struct sockaddr_in addr;
+static char request[1024];
+static size_t request_len;
+static int keepalive = 1;
+static int epfd;
+
+static uint32_t *samples;
+static size_t nsamples, capsamples;
+static unsigned long failures;
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void record(long long us) {
+    if (nsamples == capsamples) {
+        capsamples = capsamples ? capsamples * 2 : 65536;
+        samples = realloc(samples, capsamples * sizeof(*samples));
+        if (!samples) exit(1);
+    }
+    samples[nsamples++] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+static void client_open(client_t *c) {
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c->len = c->sent = 0;
+    c->in_body = 0;
+    c->connecting = 1;
+    c->t_start = now_us();
+    if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        failures++;
+    }
+    struct epoll_event ev;
+    ev.events = EPOLLOUT;
+    ev.data.ptr = c;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, c->fd, &ev);
+}
+
+static void client_reset(client_t *c, int failed) {
+    if (failed) failures++;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    client_open(c);
+}
+
+static void client_send(client_t *c) {
+    while (c->sent < request_len) {
+        ssize_t n = send(c->fd, request + c->sent, request_len - c->sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            c->sent += (size_t)n;
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) break;
+        client_reset(c, 1);
+        return;
+    }
+    struct epoll_event ev;
+    ev.events = c->sent < request_len ? EPOLLOUT : EPOLLIN;
+    ev.data.ptr = c;
+    epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+/* Parse a buffered response head. Returns its length, 0 if incomplete. */
+static size_t parse_head(client_t *c) {
+    char *end = memmem(c->buf, c->len, "\r\n\r\n", 4);
+    if (!end) return 0;
+    c->status = atoi(c->buf + 9);
+    c->close_after = 0;
+    c->body_left = 0;
+    char *line = memmem(c->buf, (size_t)(end - c->buf) + 2, "\r\n", 2);
+    while (line && line < end) {
+        line += 2;
+        char *le = memmem(line, (size_t)(end - line) + 2, "\r\n", 2);
+        if (!le) break;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) c->body_left = strtoul(line + 15, NULL, 10);
+        if (strncasecmp(line, "Connection:", 11) == 0 && memmem(line, (size_t)(le - line), "close", 5)) {
+            c->close_after = 1;
+        }
+        line = le;
+    }
+    return (size_t)(end - c->buf) + 4;
+}
+
+static void client_read(client_t *c) {
+    for (;;) {
+        ssize_t n = recv(c->fd, c->buf + c->len, sizeof(c->buf) - c->len, 0);
+        if (n > 0) {
+            if (c->in_body) {
+                size_t take = (size_t)n < c->body_left ? (size_t)n : c->body_left;
+                c->body_left -= take;
+            } else {
+                c->len += (size_t)n;
+                size_t hlen = parse_head(c);
+                if (hlen) {
+                    size_t extra = c->len - hlen;
+                    c->body_left -= extra < c->body_left ? extra : c->body_left;
+                    c->in_body = 1;
+                    c->len = 0;
+                } else if (c->len == sizeof(c->buf)) {
+                    client_reset(c, 1);
+                    return;
+                }
+            }
+            if (c->in_body && c->body_left == 0) break;
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN) return;
+        /* EOF or error before the response completed */
+        client_reset(c, 1);
+        return;
+    }
+    long long t = now_us();
+    if (c->status < 200 || c->status >= 300) failures++;
+    else record(t - c->t_start);
+    if (c->close_after || !keepalive) {
+        client_reset(c, 0);
+        return;
+    }
+    c->in_body = 0;
+    c->len = 0;
+    c->sent = 0;
+    c->t_start = t;
+    client_send(c);
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t pct(double p) {
+    if (!nsamples) return 0;
+    size_t i = (size_t)(p * (double)(nsamples - 1));
+    return samples[i];
+}
+
+int main(int argc, char **argv) {
+    int port = 8080, conns = 8, seconds = 5;
+    const char *path = "/";
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:d:u:n")) != -1) {
+        switch (opt) {
+        case 'p': port = atoi(optarg); break;
+        case 'c': conns = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        case 'u': path = optarg; break;
+        case 'n': keepalive = 0; break;
+        default:
+            fprintf(stderr, "usage: %s [-p port] [-c conns] [-d seconds] [-u path] [-n]\n", argv[0]);
+            return 2;
+        }
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    request_len = (size_t)snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: localhost\r\n%s\r\n", path,
+                                   keepalive ? "" : "Connection: close\r\n");
+    epfd = epoll_create1(0);
+    client_t *clients = calloc((size_t)conns, sizeof(client_t));
+    if (!clients) return 1;
+    for (int i = 0; i < conns; ++i) client_open(&clients[i]);
+
+    long long start = now_us();
+    long long end = start + (long long)seconds * 1000000;
+    struct epoll_event events[256];
+    while (now_us() < end) {
+        int n = epoll_wait(epfd, events, 256, 100);
+        for (int i = 0; i < n; ++i) {
+            client_t *c = events[i].data.ptr;
+            if (c->connecting) {
+                int err = 0;
+                socklen_t el = sizeof(err);
+                getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &el);
+                if (err || (events[i].events & EPOLLERR)) {
+                    client_reset(c, 1);
+                    continue;
+                }
+                c->connecting = 0;
+            }
+            if (events[i].events & EPOLLOUT) client_send(c);
+            else client_read(c);
+        }
+    }
+    double elapsed = (double)(now_us() - start) / 1e6;
+    qsort(samples, nsamples, sizeof(*samples), cmp_u32);
+    printf("requests=%zu failures=%lu rps=%.0f p50_us=%u p99_us=%u p999_us=%u max_us=%u\n", nsamples, failures,
+           (double)nsamples / elapsed, pct(0.50), pct(0.99), pct(0.999), nsamples ? samples[nsamples - 1] : 0);
+    return failures ? 1 : 0;
+}
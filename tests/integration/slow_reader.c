@@ -0,0 +1,64 @@
+// Slow HTTP client for backpressure tests: GETs a path and reads the
+// response at a limited rate through a small receive buffer, then prints the
+// number of body bytes received.
+//   usage: slow_reader PORT PATH BYTES_PER_SEC
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char **argv) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s PORT PATH BYTES_PER_SEC\n", argv[0]);
+        return 2;
+    }
+    int port = atoi(argv[1]);
+    long rate = atol(argv[3]);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int rcvbuf = 16384;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return 1;
+    }
+    char req[1024];
+    int n = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n", argv[2]);
+    if (write(fd, req, (size_t)n) != n) return 1;
+
+    /* read in 10ms slices of rate/100 bytes */
+    size_t slice = rate / 100 > 0 ? (size_t)(rate / 100) : 1;
+    char *buf = malloc(slice + 1);
+    size_t total = 0;
+    size_t body_start = 0;
+    int in_body = 0;
+    char tail[4] = { 0 };
+    struct timespec ts = { 0, 10 * 1000 * 1000 };
+    for (;;) {
+        ssize_t r = read(fd, buf, slice);
+        if (r <= 0) break;
+        for (ssize_t i = 0; i < r && !in_body; ++i) {
+            memmove(tail, tail + 1, 3);
+            tail[3] = buf[i];
+            if (memcmp(tail, "\r\n\r\n", 4) == 0) {
+                in_body = 1;
+                body_start = total + (size_t)i + 1;
+            }
+        }
+        total += (size_t)r;
+        nanosleep(&ts, NULL);
+    }
+    printf("%zu\n", in_body ? total - body_start : 0);
+    free(buf);
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,42 @@
+// LD_PRELOAD shim that makes a directory tree behave like a slow file system
+// (a cold network mount): realpath(), stat() and fopen() on paths below
+// SLOWFS_PREFIX sleep SLOWFS_DELAY_MS milliseconds before doing the real
+// call. Everything else passes straight through.
+//   LD_PRELOAD=tests/integration/slowfs.so SLOWFS_PREFIX=/srv/www SLOWFS_DELAY_MS=100 bin/c-http-server ...
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+static void maybe_sleep(const char *path) {
+    const char *prefix = getenv("SLOWFS_PREFIX");
+    const char *delay = getenv("SLOWFS_DELAY_MS");
+    if (!path || !prefix || !delay || strncmp(path, prefix, strlen(prefix)) != 0) return;
+    long ms = atol(delay);
+    struct timespec ts = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&ts, NULL);
+}
+
+char *realpath(const char *path, char *resolved) {
+    static char *(*real)(const char *, char *);
+    if (!real) real = (char *(*)(const char *, char *))dlsym(RTLD_NEXT, "realpath");
+    maybe_sleep(path);
+    return real(path, resolved);
+}
+
+int stat(const char *path, struct stat *st) {
+    static int (*real)(const char *, struct stat *);
+    if (!real) real = (int (*)(const char *, struct stat *))dlsym(RTLD_NEXT, "stat");
+    maybe_sleep(path);
+    return real(path, st);
+}
+
+FILE *fopen(const char *path, const char *mode) {
+    static FILE *(*real)(const char *, const char *);
+    if (!real) real = (FILE * (*)(const char *, const char *)) dlsym(RTLD_NEXT, "fopen");
+    maybe_sleep(path);
+    return real(path, mode);
+}
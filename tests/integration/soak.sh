@@ -0,0 +1,111 @@
+#!/usr/bin/env bash
+# Soak under hostile clients: idle keep-alive connections, byte-at-a-time
+# slowloris senders and clients that pipeline requests without reading the
+# responses, all held open while a few fast clients measure latency (see
+# soak_client.c). The server's RSS and open fd count are sampled every second.
+# Fails if the server dies, a bound is exceeded, or fds are still open once
+# the clients are gone.
+#   IDLE, SLOW, STALLED, FAST    connections of each kind
+#   DURATION                     seconds measured once all are connected
+#   WORKERS                      server worker threads
+#   MAX_RSS_MB, MAX_P99_MS, MAX_FAILURES, MAX_FDS (default: one per
+#   connection plus a margin) bound the run.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+CLIENT="$ROOT_DIR/tests/integration/soak_client"
+PORT=${PORT:-8087}
+IDLE=${IDLE:-20000}
+SLOW=${SLOW:-5000}
+STALLED=${STALLED:-1000}
+FAST=${FAST:-8}
+DURATION=${DURATION:-60}
+WORKERS=${WORKERS:-2}
+TOTAL=$(( IDLE + SLOW + STALLED + FAST ))
+MAX_RSS_MB=${MAX_RSS_MB:-1024}
+MAX_P99_MS=${MAX_P99_MS:-100}
+MAX_FAILURES=${MAX_FAILURES:-0}
+MAX_FDS=${MAX_FDS:-$(( TOTAL + 64 ))}
+TMP="$(mktemp -d)"
+
+for b in "$BIN" "$CLIENT"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+# both sides hold one fd per connection
+NOFILE=$(( TOTAL + 1024 ))
+if ! ulimit -n "$NOFILE" 2>/dev/null; then
+  echo "soak: needs $NOFILE open files (hard limit $(ulimit -Hn)); lower IDLE/SLOW/STALLED"
+  exit 2
+fi
+
+"$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -w "$WORKERS" &
+PID=$!
+trap 'kill $PID 2>/dev/null || true; wait $PID 2>/dev/null || true; rm -rf "$TMP"' EXIT
+
+fail() {
+  echo "FAIL: $*"
+  echo "--- server log"
+  tail -n 30 "$TMP/server.log" || true
+  exit 1
+}
+
+for i in $(seq 1 50); do
+  curl -s -o /dev/null "http://127.0.0.1:$PORT/" && break
+  sleep 0.1
+done
+
+rss_kb() {
+  awk '/^VmRSS:/ { print $2 }' "/proc/$PID/status"
+}
+fds() {
+  ls "/proc/$PID/fd" | wc -l
+}
+
+BASE_RSS=$(rss_kb)
+BASE_FDS=$(fds)
+"$CLIENT" -p "$PORT" -d "$DURATION" -i "$IDLE" -s "$SLOW" -x "$STALLED" -c "$FAST" > "$TMP/client.out" &
+CPID=$!
+PEAK_RSS=$BASE_RSS
+PEAK_FDS=$BASE_FDS
+while kill -0 "$CPID" 2>/dev/null; do
+  kill -0 "$PID" 2>/dev/null || fail "server died"
+  R=$(rss_kb)
+  F=$(fds)
+  [ "$R" -gt "$PEAK_RSS" ] && PEAK_RSS=$R
+  [ "$F" -gt "$PEAK_FDS" ] && PEAK_FDS=$F
+  sleep 1
+done
+wait "$CPID" || true
+RESULT=$(cat "$TMP/client.out")
+[ -n "$RESULT" ] || fail "soak client gave no result"
+
+value() {
+  sed -n "s/.*\\b$1=\\([0-9]*\\).*/\\1/p" <<< "$RESULT"
+}
+
+echo "connections=$TOTAL (idle=$IDLE slow=$SLOW stalled=$STALLED fast=$FAST) workers=$WORKERS"
+echo "client  $RESULT"
+echo "server  rss_base_mb=$(( BASE_RSS / 1024 )) rss_peak_mb=$(( PEAK_RSS / 1024 ))" \
+  "kb_per_conn=$(( (PEAK_RSS - BASE_RSS) / TOTAL )) fds_peak=$PEAK_FDS"
+
+# every connection is gone once the clients are: nothing may leak
+for i in $(seq 1 50); do
+  [ "$(fds)" -le "$(( BASE_FDS + 2 ))" ] && break
+  sleep 0.1
+done
+
+[ "$(value idle)" = "$IDLE" ] && [ "$(value slow)" = "$SLOW" ] && [ "$(value stalled)" = "$STALLED" ] ||
+  fail "connections lost"
+[ "$(value failures)" -le "$MAX_FAILURES" ] || fail "$(value failures) failed fast requests"
+[ "$(value requests)" -gt 0 ] || fail "no fast request completed"
+[ "$(value p99_us)" -le "$(( MAX_P99_MS * 1000 ))" ] || fail "p99 above ${MAX_P99_MS}ms"
+[ "$PEAK_RSS" -le "$(( MAX_RSS_MB * 1024 ))" ] || fail "RSS above ${MAX_RSS_MB}MB"
+[ "$PEAK_FDS" -le "$MAX_FDS" ] || fail "$PEAK_FDS fds open, bound $MAX_FDS"
+[ "$(fds)" -le "$(( BASE_FDS + 2 ))" ] || fail "$(( $(fds) - BASE_FDS )) fds still open after the run"
+kill -0 "$PID" 2>/dev/null || fail "server died"
+echo "Soak passed"
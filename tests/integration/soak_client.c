@@ -0,0 +1,398 @@
+// Soak client: holds a large mix of hostile and idle connections open against
+// the server while a few fast clients measure request latency.
+//   idle     one GET, then the connection sits open
+//   slow     slowloris: requests sent one byte at a time, -t ms apart
+//   stalled  pipelined GETs through a small receive buffer, never read
+//   fast     closed-loop keep-alive GETs, latency recorded
+// Connections the server closes are reopened (counted as reconnects; for the
+// fast clients a close before the response is complete is a failure). The
+// hostile connections are ramped up first; latency is recorded for D seconds
+// starting one second after the last of them is connected. Prints one summary line:
+//   requests=N failures=F p50_us=.. p99_us=.. p999_us=.. max_us=.. idle=..
+//   slow=.. stalled=.. reconnects=.. slow_requests=.. ramp_ms=..
+// where idle/slow/stalled count the connections open at the end.
+//   usage: soak_client [-p port] [-d seconds] [-u path] [-i idle] [-s slow]
+//                      [-x stalled] [-c fast] [-t slow_interval_ms]
+// Connections are spread over source addresses 127.0.0.1-127.0.0.64, so more
+// than one ephemeral port range worth of them can be open.
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef IP_BIND_ADDRESS_NO_PORT
+#define IP_BIND_ADDRESS_NO_PORT 24
+#endif
+
+/* new connections per loop iteration while ramping up */
+#define RAMP_BATCH 256
+#define SOURCE_ADDRS 64
+#define SETTLE_US 1000000
+
+enum { IDLE, SLOW, STALLED, FAST, KINDS };
+
+typedef struct client_s {
+    int fd;
+    int kind;
+    int index;
+    int connecting;
+    int established;      /* connected at least once */
+    int waiting;          /* request sent, response not complete */
+    char head[1024];      /* response head being collected */
+    size_t head_len;
+    size_t body_left;
+    int in_body;
+    int status;
+    int close_after;
+    size_t sent;
+    long long t_start;
+    long long next_byte;  /* slow: when the next request byte is due */
+} client_t;
+
+static struct sockaddr_in addr;
+static char request[1024];
+static size_t request_len;
+static char pipeline[16384]; /* the request, repeated */
+static size_t pipeline_len;
+static int epfd;
+static int slow_interval_ms = 1000;
+static int measuring;
+static long long measure_start;
+
+static uint32_t *samples;
+static size_t nsamples, capsamples;
+static unsigned long failures, reconnects, slow_requests;
+static int open_count[KINDS];
+static int established_count;
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void record(long long us) {
+    if (nsamples == capsamples) {
+        capsamples = capsamples ? capsamples * 2 : 65536;
+        samples = realloc(samples, capsamples * sizeof(*samples));
+        if (!samples) exit(1);
+    }
+    samples[nsamples++] = us > UINT32_MAX ? UINT32_MAX : (uint32_t)us;
+}
+
+static void watch(client_t *c, int op, uint32_t events) {
+    struct epoll_event ev;
+    ev.events = events;
+    ev.data.ptr = c;
+    epoll_ctl(epfd, op, c->fd, &ev);
+}
+
+static void client_open(client_t *c) {
+    c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (c->fd < 0) {
+        perror("soak_client: socket");
+        exit(1);
+    }
+    int one = 1;
+    setsockopt(c->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (c->kind == STALLED) {
+        /* the responses pile up on the server's side of the connection; a
+         * small send buffer fills quickly once the server stops reading */
+        int size = 4096;
+        setsockopt(c->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        setsockopt(c->fd, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    }
+    /* the port is picked at connect(), per source address */
+    struct sockaddr_in src;
+    memset(&src, 0, sizeof(src));
+    src.sin_family = AF_INET;
+    src.sin_addr.s_addr = htonl(INADDR_LOOPBACK + (uint32_t)(c->index % SOURCE_ADDRS));
+    setsockopt(c->fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+    bind(c->fd, (struct sockaddr *)&src, sizeof(src));
+    c->connecting = 1;
+    c->waiting = 0;
+    c->in_body = 0;
+    c->head_len = 0;
+    c->sent = 0;
+    if (connect(c->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        if (c->kind == FAST) failures++;
+    }
+    watch(c, EPOLL_CTL_ADD, EPOLLOUT);
+}
+
+/* The server closed the connection (or it failed): open a new one. */
+static void client_reset(client_t *c) {
+    if (!c->connecting) open_count[c->kind]--;
+    if (c->kind == FAST && (c->connecting || c->waiting) && measuring) failures++;
+    else if (c->kind != FAST) reconnects++;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, c->fd, NULL);
+    close(c->fd);
+    client_open(c);
+}
+
+/* Send what is left of the request; slow clients send one byte. */
+static void client_send(client_t *c) {
+    size_t want = c->kind == SLOW ? 1 : request_len - c->sent;
+    if (!c->waiting) {
+        c->waiting = 1;
+        c->t_start = now_us();
+    }
+    ssize_t n = send(c->fd, request + c->sent, want, MSG_NOSIGNAL);
+    if (n < 0 && errno == EAGAIN) n = 0;
+    if (n < 0) {
+        client_reset(c);
+        return;
+    }
+    c->sent += (size_t)n;
+    if (c->kind == SLOW) {
+        c->next_byte = now_us() + (long long)slow_interval_ms * 1000;
+        return;
+    }
+    watch(c, EPOLL_CTL_MOD, c->sent < request_len ? EPOLLOUT : EPOLLIN);
+}
+
+/* Stalled clients keep pipelining requests until the socket is full. */
+static void client_flood(client_t *c) {
+    for (;;) {
+        ssize_t n = send(c->fd, pipeline + c->sent, pipeline_len - c->sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EAGAIN) return;
+        if (n <= 0) {
+            client_reset(c);
+            return;
+        }
+        c->sent = (c->sent + (size_t)n) % request_len;
+    }
+}
+
+static void connected(client_t *c) {
+    c->connecting = 0;
+    open_count[c->kind]++;
+    if (!c->established) {
+        c->established = 1;
+        established_count++;
+    }
+    switch (c->kind) {
+    case STALLED:
+        client_flood(c);
+        break;
+    case SLOW:
+        /* spread the bytes of all slow clients over the interval */
+        watch(c, EPOLL_CTL_MOD, EPOLLIN);
+        c->next_byte = now_us() + rand() % (slow_interval_ms * 1000 + 1);
+        break;
+    default:
+        client_send(c);
+    }
+}
+
+/* Parse a complete response head. */
+static void parse_head(client_t *c, const char *end) {
+    c->status = atoi(c->head + 9);
+    c->close_after = 0;
+    c->body_left = 0;
+    const char *line = memmem(c->head, (size_t)(end - c->head) + 2, "\r\n", 2);
+    while (line && line < end) {
+        line += 2;
+        const char *le = memmem(line, (size_t)(end - line) + 2, "\r\n", 2);
+        if (!le) break;
+        if (strncasecmp(line, "Content-Length:", 15) == 0) c->body_left = strtoul(line + 15, NULL, 10);
+        if (strncasecmp(line, "Connection:", 11) == 0 && memmem(line, (size_t)(le - line), "close", 5)) {
+            c->close_after = 1;
+        }
+        line = le;
+    }
+}
+
+/* A response is complete: go on according to the kind of client. */
+static void response_done(client_t *c) {
+    long long t = now_us();
+    c->waiting = 0;
+    c->in_body = 0;
+    c->head_len = 0;
+    c->sent = 0;
+    if (c->kind == FAST && measuring && c->t_start >= measure_start) {
+        if (c->status < 200 || c->status >= 300) failures++;
+        else record(t - c->t_start);
+    }
+    if (c->kind == SLOW) slow_requests++;
+    if (c->close_after) {
+        client_reset(c);
+        return;
+    }
+    if (c->kind == FAST) client_send(c);
+    /* slow clients start over on their timer; idle ones just stay open */
+}
+
+static void client_read(client_t *c) {
+    static char scratch[65536];
+    for (;;) {
+        ssize_t n = recv(c->fd, scratch, sizeof(scratch), 0);
+        if (n < 0 && errno == EAGAIN) return;
+        if (n <= 0) {
+            client_reset(c);
+            return;
+        }
+        const char *p = scratch;
+        size_t left = (size_t)n;
+        while (left > 0 && c->waiting) {
+            if (!c->in_body) {
+                size_t take = sizeof(c->head) - 1 - c->head_len;
+                if (take > left) take = left;
+                memcpy(c->head + c->head_len, p, take);
+                size_t old = c->head_len;
+                c->head_len += take;
+                c->head[c->head_len] = '\0';
+                char *end = strstr(c->head, "\r\n\r\n");
+                if (!end) {
+                    if (c->head_len == sizeof(c->head) - 1) {
+                        client_reset(c);
+                        return;
+                    }
+                    left = 0;
+                    break;
+                }
+                size_t used = (size_t)(end - c->head) + 4 - old;
+                p += used;
+                left -= used;
+                parse_head(c, end);
+                c->in_body = 1;
+            }
+            size_t take = left < c->body_left ? left : c->body_left;
+            p += take;
+            left -= take;
+            c->body_left -= take;
+            if (c->body_left == 0) {
+                int fd = c->fd;
+                response_done(c);
+                if (c->fd != fd) return;
+            }
+        }
+    }
+}
+
+static void client_event(client_t *c, uint32_t events) {
+    if (c->connecting) {
+        int err = 0;
+        socklen_t el = sizeof(err);
+        getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &el);
+        if (err || (events & EPOLLERR)) {
+            client_reset(c);
+            return;
+        }
+        connected(c);
+        return;
+    }
+    if (c->kind == STALLED) {
+        if (events & (EPOLLERR | EPOLLHUP)) client_reset(c);
+        else client_flood(c);
+        return;
+    }
+    if (events & EPOLLIN) client_read(c);
+    else if (events & EPOLLOUT) client_send(c);
+    else client_reset(c);
+}
+
+static int cmp_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static uint32_t pct(double p) {
+    if (!nsamples) return 0;
+    size_t i = (size_t)(p * (double)(nsamples - 1));
+    return samples[i];
+}
+
+int main(int argc, char **argv) {
+    int port = 8080, seconds = 10;
+    int count[KINDS] = { 1000, 100, 100, 8 };
+    const char *path = "/";
+    int opt;
+    while ((opt = getopt(argc, argv, "p:d:u:i:s:x:c:t:")) != -1) {
+        switch (opt) {
+        case 'p': port = atoi(optarg); break;
+        case 'd': seconds = atoi(optarg); break;
+        case 'u': path = optarg; break;
+        case 'i': count[IDLE] = atoi(optarg); break;
+        case 's': count[SLOW] = atoi(optarg); break;
+        case 'x': count[STALLED] = atoi(optarg); break;
+        case 'c': count[FAST] = atoi(optarg); break;
+        case 't': slow_interval_ms = atoi(optarg); break;
+        default:
+            fprintf(stderr,
+                    "usage: %s [-p port] [-d seconds] [-u path] [-i idle] [-s slow] [-x stalled] [-c fast] "
+                    "[-t slow_interval_ms]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+    if (slow_interval_ms < 1) slow_interval_ms = 1;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    request_len = (size_t)snprintf(request, sizeof(request), "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n", path);
+    while (pipeline_len + request_len <= sizeof(pipeline)) {
+        memcpy(pipeline + pipeline_len, request, request_len);
+        pipeline_len += request_len;
+    }
+    epfd = epoll_create1(0);
+
+    int total = count[IDLE] + count[SLOW] + count[STALLED] + count[FAST];
+    client_t *clients = calloc((size_t)total, sizeof(client_t));
+    if (!clients || total <= 0) return 1;
+    /* the kinds interleave, so every part of the ramp sees all of them */
+    int k = 0, left[KINDS];
+    memcpy(left, count, sizeof(left));
+    for (int i = 0; i < total; ++k) {
+        if (!left[k % KINDS]) continue;
+        left[k % KINDS]--;
+        clients[i].kind = k % KINDS;
+        clients[i].index = i;
+        clients[i].fd = -1;
+        i++;
+    }
+
+    long long start = now_us(), end = 0;
+    int opened = 0;
+    long long ramp_us = 0;
+    struct epoll_event events[256];
+    while (!measuring || now_us() < end) {
+        for (int i = 0; i < RAMP_BATCH && opened < total; ++i) client_open(&clients[opened++]);
+        if (!ramp_us && established_count == total) ramp_us = now_us() - start;
+        /* the stalled clients' first flood settles before measuring starts */
+        if (!measuring && ramp_us && now_us() - start > ramp_us + SETTLE_US) {
+            measuring = 1;
+            measure_start = now_us();
+            end = measure_start + (long long)seconds * 1000000;
+        }
+        if (!ramp_us && now_us() - start > 120 * 1000000LL) {
+            fprintf(stderr, "soak_client: FAIL: only %d of %d connections established\n", established_count, total);
+            return 1;
+        }
+        int n = epoll_wait(epfd, events, 256, 10);
+        for (int i = 0; i < n; ++i) client_event(events[i].data.ptr, events[i].events);
+        long long t = now_us();
+        for (int i = 0; i < total; ++i) {
+            client_t *c = &clients[i];
+            if (c->kind != SLOW || c->connecting || c->fd < 0 || c->sent >= request_len) continue;
+            if (c->next_byte <= t) client_send(c);
+        }
+    }
+    qsort(samples, nsamples, sizeof(*samples), cmp_u32);
+    printf("requests=%zu failures=%lu p50_us=%u p99_us=%u p999_us=%u max_us=%u idle=%d slow=%d stalled=%d "
+           "reconnects=%lu slow_requests=%lu ramp_ms=%lld\n",
+           nsamples, failures, pct(0.50), pct(0.99), pct(0.999), nsamples ? samples[nsamples - 1] : 0,
+           open_count[IDLE], open_count[SLOW], open_count[STALLED], reconnects, slow_requests, ramp_us / 1000);
+    return failures ? 1 : 0;
+}
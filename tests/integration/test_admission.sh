@@ -0,0 +1,139 @@
+#!/usr/bin/env bash
+# Admission control: per-IP rate limiting (429), the global connection cap
+# (canned 503), the per-worker cap (connections wait in the kernel queue) and
+# accept-queue shedding, plus the counters on the status page.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+PORT=${PORT:-8095}
+TMP="$(mktemp -d)"
+SERVER_PID=
+
+if [ ! -x "$BIN" ]; then
+  echo "Binary not found: $BIN"
+  exit 2
+fi
+
+stop_server() {
+  if [ -n "$SERVER_PID" ]; then
+    kill -CONT "$SERVER_PID" 2>/dev/null || true
+    kill "$SERVER_PID" 2>/dev/null || true
+    wait "$SERVER_PID" 2>/dev/null || true
+    SERVER_PID=
+  fi
+}
+
+cleanup() {
+  stop_server
+  rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+fail() {
+  echo "FAIL: $*"
+  echo "--- server log"
+  cat "$TMP/server.log" || true
+  exit 1
+}
+
+# the status page is rate limited too: it is read from another loopback
+# address, whose bucket the tests below leave alone
+start_server() {
+  stop_server
+  "$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -S /_status "$@" &
+  SERVER_PID=$!
+  for i in $(seq 1 50); do
+    curl -s -o /dev/null --interface 127.0.0.2 "http://127.0.0.1:$PORT/_status" && return 0
+    sleep 0.1
+  done
+  fail "server did not start"
+}
+
+status_field() {
+  curl -sS --interface 127.0.0.2 "http://127.0.0.1:$PORT/_status" | awk -v k="$1" '$1 == k { print $2 }'
+}
+
+code() {
+  curl -s -o /dev/null -w '%{http_code}' --max-time 5 "$@" "http://127.0.0.1:$PORT/" || true
+}
+
+# per-IP token bucket: a burst of 5, then 429 with Retry-After
+start_server -w 2 -r 5 -b 5 -a 3
+ok=0; limited=0
+for i in $(seq 1 20); do
+  case "$(code -D "$TMP/headers")" in
+    200) ok=$((ok + 1)) ;;
+    429) limited=$((limited + 1)); cp "$TMP/headers" "$TMP/headers.429" ;;
+  esac
+done
+[ "$ok" -ge 5 ] && [ "$ok" -le 8 ] || fail "rate limit let $ok of 20 requests through"
+[ "$limited" -ge 12 ] || fail "only $limited requests throttled"
+grep -qi "^Retry-After: 3" "$TMP/headers.429" || fail "429 without Retry-After"
+[ "$(curl -s -o /dev/null -w '%{http_code}' "http://127.0.0.1:$PORT/_status")" = 429 ] ||
+  fail "status page not throttled"
+[ "$(status_field throttled)" -ge 12 ] || fail "throttled counter"
+echo "rate limit ok ($ok allowed, $limited throttled)"
+
+# a throttled request whose body was left for the proxy: the body must not
+# be answered as the next request on the connection
+start_server -r 1 -b 1 -P /api=127.0.0.1:1
+SMUGGLED=$'GET /_status HTTP/1.1\r\nHost: x\r\n\r\n'
+exec 3<>/dev/tcp/127.0.0.1/$PORT
+printf 'GET / HTTP/1.1\r\nHost: x\r\n\r\nPOST /api/x HTTP/1.1\r\nHost: x\r\nContent-Length: %d\r\n\r\n%s' \
+  "${#SMUGGLED}" "$SMUGGLED" >&3
+OUT=$(timeout 5 cat <&3 || true)
+exec 3<&-
+grep -q "HTTP/1.1 429" <<< "$OUT" || fail "body request not throttled"
+grep -qi "^Connection: close" <<< "$OUT" || fail "429 kept a connection with an unread body open"
+grep -q "^accepted " <<< "$OUT" && fail "throttled request body was answered as a request"
+echo "throttled body ok"
+
+# global cap: with every slot taken new connections get the canned 503
+start_server -w 2 -M 5
+for i in 1 2 3 4 5; do exec {fd}<>/dev/tcp/127.0.0.1/$PORT; eval "idle$i=$fd"; done
+sleep 0.3
+[ "$(code)" = 503 ] || fail "no 503 at the global connection cap"
+curl -s -D - -o /dev/null "http://127.0.0.1:$PORT/" | grep -qi "^Retry-After: 1" || fail "503 without Retry-After"
+for i in 1 2 3 4 5; do eval "exec {idle$i}>&-"; done
+sleep 0.3
+[ "$(code)" = 200 ] || fail "not serving after connections closed"
+[ "$(status_field shed)" -ge 2 ] || fail "shed counter"
+echo "global cap ok"
+
+# per-worker cap: a full worker stops accepting; the client waits in the queue
+start_server -w 1 -m 3
+for i in 1 2 3; do exec {fd}<>/dev/tcp/127.0.0.1/$PORT; eval "idle$i=$fd"; done
+sleep 0.3
+# the idle sockets must not be inherited, or closing them below would not close them
+(exec {idle1}>&- {idle2}>&- {idle3}>&-; exec curl -s -o /dev/null --max-time 5 "http://127.0.0.1:$PORT/") &
+QUEUED=$!
+sleep 0.5
+kill -0 $QUEUED 2>/dev/null || fail "request served past the per-worker cap"
+exec {idle1}>&-
+wait $QUEUED || fail "queued request not served once a slot freed up"
+for i in 2 3; do eval "exec {idle$i}>&-"; done
+[ "$(status_field accept_pauses)" -ge 1 ] || fail "accept_pauses counter"
+echo "per-worker cap ok"
+
+# accept queue shedding: connections that piled up while the server was
+# stopped are answered 503 until the queue is short again
+start_server -w 1 -Q 4
+kill -STOP "$SERVER_PID"
+PIDS=()
+for i in $(seq 1 12); do
+  curl -s -o /dev/null -w '%{http_code}\n' --max-time 5 "http://127.0.0.1:$PORT/" >> "$TMP/codes" &
+  PIDS+=($!)
+done
+sleep 0.5
+kill -CONT "$SERVER_PID"
+for p in "${PIDS[@]}"; do wait "$p" || true; done
+n503=$(grep -c '^503$' "$TMP/codes" || true)
+n200=$(grep -c '^200$' "$TMP/codes" || true)
+[ "$n503" -ge 1 ] || fail "no connections shed ($(tr '\n' ' ' < "$TMP/codes"))"
+[ "$n200" -ge 1 ] || fail "everything shed ($(tr '\n' ' ' < "$TMP/codes"))"
+[ $((n503 + n200)) -eq 12 ] || fail "unexpected responses: $(tr '\n' ' ' < "$TMP/codes")"
+grep -q "overload: worker 0 shedding" "$TMP/server.log" || fail "shedding not logged"
+echo "queue shedding ok ($n503 shed, $n200 served)"
+
+echo "Admission integration tests passed"
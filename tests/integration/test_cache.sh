@@ -0,0 +1,179 @@
+#!/usr/bin/env bash
+# Micro-cache for generated responses, with the generator slowed down to
+# 200ms (-x): concurrent misses for one key run it once and are all answered
+# from the shared result, hits are immediate, entries expire after their TTL,
+# stale entries are served while refreshed in the background, responses with
+# Vary are kept per variant, and static files, other methods and other keys
+# stay out of it. Both with the fills on the I/O threads and inline (-j 0).
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+PORT=${PORT:-8083}
+DELAY_US=200000
+TMP="$(mktemp -d)"
+URL="http://127.0.0.1:$PORT"
+PID=
+
+if [ ! -x "$BIN" ]; then
+  echo "Binary not found: $BIN"
+  exit 2
+fi
+
+stop_server() {
+  if [ -n "$PID" ]; then
+    kill "$PID" 2>/dev/null || true
+    wait "$PID" 2>/dev/null || true
+    PID=
+  fi
+}
+trap 'stop_server; rm -rf "$TMP"' EXIT
+
+fail() {
+  echo "FAIL: $*"
+  echo "--- status"
+  curl -s "$URL/_status" | grep '^cache_' || true
+  echo "--- server log"
+  tail -n 30 "$TMP/server.log" || true
+  exit 1
+}
+
+start() {
+  "$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -S /_status -x $DELAY_US "$@" &
+  PID=$!
+  for i in $(seq 1 50); do
+    curl -s -o /dev/null "$URL/_status" && return 0
+    sleep 0.1
+  done
+  fail "server did not start"
+}
+
+status_field() {
+  curl -sS "$URL/_status" | awk -v k="$1" '$1 == k { print $2 }'
+}
+
+expect_field() {
+  local v
+  v=$(status_field "$1")
+  [ "$v" = "$2" ] || fail "$1 is $v, expected $2"
+}
+
+# time_total of a GET whose body must be the generated response
+timed_get() {
+  local out t
+  out=$(curl -s -w ' %{time_total}' "$URL$1")
+  [ "${out% *}" = "Hello, world!" ] || fail "GET $1 answered '${out% *}'"
+  t=${out##* }
+  echo "$t"
+}
+
+fast() {
+  awk -v t="$1" 'BEGIN { exit !(t < 0.1) }'
+}
+
+# twenty concurrent misses for one key run the generator once. With fills on
+# the I/O threads the other nineteen all wait for it; inline, the worker
+# running it is blocked, and requests queued there are hits afterwards.
+coalescing() {
+  local pids=()
+  for i in $(seq 1 20); do
+    curl -s -o "$TMP/body.$i" "$URL/gen?id=1" &
+    pids+=($!)
+  done
+  wait "${pids[@]}"
+  for i in $(seq 1 20); do
+    [ "$(cat "$TMP/body.$i")" = "Hello, world!" ] || fail "coalesced response $i"
+  done
+  expect_field cache_misses 1
+  local coalesced hits
+  coalesced=$(status_field cache_coalesced)
+  hits=$(status_field cache_hits)
+  if [ "$1" = pool ]; then
+    [ "$coalesced" = 19 ] || fail "$coalesced of 19 requests coalesced"
+  else
+    [ "$coalesced" -ge 1 ] && [ $(( coalesced + hits )) = 19 ] || fail "$coalesced coalesced, $hits hits"
+  fi
+  T=$(timed_get "/gen?id=1")
+  fast "$T" || fail "hit took ${T}s"
+  expect_field cache_hits $(( hits + 1 ))
+  # the query and the normalized path are part of the key
+  T=$(timed_get "/gen?id=2")
+  fast "$T" && fail "another query was a hit"
+  T=$(timed_get "/x/../gen?id=2")
+  fast "$T" || fail "equivalent path missed"
+  expect_field cache_misses 2
+}
+
+start -C 1000 -w 2 -j 4
+coalescing pool
+
+# pipelined requests behind a fill keep their order
+exec 3<>/dev/tcp/127.0.0.1/$PORT
+printf 'GET /pipe HTTP/1.1\r\nHost: x\r\n\r\nGET /index.html HTTP/1.1\r\nHost: x\r\n\r\nGET /pipe HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n' >&3
+OUT=$(timeout 5 cat <&3)
+exec 3<&-
+[ "$(grep -o 'HTTP/1.1 200' <<< "$OUT" | wc -l)" = 3 ] || fail "pipelined responses missing"
+[ "$(grep -o 'Hello, world!\|<html' <<< "$OUT" | tr '\n' ' ')" = "Hello, world! <html Hello, world! " ] ||
+  fail "pipelined responses out of order"
+
+# static files and other methods are not cached
+MISSES=$(status_field cache_misses)
+curl -s "$URL/index.html" | grep -q '<html' || fail "static file"
+curl -s "$URL/index.html" | grep -q '<html' || fail "static file again"
+[ "$(curl -s -X POST -d x "$URL/gen?id=1")" = "Hello, world!" ] || fail "POST response"
+[ "$(status_field cache_misses)" = "$MISSES" ] || fail "static file or POST went through the cache"
+
+# a client hanging up while its fill runs, and one while it waits for it
+curl -s -o /dev/null --max-time 0.05 "$URL/hangup" || true
+curl -s -o /dev/null --max-time 0.05 "$URL/hangup" || true
+sleep 0.3
+kill -0 "$PID" 2>/dev/null || fail "server died after clients hung up"
+T=$(timed_get /hangup)
+fast "$T" || fail "fill of a closed connection was not stored"
+
+# entries expire after the TTL
+sleep 1.1
+T=$(timed_get "/gen?id=1")
+fast "$T" && fail "expired entry was served"
+stop_server
+
+# stale-while-revalidate: expired entries are served at once while one
+# request refreshes them in the background
+start -C 1000 -s 5000 -j 4
+timed_get /swr > /dev/null
+sleep 1.3
+T=$(timed_get /swr)
+fast "$T" || fail "stale response took ${T}s"
+T=$(timed_get /swr)
+fast "$T" || fail "stale response during the refresh took ${T}s"
+expect_field cache_refreshes 1
+# stale until the refresh is in, then fresh for a second
+for i in $(seq 1 30); do
+  [ "$(status_field cache_hits)" = 1 ] && break
+  sleep 0.1
+  T=$(timed_get /swr)
+  fast "$T" || fail "response after the refresh started took ${T}s"
+done
+expect_field cache_hits 1
+expect_field cache_refreshes 1
+expect_field cache_misses 1
+stop_server
+
+# a response with Vary is cached once per value of the named header
+start -C 1000 -V Accept-Language
+vary_get() {
+  curl -s -w ' %{time_total}' -H "Accept-Language: $1" "$URL/vary" | awk '{ print $NF }'
+}
+T=$(vary_get en); fast "$T" && fail "first variant was a hit"
+T=$(vary_get de); fast "$T" && fail "another variant was a hit"
+T=$(vary_get en); fast "$T" || fail "cached variant took ${T}s"
+curl -s -D - -o /dev/null "$URL/vary" | grep -qi "^Vary: Accept-Language" || fail "generated response without Vary"
+expect_field cache_misses 3
+expect_field cache_hits 1
+stop_server
+
+# fills inline on the loops: coalescing works across workers
+start -C 1000 -w 2 -j 0
+coalescing inline
+stop_server
+echo "Cache integration tests passed"
@@ -0,0 +1,105 @@
+#!/usr/bin/env bash
+# Static-file I/O off the event loop: with every file system call on the
+# docroot slowed down (slowfs.so), the loop keeps answering other requests
+# while files are read, its lag stays in microseconds, responses stay
+# correct and in order, and a client hanging up while its file is being read
+# does no harm. With -j 0 the same setup stalls the loop, which shows the
+# slowdown is real.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+SLOWFS="$ROOT_DIR/tests/integration/slowfs.so"
+PORT=${PORT:-8086}
+DELAY_MS=100
+TMP="$(mktemp -d)"
+WWW="$TMP/www"
+URL="http://127.0.0.1:$PORT"
+PID=
+
+for b in "$BIN" "$SLOWFS"; do
+  if [ ! -e "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+mkdir "$WWW"
+cp "$ROOT_DIR/www/index.html" "$WWW/"
+echo "file a" > "$WWW/a.txt"
+echo "file b" > "$WWW/b.txt"
+
+stop_server() {
+  if [ -n "$PID" ]; then
+    kill "$PID" 2>/dev/null || true
+    wait "$PID" 2>/dev/null || true
+    PID=
+  fi
+}
+trap 'stop_server; rm -rf "$TMP"' EXIT
+
+fail() {
+  echo "FAIL: $*"
+  echo "--- server log"
+  tail -n 30 "$TMP/server.log" || true
+  exit 1
+}
+
+start() {
+  LD_PRELOAD="$SLOWFS" SLOWFS_PREFIX="$WWW" SLOWFS_DELAY_MS=$DELAY_MS \
+    "$BIN" -p "$PORT" -d "$WWW" -l "$TMP/server.log" -w 1 -S /_status "$@" &
+  PID=$!
+  for i in $(seq 1 50); do
+    curl -s -o /dev/null "$URL/_status" && return 0
+    sleep 0.1
+  done
+  fail "server did not start"
+}
+
+status_field() {
+  curl -sS "$URL/_status" | awk -v k="$1" '$1 == k { print $2 }'
+}
+
+start -j 4
+[ "$(status_field loop_lag_max_us)" -lt 5000 ] || fail "lag before any file was read"
+
+# eight slow reads in flight; the status page (no file I/O) is still fast
+for i in $(seq 1 8); do
+  curl -s -o "$TMP/index.$i" "$URL/index.html" &
+done
+sleep 0.2
+T=$(curl -s -o /dev/null -w '%{time_total}' "$URL/_status")
+awk -v t="$T" 'BEGIN { exit !(t < 0.05) }' || fail "status page took ${T}s while files were read"
+wait $(jobs -p | grep -v "^$PID$") 2>/dev/null || true
+for i in $(seq 1 8); do
+  cmp -s "$WWW/index.html" "$TMP/index.$i" || fail "response $i differs"
+done
+
+# unknown paths get the fallback; pipelined requests keep their order
+[ "$(curl -s "$URL/missing")" = "Hello, world!" ] || fail "fallback response"
+exec 3<>/dev/tcp/127.0.0.1/$PORT
+printf 'GET /a.txt HTTP/1.1\r\nHost: x\r\n\r\nGET /b.txt HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n' >&3
+OUT=$(timeout 5 cat <&3)
+exec 3<&-
+grep -q "file a" <<< "$OUT" && grep -q "file b" <<< "$OUT" || fail "pipelined responses missing"
+[ "$(grep -o 'file [ab]' <<< "$OUT" | tr '\n' ' ')" = "file a file b " ] || fail "pipelined responses out of order"
+
+# a client that gives up while its file is read
+curl -s -o /dev/null --max-time 0.1 "$URL/index.html" || true
+sleep 0.5
+kill -0 "$PID" 2>/dev/null || fail "server died after a client hung up"
+cmp -s "$WWW/index.html" <(curl -s "$URL/index.html") || fail "request after a hangup"
+
+[ "$(status_field io_jobs)" -ge 12 ] || fail "io_jobs counter"
+LAG=$(status_field loop_lag_max_us)
+[ "$LAG" -lt 5000 ] || fail "loop lag ${LAG}us with a ${DELAY_MS}ms file system"
+echo "loop lag max ${LAG}us with I/O threads"
+stop_server
+
+# the same file system on the loop itself
+start -j 0
+curl -s -o /dev/null "$URL/index.html"
+LAG=$(status_field loop_lag_max_us)
+[ "$LAG" -ge $(( DELAY_MS * 1000 )) ] || fail "slowfs not in effect (lag ${LAG}us)"
+echo "loop lag max ${LAG}us inline"
+echo "I/O pool integration tests passed"
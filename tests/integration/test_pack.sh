@@ -0,0 +1,65 @@
+#!/usr/bin/env bash
+# Packed docroot: build an archive with bin/docpack, verify it, serve from it
+# (including ETag revalidation) and check that verify catches a changed tree.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+DOCPACK="$ROOT_DIR/bin/docpack"
+PORT=${PORT:-8094}
+TMP="$(mktemp -d)"
+
+for b in "$BIN" "$DOCPACK"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+PID=
+trap '[ -n "$PID" ] && kill $PID 2>/dev/null; rm -rf "$TMP"' EXIT
+
+fail() {
+  echo "FAIL: $*"
+  cat "$TMP/server.log" 2>/dev/null || true
+  exit 1
+}
+
+mkdir -p "$TMP/www/css"
+echo "<h1>packed</h1>" > "$TMP/www/index.html"
+echo "body{}" > "$TMP/www/css/site.css"
+head -c 100000 /dev/urandom > "$TMP/www/blob.bin"
+
+"$DOCPACK" build "$TMP/www" "$TMP/www.pack" > /dev/null || fail "build"
+"$DOCPACK" verify "$TMP/www.pack" "$TMP/www" > /dev/null || fail "verify of a fresh archive"
+
+# the server never looks at the tree: serve from an empty docroot
+mkdir "$TMP/empty"
+"$BIN" -p "$PORT" -d "$TMP/empty" -D "$TMP/www.pack" -l "$TMP/server.log" &
+PID=$!
+for i in $(seq 1 50); do
+  curl -s -o /dev/null "http://127.0.0.1:$PORT/" && break
+  sleep 0.1
+done
+
+[ "$(curl -sS "http://127.0.0.1:$PORT/")" = "<h1>packed</h1>" ] || fail "index"
+curl -sS -D "$TMP/h" -o "$TMP/css" "http://127.0.0.1:$PORT/css/../css/site.css"
+cmp -s "$TMP/css" "$TMP/www/css/site.css" || fail "normalized path"
+grep -qi "^Content-Type: text/css" "$TMP/h" || fail "content type"
+curl -sS -o "$TMP/blob" "http://127.0.0.1:$PORT/blob.bin"
+cmp -s "$TMP/blob" "$TMP/www/blob.bin" || fail "large body"
+
+ETAG=$(grep -i "^ETag:" "$TMP/h" | cut -d' ' -f2 | tr -d '\r')
+[ -n "$ETAG" ] || fail "no ETag"
+CODE=$(curl -s -o /dev/null -w '%{http_code}' -H "If-None-Match: $ETAG" "http://127.0.0.1:$PORT/css/site.css")
+[ "$CODE" = 304 ] || fail "If-None-Match gave $CODE"
+CODE=$(curl -s -o /dev/null -w '%{http_code}' -H 'If-None-Match: "stale"' "http://127.0.0.1:$PORT/css/site.css")
+[ "$CODE" = 200 ] || fail "stale ETag gave $CODE"
+# not in the archive: the usual fallback
+[ "$(curl -sS "http://127.0.0.1:$PORT/missing.html")" = "Hello, world!" ] || fail "fallback"
+
+echo changed > "$TMP/www/css/site.css"
+if "$DOCPACK" verify "$TMP/www.pack" "$TMP/www" 2> "$TMP/verify.err"; then fail "verify missed a change"; fi
+grep -q "differs: /css/site.css" "$TMP/verify.err" || fail "verify output: $(cat "$TMP/verify.err")"
+
+echo "Pack integration tests passed"
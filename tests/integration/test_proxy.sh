@@ -0,0 +1,113 @@
+#!/usr/bin/env bash
+# Reverse-proxy integration test: runs the server in front of
+# tests/integration/upstream_stub and checks pool reuse, body streaming in
+# both directions, response framings, backpressure and upstream failure.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+STUB="$ROOT_DIR/tests/integration/upstream_stub"
+SLOW_READER="$ROOT_DIR/tests/integration/slow_reader"
+PORT=${PORT:-8091}
+UP_PORT=${UP_PORT:-9101}
+DEAD_PORT=${DEAD_PORT:-9199}
+TMP="$(mktemp -d)"
+
+for b in "$BIN" "$STUB" "$SLOW_READER"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+cleanup() {
+  kill $SRV_PID $STUB_PID 2>/dev/null || true
+  wait 2>/dev/null || true
+  rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+wait_port() {
+  for i in $(seq 1 50); do
+    if curl -s -o /dev/null "http://127.0.0.1:$1/" 2>/dev/null; then return 0; fi
+    sleep 0.1
+  done
+  echo "nothing listening on $1"
+  exit 1
+}
+
+fail() {
+  echo "FAIL: $*"
+  echo "--- server log"
+  cat "$TMP/server.log" || true
+  exit 1
+}
+
+"$STUB" "$UP_PORT" &
+STUB_PID=$!
+"$BIN" -p "$PORT" -l "$TMP/server.log" -d "$ROOT_DIR/www" \
+  -P "/api=127.0.0.1:$UP_PORT" -P "/down=127.0.0.1:$DEAD_PORT" &
+SRV_PID=$!
+wait_port "$UP_PORT"
+wait_port "$PORT"
+P="http://127.0.0.1:$PORT"
+
+# static files are still served locally
+[ "$(curl -sS -o /dev/null -w '%{http_code}' "$P/")" = "200" ] || fail "static GET /"
+
+# pool reuse: separate client connections share one upstream connection
+ids=""
+for i in 1 2 3 4 5; do
+  ids="$ids $(curl -sS -D - -o /dev/null "$P/api/hello" | tr -d '\r' | awk -F': ' '/^X-Upstream-Conn/ {print $2}')"
+done
+[ "$(echo $ids | tr ' ' '\n' | sort -u | wc -l)" = "1" ] || fail "expected one upstream connection, got:$ids"
+body=$(curl -sS "$P/api/hello")
+case "$body" in conn=*" req=6") ;; *) fail "unexpected body: $body" ;; esac
+echo "pool reuse ok ($body)"
+
+# request body streamed upstream and echoed back
+head -c 3000000 /dev/urandom > "$TMP/up.bin"
+curl -sS --data-binary @"$TMP/up.bin" -H 'Content-Type: application/octet-stream' "$P/api/echo" -o "$TMP/echo.bin"
+cmp -s "$TMP/up.bin" "$TMP/echo.bin" || fail "echoed body differs"
+echo "request body ok"
+
+# large response body, compared with fetching it directly
+curl -sS "http://127.0.0.1:$UP_PORT/big?n=20000000" -o "$TMP/direct.bin"
+curl -sS "$P/api/big?n=20000000" -o "$TMP/proxied.bin"
+cmp -s "$TMP/direct.bin" "$TMP/proxied.bin" || fail "proxied body differs"
+echo "response body ok"
+
+# chunked and close-delimited responses
+[ "$(curl -sS "$P/api/chunked")" = "hello world" ] || fail "chunked body"
+[ "$(curl -sS "$P/api/eof")" = "until-eof" ] || fail "close-delimited body"
+echo "framing ok"
+
+# backpressure: a slow reader must not stall other clients
+"$SLOW_READER" "$PORT" "/api/big?n=4000000" 1000000 > "$TMP/slow.out" &
+SLOW=$!
+sleep 0.5
+t0=$(date +%s%N)
+for i in 1 2 3 4 5; do
+  [ "$(curl -sS -o /dev/null -w '%{http_code}' "$P/api/fast")" = "200" ] || fail "request during slow transfer"
+done
+t1=$(date +%s%N)
+ms=$(( (t1 - t0) / 1000000 ))
+kill -0 $SLOW 2>/dev/null || fail "slow transfer finished too early to test backpressure"
+[ "$ms" -lt 1000 ] || fail "requests stalled behind slow reader (${ms}ms)"
+wait $SLOW
+[ "$(cat "$TMP/slow.out")" = "4000000" ] || fail "slow transfer truncated"
+echo "backpressure ok (5 requests in ${ms}ms during slow transfer)"
+
+# upstream failures
+[ "$(curl -sS -o /dev/null -w '%{http_code}' "$P/down/x")" = "502" ] || fail "expected 502 for dead upstream"
+kill $STUB_PID
+wait $STUB_PID 2>/dev/null || true
+[ "$(curl -sS -o /dev/null -w '%{http_code}' "$P/api/hello")" = "502" ] || fail "expected 502 after upstream exit"
+"$STUB" "$UP_PORT" &
+STUB_PID=$!
+wait_port "$UP_PORT"
+[ "$(curl -sS -o /dev/null -w '%{http_code}' "$P/api/hello")" = "200" ] || fail "no recovery after upstream restart"
+echo "upstream failure ok"
+
+kill -0 $SRV_PID || fail "server died"
+echo "Proxy integration tests passed"
@@ -0,0 +1,128 @@
+#!/usr/bin/env bash
+# Event streams: publish with POST and receive on a GET stream, channel
+# isolation, multi-line data, Last-Event-ID replay, request bodies on other
+# local paths, dropping a subscriber that does not read, and a drain that
+# ends the streams.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+SLOW="$ROOT_DIR/tests/integration/slow_reader"
+PORT=${PORT:-8090}
+TMP="$(mktemp -d)"
+URL="http://127.0.0.1:$PORT"
+
+for b in "$BIN" "$SLOW"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+"$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -i "$TMP/pid" -w 2 -E /events -R 8 -e 64 &
+PID=$!
+cleanup() {
+  [ -f "$TMP/pid" ] && kill "$(cat "$TMP/pid")" 2>/dev/null || true
+  kill $PID 2>/dev/null || true
+  jobs -p | xargs -r kill 2>/dev/null || true
+  wait 2>/dev/null || true
+  rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+fail() {
+  echo "FAIL: $*"
+  echo "--- server log"
+  tail -n 30 "$TMP/server.log" || true
+  exit 1
+}
+
+for i in $(seq 1 50); do
+  curl -s -o /dev/null "$URL/" && break
+  sleep 0.1
+done
+
+# wait until a stream's response head has arrived
+await_stream() {
+  for i in $(seq 1 50); do
+    grep -qi "content-type: text/event-stream" "$1" 2>/dev/null && return 0
+    sleep 0.1
+  done
+  fail "stream $1 did not start"
+}
+
+# several subscribers, so both workers are likely to have one
+for n in 1 2 3 4; do
+  curl -sN -D "$TMP/head$n" -m 10 "$URL/events/room" > "$TMP/room$n" &
+  await_stream "$TMP/head$n"
+done
+curl -sN -D "$TMP/head_other" -m 10 "$URL/events/other" > "$TMP/other" &
+await_stream "$TMP/head_other"
+
+ID1=$(curl -sS -d 'hello' "$URL/events/room")
+ID2=$(curl -sS --data-binary $'line one\nline two' "$URL/events/room?event=update")
+[ "$ID2" -gt "$ID1" ] || fail "ids not increasing: $ID1 $ID2"
+CODE=$(curl -s -o /dev/null -w '%{http_code}' -d x "$URL/events/room?event=bad%0Aname")
+[ "$CODE" = 400 ] || fail "bad event name gave $CODE"
+CODE=$(curl -s -o /dev/null -w '%{http_code}' -X PUT "$URL/events/room")
+[ "$CODE" = 405 ] || fail "PUT gave $CODE"
+
+for n in 1 2 3 4; do
+  for i in $(seq 1 50); do
+    grep -q "data: line two" "$TMP/room$n" && break
+    sleep 0.1
+  done
+  grep -q "^id: $ID1$" "$TMP/room$n" || fail "subscriber $n missed $ID1: $(cat "$TMP/room$n")"
+  grep -q "^data: hello$" "$TMP/room$n" || fail "subscriber $n: $(cat "$TMP/room$n")"
+  grep -q "^event: update$" "$TMP/room$n" || fail "subscriber $n missed the event type"
+  grep -q "^data: line one$" "$TMP/room$n" || fail "subscriber $n: multi-line data"
+done
+grep -q "data:" "$TMP/other" && fail "other channel received: $(cat "$TMP/other")"
+
+# reconnecting with Last-Event-ID replays only what was missed
+curl -sN -m 1 -H "Last-Event-ID: $ID1" "$URL/events/room" > "$TMP/replay" || true
+grep -q "^id: $ID2$" "$TMP/replay" || fail "no replay: $(cat "$TMP/replay")"
+grep -q "^id: $ID1$" "$TMP/replay" && fail "replayed an event the client had"
+curl -sN -m 1 "$URL/events/room" > "$TMP/fresh" || true
+grep -q "data:" "$TMP/fresh" && fail "replay without Last-Event-ID: $(cat "$TMP/fresh")"
+
+# a body on another local path is consumed, not parsed as the next request
+printf 'POST / HTTP/1.1\r\nHost: x\r\nContent-Length: 23\r\n\r\nGET /bogus HTTP/1.1\r\n\r\nGET / HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n' \
+  | timeout 5 bash -c "exec 3<>/dev/tcp/127.0.0.1/$PORT; cat >&3; cat <&3" > "$TMP/pipelined" || true
+[ "$(grep -o 'HTTP/1.1 200' "$TMP/pipelined" | wc -l)" = 2 ] || fail "body pipelining: $(cat "$TMP/pipelined")"
+grep -q "GET /bogus" "$TMP/server.log" && fail "request body parsed as a request"
+CODE=$(curl -s -o /dev/null -w '%{http_code}' --data-binary "@$ROOT_DIR/README.md" "$URL/events/room")
+[ "$CODE" = 413 ] || fail "oversized event gave $CODE"
+
+# a subscriber that stops reading is dropped once 64 KiB behind (after the
+# kernel's socket buffers, which grow to a few MB, are full)
+"$SLOW" "$PORT" /events/slow 1 > "$TMP/slow" &
+SLOWPID=$!
+sleep 0.5
+head -c 8000 /dev/zero | tr '\0' 'x' > "$TMP/big"
+ARGS=()
+for i in $(seq 1 1000); do ARGS+=("$URL/events/slow"); done
+curl -s --data-binary "@$TMP/big" "${ARGS[@]}" > /dev/null
+for i in $(seq 1 50); do
+  grep -q "events fd=.* dropped" "$TMP/server.log" && break
+  sleep 0.1
+done
+grep -q "events fd=.* dropped" "$TMP/server.log" || fail "slow subscriber not dropped"
+kill $SLOWPID 2>/dev/null || true
+[ "$(curl -sS -d 'still here' "$URL/events/room")" -gt "$ID2" ] || fail "publishing after a drop"
+
+# an upgrade ends the streams so clients reconnect to the successor
+curl -sN -m 10 "$URL/events/room" > "$TMP/drained" &
+DRAINED=$!
+sleep 0.3
+kill -USR2 $PID
+wait $DRAINED || fail "stream not ended by the drain"
+for i in $(seq 1 50); do
+  kill -0 $PID 2>/dev/null || break
+  sleep 0.1
+done
+kill -0 $PID 2>/dev/null && fail "old process still running after its streams ended"
+ID3=$(curl -sS -d 'after' "$URL/events/room")
+[ "$ID3" -gt "$ID2" ] || fail "ids went backwards across the upgrade: $ID2 then $ID3"
+
+echo "Event stream integration tests passed"
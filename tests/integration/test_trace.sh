@@ -0,0 +1,48 @@
+#!/usr/bin/env bash
+# Flight recorder: recorded requests carry their phase timestamps, are served
+# from the trace endpoint and dumped to the log on SIGUSR1.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+PORT=${PORT:-8096}
+TMP="$(mktemp -d)"
+
+if [ ! -x "$BIN" ]; then
+  echo "Binary not found: $BIN"
+  exit 2
+fi
+
+"$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -w 2 -T 8 -t /_trace &
+PID=$!
+trap 'kill $PID 2>/dev/null || true; wait $PID 2>/dev/null || true; rm -rf "$TMP"' EXIT
+
+fail() {
+  echo "FAIL: $*"
+  echo "--- server log"
+  cat "$TMP/server.log" || true
+  exit 1
+}
+
+for i in $(seq 1 50); do
+  curl -s -o /dev/null "http://127.0.0.1:$PORT/" && break
+  sleep 0.1
+done
+
+for i in $(seq 1 12); do curl -s -o /dev/null "http://127.0.0.1:$PORT/index.html"; done
+curl -sS "http://127.0.0.1:$PORT/_trace" > "$TMP/trace"
+grep -Eq "^worker=[01] fd=[0-9]+ GET /index.html accept=\+0us first_byte=\+[0-9]+us header=.* parsed=.* resolved=.* io=.* queued=.* flushed=" "$TMP/trace" \
+  || fail "no complete static request in the trace: $(cat "$TMP/trace")"
+# the ring keeps the last 8 requests of each worker
+[ "$(grep -c "GET /index.html" "$TMP/trace")" -le 16 ] || fail "ring not bounded"
+
+kill -USR1 $PID
+for i in $(seq 1 20); do
+  grep -q "^trace: worker 0 flight recorder" "$TMP/server.log" && break
+  sleep 0.1
+done
+grep -q "^trace: worker 0 flight recorder" "$TMP/server.log" || fail "SIGUSR1 did not dump the recorder"
+grep -q "^worker=0 fd=.* GET /index.html" "$TMP/server.log" || fail "dump without requests"
+kill -0 $PID || fail "server exited on SIGUSR1"
+
+echo "Trace integration tests passed"
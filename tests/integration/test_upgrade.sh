@@ -0,0 +1,107 @@
+#!/usr/bin/env bash
+# Zero-downtime upgrade test: while loadgen keeps keep-alive connections
+# busy, reload the config (SIGHUP) and upgrade the binary (SIGUSR2). Every
+# request must succeed, each old process must exit after draining, and a
+# new process that fails to start must leave the old one serving.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+LOADGEN="$ROOT_DIR/tests/integration/loadgen"
+PORT=${PORT:-8093}
+TMP="$(mktemp -d)"
+
+for b in "$BIN" "$LOADGEN"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+cleanup() {
+  [ -f "$TMP/pid" ] && kill "$(cat "$TMP/pid")" 2>/dev/null || true
+  kill $FIRST_PID 2>/dev/null || true
+  rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+fail() {
+  echo "FAIL: $*"
+  echo "--- server log"
+  cat "$TMP/server.log" || true
+  exit 1
+}
+
+# wait until the pidfile names a process other than $1
+wait_new_pid() {
+  for i in $(seq 1 50); do
+    p=$(cat "$TMP/pid" 2>/dev/null || true)
+    if [ -n "$p" ] && [ "$p" != "$1" ]; then echo "$p"; return 0; fi
+    sleep 0.1
+  done
+  fail "no new process after upgrade"
+}
+
+wait_exit() {
+  for i in $(seq 1 100); do
+    kill -0 "$1" 2>/dev/null || return 0
+    sleep 0.1
+  done
+  fail "old process $1 did not exit after draining"
+}
+
+mkdir -p "$TMP/a" "$TMP/b"
+echo old > "$TMP/a/index.html"
+echo new > "$TMP/b/index.html"
+# the binary is run from a copy so it can be replaced like a real deploy
+cp "$BIN" "$TMP/c-http-server"
+cat > "$TMP/server.conf" <<EOF
+port $PORT
+docroot $TMP/a
+logfile $TMP/server.log
+pidfile $TMP/pid
+drain-timeout 5
+workers 2
+EOF
+
+"$TMP/c-http-server" -c "$TMP/server.conf" &
+FIRST_PID=$!
+for i in $(seq 1 50); do
+  curl -s -o /dev/null "http://127.0.0.1:$PORT/" && break
+  sleep 0.1
+done
+[ "$(curl -sS "http://127.0.0.1:$PORT/")" = "old" ] || fail "initial docroot"
+
+"$LOADGEN" -p "$PORT" -c 16 -d 4 > "$TMP/load.out" &
+LOAD=$!
+sleep 1
+
+# config reload: new docroot picked up by the re-exec'd process
+sed -i "s#docroot .*#docroot $TMP/b#" "$TMP/server.conf"
+kill -HUP $FIRST_PID
+SECOND_PID=$(wait_new_pid $FIRST_PID)
+sleep 1
+
+# binary upgrade of the new process
+cp "$BIN" "$TMP/c-http-server.new"
+mv "$TMP/c-http-server.new" "$TMP/c-http-server"
+kill -USR2 "$SECOND_PID"
+THIRD_PID=$(wait_new_pid "$SECOND_PID")
+
+wait $LOAD || fail "load run reported failures: $(cat "$TMP/load.out")"
+echo "load during upgrades: $(cat "$TMP/load.out")"
+wait_exit $FIRST_PID
+wait_exit "$SECOND_PID"
+[ "$(curl -sS "http://127.0.0.1:$PORT/")" = "new" ] || fail "reloaded docroot not served"
+grep -q "inherited listening socket" "$TMP/server.log" || fail "listening socket was not handed over"
+
+# a successor that cannot start leaves the old process in charge
+echo "bogus option" >> "$TMP/server.conf"
+kill -HUP "$THIRD_PID"
+sleep 1
+kill -0 "$THIRD_PID" || fail "old process exited after failed upgrade"
+[ "$(cat "$TMP/pid")" = "$THIRD_PID" ] || fail "pidfile replaced by failed process"
+grep -q "new process failed" "$TMP/server.log" || fail "failed upgrade not logged"
+[ "$(curl -sS "http://127.0.0.1:$PORT/")" = "new" ] || fail "not serving after failed upgrade"
+
+echo "Upgrade integration tests passed"
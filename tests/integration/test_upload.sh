@@ -0,0 +1,112 @@
+#!/usr/bin/env bash
+# Uploads: PUT and POST store the body (small, and large enough to be
+# spliced), replace atomically, keep the connection usable; traversal,
+# missing or oversized lengths and hidden names are refused; a client that
+# disconnects mid-body leaves no temporary file behind, and a throttled
+# upload closes the connection instead of reading its body as a request.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+PORT=${PORT:-8089}
+TMP="$(mktemp -d)"
+DIR="$TMP/store"
+URL="http://127.0.0.1:$PORT/upload"
+
+if [ ! -x "$BIN" ]; then
+  echo "Binary not found: $BIN"
+  exit 2
+fi
+
+"$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -w 2 -u /upload -U "$DIR" -z 8 &
+PID=$!
+trap 'kill $PID 2>/dev/null || true; wait $PID 2>/dev/null || true; rm -rf "$TMP"' EXIT
+
+fail() {
+  echo "FAIL: $*"
+  echo "--- server log"
+  tail -n 30 "$TMP/server.log" || true
+  exit 1
+}
+
+for i in $(seq 1 50); do
+  curl -s -o /dev/null "http://127.0.0.1:$PORT/" && break
+  sleep 0.1
+done
+[ -d "$DIR" ] || fail "storage directory not created"
+
+status() {
+  curl -s -o /dev/null -w '%{http_code}' "$@"
+}
+
+# small bodies arrive with the header block, larger ones are spliced
+echo "hello upload" > "$TMP/small"
+head -c 6000000 /dev/urandom > "$TMP/large"
+CODE=$(status -T "$TMP/small" "$URL/small.txt")
+[ "$CODE" = 201 ] || fail "small PUT gave $CODE"
+cmp -s "$TMP/small" "$DIR/small.txt" || fail "small upload differs"
+CODE=$(status -T "$TMP/large" "$URL/large.bin")
+[ "$CODE" = 201 ] || fail "large PUT gave $CODE"
+cmp -s "$TMP/large" "$DIR/large.bin" || fail "large upload differs"
+CODE=$(status --data-binary "@$TMP/small" "$URL/large.bin")
+[ "$CODE" = 204 ] || fail "replacing POST gave $CODE"
+cmp -s "$TMP/small" "$DIR/large.bin" || fail "replacement differs"
+CODE=$(status -X PUT --data-binary '' "$URL/empty")
+[ "$CODE" = 201 ] && [ ! -s "$DIR/empty" ] || fail "empty PUT gave $CODE"
+mkdir "$DIR/sub"
+CODE=$(status -T "$TMP/small" "$URL/sub/nested.txt?x=1")
+[ "$CODE" = 201 ] && [ -f "$DIR/sub/nested.txt" ] || fail "nested PUT gave $CODE"
+
+# the connection goes on with the next request after a spliced body
+ARGS=(-s -o /dev/null -o /dev/null -w '%{http_code} ' -T "$TMP/large" "$URL/again.bin" "http://127.0.0.1:$PORT/")
+[ "$(curl "${ARGS[@]}")" = "201 200 " ] || fail "keep-alive after an upload"
+cmp -s "$TMP/large" "$DIR/again.bin" || fail "keep-alive upload differs"
+
+CODE=$(status --path-as-is -T "$TMP/small" "$URL/../escape.txt")
+[ "$CODE" = 403 ] && [ ! -e "$TMP/escape.txt" ] || fail "traversal gave $CODE"
+CODE=$(status -T "$TMP/small" "$URL/missing/dir.txt")
+[ "$CODE" = 403 ] || fail "missing directory gave $CODE"
+CODE=$(status -T "$TMP/small" "$URL/.hidden")
+[ "$CODE" = 403 ] || fail "hidden name gave $CODE"
+CODE=$(status -T "$TMP/small" "$URL/sub")
+[ "$CODE" = 409 ] || fail "directory target gave $CODE"
+CODE=$(status -H 'Transfer-Encoding: chunked' -T "$TMP/small" "$URL/chunked.txt")
+[ "$CODE" = 411 ] || fail "chunked upload gave $CODE"
+head -c 9000000 /dev/zero > "$TMP/huge"
+CODE=$(status -T "$TMP/huge" "$URL/huge.bin")
+[ "$CODE" = 413 ] && [ ! -e "$DIR/huge.bin" ] || fail "oversized upload gave $CODE"
+CODE=$(status "$URL/small.txt")
+[ "$CODE" = 405 ] || fail "GET gave $CODE"
+
+# a client that goes away mid-body leaves nothing behind
+printf 'PUT /upload/partial.bin HTTP/1.1\r\nHost: x\r\nContent-Length: 5000000\r\n\r\n' > "$TMP/partial"
+head -c 100000 /dev/zero >> "$TMP/partial"
+timeout 5 bash -c "exec 3<>/dev/tcp/127.0.0.1/$PORT; cat '$TMP/partial' >&3; sleep 0.3" || true
+for i in $(seq 1 50); do
+  grep -q "aborted" "$TMP/server.log" && break
+  sleep 0.1
+done
+grep -q "aborted: .* of 5000000 bytes" "$TMP/server.log" || fail "no abort logged"
+[ ! -e "$DIR/partial.bin" ] || fail "partial upload stored"
+[ -z "$(find "$DIR" -name '.*')" ] || fail "temporary files left: $(find "$DIR" -name '.*')"
+
+# a throttled upload: its body must not be answered as the next request
+kill $PID; wait $PID 2>/dev/null || true
+"$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -w 2 -u /upload -U "$DIR" -r 1 -b 1 -S /status &
+PID=$!
+for i in $(seq 1 50); do
+  curl -s -o /dev/null --interface 127.0.0.2 "http://127.0.0.1:$PORT/status" && break
+  sleep 0.1
+done
+SMUGGLED=$'GET /status HTTP/1.1\r\nHost: x\r\n\r\n'
+exec 3<>/dev/tcp/127.0.0.1/$PORT
+printf 'GET / HTTP/1.1\r\nHost: x\r\n\r\nPUT /upload/a HTTP/1.1\r\nHost: x\r\nContent-Length: %d\r\n\r\n%s' \
+  "${#SMUGGLED}" "$SMUGGLED" >&3
+OUT=$(timeout 5 cat <&3 || true)
+exec 3<&-
+grep -q "HTTP/1.1 429" <<< "$OUT" || fail "upload not throttled"
+grep -qi "^Connection: close" <<< "$OUT" || fail "429 kept a connection with an unread body open"
+grep -q "^accepted " <<< "$OUT" && fail "throttled upload body was answered as a request"
+[ ! -e "$DIR/a" ] || fail "throttled upload stored"
+
+echo "Upload integration tests passed"
@@ -0,0 +1,73 @@
+#!/usr/bin/env bash
+# WebSocket channels: handshake, broadcast within a channel, fragmentation,
+# ping/pong, large frames, close codes; then a small fan-out across two
+# workers and a drain that asks subscribers to reconnect.
+set -euo pipefail
+
+ROOT_DIR="$(cd "$(dirname "$0")/../.." && pwd)"
+BIN="$ROOT_DIR/bin/c-http-server"
+CLIENT="$ROOT_DIR/tests/integration/ws_client"
+PORT=${PORT:-8092}
+TMP="$(mktemp -d)"
+
+for b in "$BIN" "$CLIENT"; do
+  if [ ! -x "$b" ]; then
+    echo "Binary not found: $b"
+    exit 2
+  fi
+done
+
+"$BIN" -p "$PORT" -d "$ROOT_DIR/www" -l "$TMP/server.log" -i "$TMP/pid" -w 2 -W /ws &
+PID=$!
+cleanup() {
+  [ -f "$TMP/pid" ] && kill "$(cat "$TMP/pid")" 2>/dev/null || true
+  kill $PID 2>/dev/null || true
+  wait $PID 2>/dev/null || true
+  rm -rf "$TMP"
+}
+trap cleanup EXIT
+
+fail() {
+  echo "FAIL: $*"
+  echo "--- server log"
+  tail -n 30 "$TMP/server.log" || true
+  exit 1
+}
+
+for i in $(seq 1 50); do
+  curl -s -o /dev/null "http://127.0.0.1:$PORT/" && break
+  sleep 0.1
+done
+
+"$CLIENT" -p "$PORT" check || fail "protocol checks"
+
+# a plain GET on a channel asks for the upgrade
+CODE=$(curl -s -o /dev/null -w '%{http_code}' "http://127.0.0.1:$PORT/ws/room")
+[ "$CODE" = 426 ] || fail "plain GET gave $CODE"
+CODE=$(curl -s -o /dev/null -w '%{http_code}' -H 'Upgrade: websocket' -H 'Connection: Upgrade' \
+  -H 'Sec-WebSocket-Version: 8' -H 'Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==' "http://127.0.0.1:$PORT/ws/room")
+[ "$CODE" = 426 ] || fail "old protocol version gave $CODE"
+# other paths are unaffected
+[ "$(curl -sS "http://127.0.0.1:$PORT/")" != "" ] || fail "static page"
+
+"$CLIENT" -p "$PORT" -c 200 -n 200 bench > "$TMP/bench" || fail "fan-out: $(cat "$TMP/bench")"
+grep -q "subscribers=200 messages=200" "$TMP/bench" || fail "bench output: $(cat "$TMP/bench")"
+
+# an upgrade hands the listener over and sends subscribers away with 1001
+"$CLIENT" -p "$PORT" -u /ws/room await > "$TMP/await" &
+AWAIT=$!
+for i in $(seq 1 50); do
+  grep -q subscribed "$TMP/await" && break
+  sleep 0.1
+done
+kill -USR2 $PID
+wait $AWAIT || fail "subscriber: $(cat "$TMP/await")"
+grep -q "close 1001" "$TMP/await" || fail "no 1001 on drain: $(cat "$TMP/await")"
+for i in $(seq 1 50); do
+  kill -0 $PID 2>/dev/null || break
+  sleep 0.1
+done
+kill -0 $PID 2>/dev/null && fail "old process still running after its subscriber left"
+"$CLIENT" -p "$PORT" -c 2 -n 2 bench > /dev/null || fail "new process does not serve channels"
+
+echo "WebSocket integration tests passed"
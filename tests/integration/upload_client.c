@@ -0,0 +1,108 @@
+// Upload client for the upload benchmark: PUTs count bodies of size MB, one
+// after the other on a keep-alive connection, and reports the throughput.
+//   upload_client [-p port] [-u path] [-s MB] [-n count]
+// prints one summary line:
+//   uploads=N size_mb=S seconds=T gb_per_s=G
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what) {
+    fprintf(stderr, "upload_client: FAIL: %s\n", what);
+    exit(1);
+}
+
+static void send_all(int fd, const char *p, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, p, len, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            die("send");
+        }
+        p += n;
+        len -= (size_t)n;
+    }
+}
+
+/* Read one response head (uploads are answered without a body) and return
+ * its status code. */
+static int read_status(int fd) {
+    char head[1024];
+    size_t len = 0;
+    while (len < sizeof(head) - 1) {
+        ssize_t n = recv(fd, head + len, 1, 0);
+        if (n <= 0) die("connection closed before the response");
+        len++;
+        if (len >= 4 && memcmp(head + len - 4, "\r\n\r\n", 4) == 0) break;
+    }
+    head[len] = '\0';
+    int code = 0;
+    if (sscanf(head, "HTTP/1.1 %d", &code) != 1) die("bad response");
+    return code;
+}
+
+int main(int argc, char **argv) {
+    int port = 8080, count = 4;
+    long mb = 256;
+    const char *path = "/upload/bench.bin";
+    int opt;
+    while ((opt = getopt(argc, argv, "p:u:s:n:")) != -1) {
+        switch (opt) {
+        case 'p': port = atoi(optarg); break;
+        case 'u': path = optarg; break;
+        case 's': mb = atol(optarg); break;
+        case 'n': count = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: upload_client [-p port] [-u path] [-s MB] [-n count]\n");
+            return 2;
+        }
+    }
+    if (mb < 1 || count < 1) die("size and count must be positive");
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) die("connect");
+
+    size_t chunk = 1 << 20;
+    char *buf = malloc(chunk);
+    if (!buf) die("out of memory");
+    for (size_t i = 0; i < chunk; ++i) buf[i] = (char)('a' + i % 26);
+    size_t size = (size_t)mb << 20;
+
+    double start = now_s();
+    for (int i = 0; i < count; ++i) {
+        char head[512];
+        int n = snprintf(head, sizeof(head), "PUT %s HTTP/1.1\r\nHost: localhost\r\nContent-Length: %zu\r\n\r\n",
+                         path, size);
+        send_all(fd, head, (size_t)n);
+        for (size_t sent = 0; sent < size; sent += chunk) send_all(fd, buf, chunk);
+        int code = read_status(fd);
+        if (code != 201 && code != 204) {
+            fprintf(stderr, "upload_client: FAIL: status %d\n", code);
+            return 1;
+        }
+    }
+    double secs = now_s() - start;
+    printf("uploads=%d size_mb=%ld seconds=%.3f gb_per_s=%.2f\n", count, mb, secs,
+           (double)size * count / secs / 1e9);
+    free(buf);
+    close(fd);
+    return 0;
+}
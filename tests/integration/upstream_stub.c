@@ -0,0 +1,147 @@
+// Stand-in upstream for the reverse-proxy integration test.
+// Forks one blocking handler per connection; every response carries
+// "X-Upstream-Conn: <n>" (the accept sequence number) so the test can tell
+// whether the proxy reused a pooled connection.
+//
+//   GET  /.../big?n=BYTES  -> BYTES of a repeating pattern
+//   GET  /.../chunked      -> chunked response
+//   GET  /.../eof          -> body delimited by closing the connection
+//   POST /.../echo         -> request body echoed back
+//   anything else          -> "conn=<n> req=<k>"
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w <= 0) return -1;
+        p += w;
+        n -= (size_t)w;
+    }
+    return 0;
+}
+
+static void serve(int fd, int conn_id) {
+    char buf[65536];
+    size_t len = 0;
+    int reqno = 0;
+    for (;;) {
+        char *end;
+        while (!(end = memmem(buf, len, "\r\n\r\n", 4))) {
+            if (len == sizeof(buf)) return;
+            ssize_t r = read(fd, buf + len, sizeof(buf) - len);
+            if (r <= 0) return;
+            len += (size_t)r;
+        }
+        size_t hlen = (size_t)(end - buf) + 4;
+        char method[16] = "", path[1024] = "";
+        sscanf(buf, "%15s %1023s", method, path);
+        size_t clen = 0;
+        const char *cl = strcasestr(buf, "\r\nContent-Length:");
+        if (cl && cl < end) clen = strtoul(cl + 17, NULL, 10);
+        reqno++;
+
+        /* read the body (only the echo handler keeps it) */
+        char *body = malloc(clen + 1);
+        size_t have = len - hlen < clen ? len - hlen : clen;
+        memcpy(body, buf + hlen, have);
+        size_t rest = len - hlen - have;
+        memmove(buf, buf + hlen + have, rest);
+        len = rest;
+        while (have < clen) {
+            ssize_t r = read(fd, body + have, clen - have);
+            if (r <= 0) {
+                free(body);
+                return;
+            }
+            have += (size_t)r;
+        }
+
+        char hdr[256];
+        if (strstr(path, "/big")) {
+            const char *q = strstr(path, "n=");
+            size_t n = q ? strtoul(q + 2, NULL, 10) : 1048576;
+            snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nX-Upstream-Conn: %d\r\nContent-Length: %zu\r\n\r\n", conn_id, n);
+            if (write_all(fd, hdr, strlen(hdr)) < 0) break;
+            char blk[16384];
+            for (size_t i = 0; i < sizeof(blk); ++i) blk[i] = (char)('a' + i % 26);
+            size_t sent = 0;
+            while (sent < n) {
+                /* keep the pattern aligned with the absolute offset */
+                size_t off = sent % 26;
+                size_t m = n - sent < sizeof(blk) - 26 ? n - sent : sizeof(blk) - 26;
+                if (write_all(fd, blk + off, m) < 0) break;
+                sent += m;
+            }
+            if (sent < n) break;
+        } else if (strstr(path, "/chunked")) {
+            snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nX-Upstream-Conn: %d\r\nTransfer-Encoding: chunked\r\n\r\n", conn_id);
+            const char *chunks = "5\r\nhello\r\n1;ext=1\r\n \r\n5\r\nworld\r\n0\r\nX-Trailer: t\r\n\r\n";
+            if (write_all(fd, hdr, strlen(hdr)) < 0 || write_all(fd, chunks, strlen(chunks)) < 0) break;
+        } else if (strstr(path, "/eof")) {
+            snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nX-Upstream-Conn: %d\r\nConnection: close\r\n\r\nuntil-eof", conn_id);
+            write_all(fd, hdr, strlen(hdr));
+            free(body);
+            return;
+        } else if (strcmp(method, "POST") == 0 && strstr(path, "/echo")) {
+            snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nX-Upstream-Conn: %d\r\nContent-Length: %zu\r\n\r\n", conn_id, clen);
+            if (write_all(fd, hdr, strlen(hdr)) < 0 || write_all(fd, body, clen) < 0) break;
+        } else {
+            char msg[64];
+            int mlen = snprintf(msg, sizeof(msg), "conn=%d req=%d\n", conn_id, reqno);
+            snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\nX-Upstream-Conn: %d\r\nContent-Length: %d\r\n\r\n", conn_id, mlen);
+            if (write_all(fd, hdr, strlen(hdr)) < 0 || write_all(fd, msg, (size_t)mlen) < 0) break;
+        }
+        free(body);
+        body = NULL;
+    }
+}
+
+/* take the forked handlers (and their keep-alive sockets) down too */
+static void handle_term(int sig) {
+    (void)sig;
+    kill(0, SIGKILL);
+}
+
+int main(int argc, char **argv) {
+    int port = argc > 1 ? atoi(argv[1]) : 9000;
+    setpgid(0, 0);
+    signal(SIGTERM, handle_term);
+    signal(SIGCHLD, SIG_IGN);
+    signal(SIGPIPE, SIG_IGN);
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    int opt = 1;
+    setsockopt(lfd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons((unsigned short)port);
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 128) < 0) {
+        perror("upstream_stub");
+        return 1;
+    }
+    int conn_id = 0;
+    for (;;) {
+        int fd = accept(lfd, NULL, NULL);
+        if (fd < 0) continue;
+        conn_id++;
+        pid_t pid = fork();
+        if (pid == 0) {
+            signal(SIGTERM, SIG_DFL);
+            close(lfd);
+            serve(fd, conn_id);
+            close(fd);
+            _exit(0);
+        }
+        close(fd);
+    }
+}
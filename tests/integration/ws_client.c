@@ -0,0 +1,411 @@
+// WebSocket client for the integration tests and the broadcast benchmark.
+//   ws_client [-p port] check
+//     protocol checks against a server started with -W /ws; exits non-zero
+//     with a message on the first failure
+//   ws_client [-p port] [-u path] await
+//     subscribes, prints "subscribed", then waits for the server to close
+//     and prints "close CODE"
+//   ws_client [-p port] [-c conns] [-n messages] [-s size] [-u path] bench
+//     opens conns subscribers on one channel, then the first of them sends
+//     messages frames of size bytes, keeping at most 64 broadcasts in flight;
+//     prints one summary line:
+//       subscribers=N messages=M size=S seconds=T broadcasts_per_s=B deliveries_per_s=D
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RFC_KEY "dGhlIHNhbXBsZSBub25jZQ=="
+#define RFC_ACCEPT "s3pPLMBiTxaQ9kYGzzhZRbK+xOo="
+
+static struct sockaddr_in addr;
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void die(const char *what) {
+    fprintf(stderr, "ws_client: FAIL: %s\n", what);
+    exit(1);
+}
+
+static int send_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len) {
+        ssize_t s = send(fd, p, len, MSG_NOSIGNAL);
+        if (s < 0 && (errno == EAGAIN || errno == EINTR)) {
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            poll(&pfd, 1, 1000);
+            continue;
+        }
+        if (s <= 0) return -1;
+        p += s;
+        len -= (size_t)s;
+    }
+    return 0;
+}
+
+static int recv_all(int fd, void *data, size_t len) {
+    char *p = data;
+    while (len) {
+        ssize_t r = recv(fd, p, len, 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return -1;
+        p += r;
+        len -= (size_t)r;
+    }
+    return 0;
+}
+
+static int format_upgrade(char *buf, size_t len, const char *path) {
+    return snprintf(buf, len,
+                    "GET %s HTTP/1.1\r\nHost: 127.0.0.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                    "Sec-WebSocket-Key: " RFC_KEY "\r\nSec-WebSocket-Version: 13\r\n\r\n",
+                    path);
+}
+
+/* Encode a masked client frame into out. Returns its length. */
+static size_t encode_frame(uint8_t *out, int fin, int opcode, const void *payload, size_t len) {
+    static const uint8_t key[4] = { 0x12, 0x34, 0x56, 0x78 };
+    size_t h = 0;
+    out[h++] = (uint8_t)((fin ? 0x80 : 0) | opcode);
+    if (len < 126) {
+        out[h++] = (uint8_t)(0x80 | len);
+    } else if (len <= 0xffff) {
+        out[h++] = 0x80 | 126;
+        out[h++] = (uint8_t)(len >> 8);
+        out[h++] = (uint8_t)len;
+    } else {
+        out[h++] = 0x80 | 127;
+        for (int i = 0; i < 8; ++i) out[h++] = (uint8_t)((uint64_t)len >> (56 - 8 * i));
+    }
+    memcpy(out + h, key, 4);
+    h += 4;
+    const uint8_t *p = payload;
+    for (size_t i = 0; i < len; ++i) out[h + i] = p[i] ^ key[i & 3];
+    return h + len;
+}
+
+/* ---- check ---- */
+
+static int connect_blocking(void) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) die("connect");
+    struct timeval tv = { 3, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static int ws_open(const char *path) {
+    int fd = connect_blocking();
+    char req[512];
+    int n = format_upgrade(req, sizeof(req), path);
+    if (send_all(fd, req, (size_t)n) != 0) die("send handshake");
+    char resp[1024];
+    size_t len = 0;
+    /* byte at a time: frames may follow the head */
+    while (len < 4 || memcmp(resp + len - 4, "\r\n\r\n", 4) != 0) {
+        if (len == sizeof(resp) - 1 || recv_all(fd, resp + len, 1) != 0) die("read handshake");
+        len++;
+    }
+    resp[len] = '\0';
+    if (strncmp(resp, "HTTP/1.1 101 ", 13) != 0) die("no 101");
+    if (!strstr(resp, "Sec-WebSocket-Accept: " RFC_ACCEPT "\r\n")) die("wrong Sec-WebSocket-Accept");
+    return fd;
+}
+
+static void send_frame(int fd, int fin, int opcode, const void *payload, size_t len) {
+    uint8_t *out = malloc(len + 14);
+    if (!out) die("malloc");
+    size_t n = encode_frame(out, fin, opcode, payload, len);
+    if (send_all(fd, out, n) != 0) die("send frame");
+    free(out);
+}
+
+/* Read one server frame; the payload is malloc'd. Returns the opcode. */
+static int read_frame(int fd, uint8_t **payload, size_t *len) {
+    uint8_t h[10];
+    if (recv_all(fd, h, 2) != 0) die("read frame header");
+    if (!(h[0] & 0x80) || (h[1] & 0x80)) die("server frame not final or masked");
+    uint64_t n = h[1] & 0x7f;
+    if (n == 126) {
+        if (recv_all(fd, h + 2, 2) != 0) die("read length");
+        n = (uint64_t)h[2] << 8 | h[3];
+    } else if (n == 127) {
+        if (recv_all(fd, h + 2, 8) != 0) die("read length");
+        n = 0;
+        for (int i = 0; i < 8; ++i) n = n << 8 | h[2 + i];
+    }
+    *payload = malloc(n + 1);
+    if (!*payload || recv_all(fd, *payload, n) != 0) die("read payload");
+    (*payload)[n] = 0;
+    *len = n;
+    return h[0] & 0x0f;
+}
+
+static void expect(int fd, int opcode, const void *data, size_t len, const char *what) {
+    uint8_t *p;
+    size_t n;
+    int op = read_frame(fd, &p, &n);
+    if (op != opcode || n != len || memcmp(p, data, len) != 0) die(what);
+    free(p);
+}
+
+static void expect_close(int fd, int status, const char *what) {
+    uint8_t code[2] = { (uint8_t)(status >> 8), (uint8_t)status };
+    expect(fd, 0x8, code, 2, what);
+    char b;
+    if (recv(fd, &b, 1, 0) != 0) die("connection not closed after close frame");
+    close(fd);
+}
+
+static int check(void) {
+    int a = ws_open("/ws/room");
+    int b = ws_open("/ws/room");
+    int o = ws_open("/ws/other");
+
+    send_frame(a, 1, 0x1, "hello", 5);
+    expect(a, 0x1, "hello", 5, "sender did not get its broadcast");
+    expect(b, 0x1, "hello", 5, "subscriber did not get the broadcast");
+
+    /* fragmented, with a ping in the middle: the pong comes back first */
+    send_frame(a, 0, 0x1, "frag", 4);
+    send_frame(a, 1, 0x9, "p1", 2);
+    send_frame(a, 1, 0x0, "ment", 4);
+    expect(a, 0xA, "p1", 2, "no pong");
+    expect(a, 0x1, "fragment", 8, "fragmented message not reassembled");
+    expect(b, 0x1, "fragment", 8, "fragmented message not broadcast");
+
+    /* text is checked as a whole message, not frame by frame */
+    send_frame(a, 0, 0x1, "caf\xc3", 4);
+    send_frame(a, 1, 0x0, "\xa9", 1);
+    expect(a, 0x1, "caf\xc3\xa9", 5, "text split inside a character refused");
+    expect(b, 0x1, "caf\xc3\xa9", 5, "text split inside a character not broadcast");
+    /* invalid UTF-8 closes with 1007 and is not broadcast (checked below) */
+    int u = ws_open("/ws/room");
+    send_frame(u, 1, 0x1, "bad \xff", 5);
+    expect_close(u, 1007, "invalid UTF-8 not refused with 1007");
+
+    /* larger than the server's read buffer: unmasked in pieces */
+    size_t big = 100000;
+    uint8_t *data = malloc(big);
+    for (size_t i = 0; i < big; ++i) data[i] = (uint8_t)(i * 7 + (i >> 9));
+    send_frame(b, 1, 0x2, data, big);
+    expect(a, 0x2, data, big, "large binary message corrupted");
+    expect(b, 0x2, data, big, "large binary message corrupted for sender");
+    free(data);
+
+    /* channels are separate */
+    send_frame(o, 1, 0x1, "other", 5);
+    expect(o, 0x1, "other", 5, "other channel");
+    send_frame(a, 1, 0x1, "last", 4);
+    expect(a, 0x1, "last", 4, "message leaked across channels");
+    expect(b, 0x1, "last", 4, "last");
+
+    /* clients must mask */
+    uint8_t unmasked[] = { 0x81, 0x02, 'h', 'i' };
+    if (send_all(o, unmasked, sizeof(unmasked)) != 0) die("send");
+    expect_close(o, 1002, "unmasked frame not refused with 1002");
+
+    /* messages over the limit */
+    uint8_t huge[14] = { 0x82, 0x80 | 127, 0, 0, 0, 0, 0, 0x20, 0, 0, 1, 2, 3, 4 };
+    if (send_all(b, huge, sizeof(huge)) != 0) die("send");
+    expect_close(b, 1009, "oversized message not refused with 1009");
+
+    /* close handshake */
+    uint8_t code[2] = { 0x03, 0xe8 };
+    send_frame(a, 1, 0x8, code, 2);
+    expect_close(a, 1000, "close not echoed");
+    printf("ws check passed\n");
+    return 0;
+}
+
+static int await_close(const char *path) {
+    int fd = ws_open(path);
+    struct timeval tv = { 30, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    printf("subscribed\n");
+    fflush(stdout);
+    for (;;) {
+        uint8_t *p;
+        size_t n;
+        int op = read_frame(fd, &p, &n);
+        if (op == 0x8) {
+            printf("close %d\n", n >= 2 ? p[0] << 8 | p[1] : 0);
+            /* complete the handshake */
+            send_frame(fd, 1, 0x8, p, n);
+            free(p);
+            return 0;
+        }
+        free(p);
+    }
+}
+
+/* ---- bench ---- */
+
+typedef struct sub_s {
+    int fd;
+    int state; /* 0 connecting, 1 handshake sent, 2 open */
+    char head[256];
+    size_t head_len;
+    uint8_t hdr[10];
+    size_t hdr_have;
+    uint64_t left;  /* payload bytes of the current frame still to skip */
+    int in_payload;
+} sub_t;
+
+static unsigned long long delivered;
+
+/* Count complete frames in a chunk of server output. */
+static void consume(sub_t *s, const uint8_t *p, size_t len) {
+    while (len) {
+        if (s->in_payload) {
+            size_t take = s->left < len ? (size_t)s->left : len;
+            s->left -= take;
+            p += take;
+            len -= take;
+            if (!s->left) {
+                s->in_payload = 0;
+                delivered++;
+            }
+            continue;
+        }
+        s->hdr[s->hdr_have++] = *p++;
+        len--;
+        if (s->hdr_have < 2) continue;
+        size_t need = (s->hdr[1] & 0x7f) == 126 ? 4 : (s->hdr[1] & 0x7f) == 127 ? 10 : 2;
+        if (s->hdr_have < need) continue;
+        uint64_t n = s->hdr[1] & 0x7f;
+        if (need == 4) n = (uint64_t)s->hdr[2] << 8 | s->hdr[3];
+        if (need == 10) {
+            n = 0;
+            for (int i = 0; i < 8; ++i) n = n << 8 | s->hdr[2 + i];
+        }
+        s->hdr_have = 0;
+        s->left = n;
+        s->in_payload = 1;
+        if (!n) {
+            s->in_payload = 0;
+            delivered++;
+        }
+    }
+}
+
+static int bench(int conns, int messages, size_t size, const char *path) {
+    int epfd = epoll_create1(0);
+    sub_t *subs = calloc((size_t)conns, sizeof(sub_t));
+    if (epfd < 0 || !subs) die("setup");
+    char req[512];
+    int req_len = format_upgrade(req, sizeof(req), path);
+    static uint8_t buf[65536];
+    struct epoll_event events[256];
+    /* connect in waves so the listen backlog never overflows */
+    int started = 0, open = 0;
+    double deadline = now_s() + 60;
+    while (open < conns) {
+        while (started < conns && started - open < 128) {
+            sub_t *s = &subs[started];
+            s->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+            if (s->fd < 0) die("socket (raise ulimit -n)");
+            if (connect(s->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 && errno != EINPROGRESS) die("connect");
+            struct epoll_event ev = { .events = EPOLLOUT, .data.ptr = s };
+            epoll_ctl(epfd, EPOLL_CTL_ADD, s->fd, &ev);
+            started++;
+        }
+        int n = epoll_wait(epfd, events, 256, 1000);
+        if (now_s() > deadline) die("timed out opening connections");
+        for (int i = 0; i < n; ++i) {
+            sub_t *s = events[i].data.ptr;
+            if (s->state == 0) {
+                int err = 0;
+                socklen_t elen = sizeof(err);
+                getsockopt(s->fd, SOL_SOCKET, SO_ERROR, &err, &elen);
+                if (err || send(s->fd, req, (size_t)req_len, MSG_NOSIGNAL) != req_len) die("handshake send");
+                s->state = 1;
+                struct epoll_event ev = { .events = EPOLLIN, .data.ptr = s };
+                epoll_ctl(epfd, EPOLL_CTL_MOD, s->fd, &ev);
+                continue;
+            }
+            ssize_t r = recv(s->fd, s->head + s->head_len, sizeof(s->head) - 1 - s->head_len, 0);
+            if (r <= 0) die("handshake read");
+            s->head_len += (size_t)r;
+            s->head[s->head_len] = '\0';
+            if (!strstr(s->head, "\r\n\r\n")) continue;
+            if (strncmp(s->head, "HTTP/1.1 101 ", 13) != 0) die("no 101");
+            s->state = 2;
+            open++;
+        }
+    }
+    uint8_t *frame = malloc(size + 14);
+    uint8_t *payload = calloc(1, size ? size : 1);
+    if (!frame || !payload) die("malloc");
+    size_t frame_len = encode_frame(frame, 1, 0x2, payload, size);
+    int fd0 = subs[0].fd;
+    unsigned long long want = (unsigned long long)messages * (unsigned long long)conns;
+    int sent = 0;
+    const int window = 64;
+    double start = now_s();
+    deadline = start + 120;
+    while (delivered < want) {
+        while (sent < messages && delivered + (unsigned long long)window * conns >= (unsigned long long)sent * conns) {
+            if (send_all(fd0, frame, frame_len) != 0) die("publish");
+            sent++;
+        }
+        int n = epoll_wait(epfd, events, 256, 1000);
+        if (now_s() > deadline) die("timed out waiting for deliveries");
+        for (int i = 0; i < n; ++i) {
+            sub_t *s = events[i].data.ptr;
+            ssize_t r = recv(s->fd, buf, sizeof(buf), 0);
+            if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) die("subscriber dropped");
+            if (r > 0) consume(s, buf, (size_t)r);
+        }
+    }
+    double secs = now_s() - start;
+    printf("subscribers=%d messages=%d size=%zu seconds=%.3f broadcasts_per_s=%.0f deliveries_per_s=%.0f\n", conns,
+           messages, size, secs, messages / secs, (double)want / secs);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    int port = 8080, conns = 10000, messages = 1000;
+    size_t size = 64;
+    const char *path = "/ws/bench";
+    int opt;
+    while ((opt = getopt(argc, argv, "p:c:n:s:u:")) != -1) {
+        switch (opt) {
+        case 'p': port = atoi(optarg); break;
+        case 'c': conns = atoi(optarg); break;
+        case 'n': messages = atoi(optarg); break;
+        case 's': size = (size_t)atol(optarg); break;
+        case 'u': path = optarg; break;
+        default: goto usage;
+        }
+    }
+    if (optind != argc - 1 || conns < 1 || messages < 1) goto usage;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (strcmp(argv[optind], "check") == 0) return check();
+    if (strcmp(argv[optind], "bench") == 0) return bench(conns, messages, size, path);
+    if (strcmp(argv[optind], "await") == 0) return await_close(path);
+usage:
+    fprintf(stderr, "usage: ws_client [-p port] check\n"
+                    "       ws_client [-p port] [-u path] await\n"
+                    "       ws_client [-p port] [-c conns] [-n messages] [-s size] [-u path] bench\n");
+    return 2;
+}
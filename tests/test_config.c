@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#include "../src/config.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+void test_parse_route() {
+    proxy_route_t r;
+    assert(config_parse_route(&r, "/api=127.0.0.1:9000") == 0);
+    assert(strcmp(r.prefix, "/api") == 0);
+    assert(r.prefix_len == 4);
+    assert(strcmp(r.host, "127.0.0.1") == 0);
+    assert(r.port == 9000);
+    assert(config_parse_route(&r, "api=127.0.0.1:9000") == -1);
+    assert(config_parse_route(&r, "/api=127.0.0.1") == -1);
+    assert(config_parse_route(&r, "/api=127.0.0.1:0") == -1);
+    assert(config_parse_route(&r, "/api=:80") == -1);
+    printf("test_parse_route passed\n");
+}
+
+void test_parse_args() {
+    server_config_t cfg;
+    config_defaults(&cfg);
+    char *argv[] = { "srv", "-p", "9090", "-d", "public", "-P", "/api=localhost:9000", "-P", "/api/v2/=10.0.0.1:81", "-k", "4", NULL };
+    assert(config_parse_args(&cfg, 11, argv) == 0);
+    assert(cfg.port == 9090);
+    assert(strcmp(cfg.docroot, "public") == 0);
+    assert(cfg.route_count == 2);
+    assert(cfg.upstream_max_idle == 4);
+
+    server_config_t bad;
+    config_defaults(&bad);
+    char *argv2[] = { "srv", "-p", "99999", NULL };
+    assert(config_parse_args(&bad, 3, argv2) == -1);
+    printf("test_parse_args passed\n");
+}
+
+void test_match_route() {
+    server_config_t cfg;
+    config_defaults(&cfg);
+    assert(config_parse_route(&cfg.routes[0], "/api=127.0.0.1:9000") == 0);
+    assert(config_parse_route(&cfg.routes[1], "/api/v2/=127.0.0.1:9001") == 0);
+    cfg.route_count = 2;
+    assert(config_match_route(&cfg, "/api") == &cfg.routes[0]);
+    assert(config_match_route(&cfg, "/api/users") == &cfg.routes[0]);
+    assert(config_match_route(&cfg, "/api?x=1") == &cfg.routes[0]);
+    assert(config_match_route(&cfg, "/apix") == NULL);
+    assert(config_match_route(&cfg, "/api/v2/items") == &cfg.routes[1]);
+    assert(config_match_route(&cfg, "/index.html") == NULL);
+    assert(config_path_match("/ws", "/ws"));
+    assert(config_path_match("/ws", "/ws?room=1"));
+    assert(!config_path_match("/ws", "/wsx"));
+    assert(config_path_match("/ws/", "/ws/a"));
+    assert(!config_path_match("", "/"));
+    printf("test_match_route passed\n");
+}
+
+void test_parse_file() {
+    char path[] = "/tmp/test_config_XXXXXX";
+    int fd = mkstemp(path);
+    assert(fd >= 0);
+    const char *text = "# comment\nport 9091\n\ndocroot /srv/www  # trailing\nproxy /api=127.0.0.1:9000\ndrain-timeout 7\n";
+    assert(write(fd, text, strlen(text)) == (ssize_t)strlen(text));
+    close(fd);
+
+    server_config_t cfg;
+    config_defaults(&cfg);
+    /* flags after -c override the file */
+    char *argv[] = { "srv", "-c", path, "-p", "9092", NULL };
+    assert(config_parse_args(&cfg, 5, argv) == 0);
+    assert(cfg.port == 9092);
+    assert(strcmp(cfg.docroot, "/srv/www") == 0);
+    assert(cfg.route_count == 1);
+    assert(cfg.drain_timeout == 7);
+    assert(strcmp(cfg.config_file, path) == 0);
+
+    FILE *f = fopen(path, "w");
+    fputs("port 80\nbogus value\n", f);
+    fclose(f);
+    config_defaults(&cfg);
+    assert(config_parse_file(&cfg, path) == -1);
+    assert(config_parse_file(&cfg, "/nonexistent/file.conf") == -1);
+    unlink(path);
+    printf("test_parse_file passed\n");
+}
+
+void test_admission_options() {
+    server_config_t cfg;
+    config_defaults(&cfg);
+    assert(cfg.workers == 1);
+    assert(cfg.max_conns == 0 && cfg.rate_limit == 0);
+    char *argv[] = { "srv", "-w", "4", "-M", "1000", "-m", "300", "-r", "2.5", "-b", "10", "-Q", "64", "-L", "50", "-S", "/_status", NULL };
+    assert(config_parse_args(&cfg, 17, argv) == 0);
+    assert(cfg.workers == 4);
+    assert(cfg.max_conns == 1000);
+    assert(cfg.max_conns_per_worker == 300);
+    assert(cfg.rate_limit == 2.5);
+    assert(cfg.rate_burst == 10);
+    assert(cfg.shed_queue_depth == 64);
+    assert(cfg.shed_lag_ms == 50);
+    assert(strcmp(cfg.status_path, "/_status") == 0);
+
+    char *bad_workers[] = { "srv", "-w", "0", NULL };
+    assert(config_parse_args(&cfg, 3, bad_workers) == -1);
+    char *bad_rate[] = { "srv", "-r", "fast", NULL };
+    assert(config_parse_args(&cfg, 3, bad_rate) == -1);
+    char *bad_status[] = { "srv", "-S", "status", NULL };
+    assert(config_parse_args(&cfg, 3, bad_status) == -1);
+    printf("test_admission_options passed\n");
+}
+
+void test_parse_cpus() {
+    int cpus[8];
+    assert(config_parse_cpus(cpus, 8, "3") == 1 && cpus[0] == 3);
+    assert(config_parse_cpus(cpus, 8, "0,2,4-6") == 5);
+    assert(cpus[0] == 0 && cpus[1] == 2 && cpus[2] == 4 && cpus[4] == 6);
+    assert(config_parse_cpus(cpus, 8, "0-8") == -1);
+    assert(config_parse_cpus(cpus, 8, "4-2") == -1);
+    assert(config_parse_cpus(cpus, 8, "1,,2") == -1);
+    assert(config_parse_cpus(cpus, 8, "a") == -1);
+    assert(config_parse_cpus(cpus, 8, "") == -1);
+
+    server_config_t cfg;
+    config_defaults(&cfg);
+    char *argv[] = { "srv", "-A", "1-2", "-B", "50", NULL };
+    assert(config_parse_args(&cfg, 5, argv) == 0);
+    assert(cfg.cpu_count == 2 && cfg.cpus[1] == 2);
+    assert(cfg.busy_poll_us == 50);
+    printf("test_parse_cpus passed\n");
+}
+
+void test_upload_options() {
+    server_config_t cfg;
+    config_defaults(&cfg);
+    assert(!cfg.upload_path && strcmp(cfg.upload_dir, "uploads") == 0 && cfg.upload_max_mb == 1024);
+    char *argv[] = { "srv", "-u", "/upload", "-U", "/srv/artifacts", "-z", "64", NULL };
+    assert(config_parse_args(&cfg, 7, argv) == 0);
+    assert(strcmp(cfg.upload_path, "/upload") == 0);
+    assert(strcmp(cfg.upload_dir, "/srv/artifacts") == 0);
+    assert(cfg.upload_max_mb == 64);
+    char *bad_path[] = { "srv", "-u", "upload", NULL };
+    assert(config_parse_args(&cfg, 3, bad_path) == -1);
+    char *bad_max[] = { "srv", "-z", "0", NULL };
+    assert(config_parse_args(&cfg, 3, bad_max) == -1);
+    printf("test_upload_options passed\n");
+}
+
+void test_io_threads() {
+    server_config_t cfg;
+    config_defaults(&cfg);
+    assert(cfg.io_threads == 4);
+    char *argv[] = { "srv", "-j", "0", NULL };
+    assert(config_parse_args(&cfg, 3, argv) == 0 && cfg.io_threads == 0);
+    char *many[] = { "srv", "-j", "257", NULL };
+    assert(config_parse_args(&cfg, 3, many) == -1);
+    printf("test_io_threads passed\n");
+}
+
+void test_cache_options() {
+    server_config_t cfg;
+    config_defaults(&cfg);
+    assert(cfg.cache_ttl_ms == 0 && cfg.cache_stale_ms == 0 && cfg.cache_entries == 4096);
+    char *argv[] = { "srv", "-C", "500", "-s", "2000", "-N", "64", "-x", "1000", NULL };
+    assert(config_parse_args(&cfg, 9, argv) == 0);
+    assert(cfg.cache_ttl_ms == 500 && cfg.cache_stale_ms == 2000 && cfg.cache_entries == 64);
+    assert(cfg.fallback_delay_us == 1000 && !cfg.fallback_vary);
+    char *vary[] = { "srv", "-V", "Accept-Language", NULL };
+    assert(config_parse_args(&cfg, 3, vary) == 0 && strcmp(cfg.fallback_vary, "Accept-Language") == 0);
+    char *bad_vary[] = { "srv", "-V", "a\r\nX-Injected: 1", NULL };
+    assert(config_parse_args(&cfg, 3, bad_vary) == -1);
+    char *long_ttl[] = { "srv", "-C", "1001", NULL };
+    assert(config_parse_args(&cfg, 3, long_ttl) == -1);
+    char *no_entries[] = { "srv", "-N", "0", NULL };
+    assert(config_parse_args(&cfg, 3, no_entries) == -1);
+    printf("test_cache_options passed\n");
+}
+
+int main(void) {
+    test_parse_route();
+    test_parse_args();
+    test_match_route();
+    test_parse_file();
+    test_admission_options();
+    test_parse_cpus();
+    test_upload_options();
+    test_io_threads();
+    test_cache_options();
+    printf("ALL CONFIG TESTS PASSED\n");
+    return 0;
+}
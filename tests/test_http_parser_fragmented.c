@@ -13,6 +13,7 @@ void test_fragmented_request() {
     assert(r1 == 0); // need more data
     int r2 = http_parser_execute(&p, part2, strlen(part2), &consumed);
     assert(r2 == 1);
+    assert(consumed == strlen(part2));
     assert(strcmp(http_parser_method(&p), "GET") == 0);
     assert(strcmp(http_parser_path(&p), "/frag") == 0);
     http_parser_destroy(&p);
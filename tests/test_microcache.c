@@ -0,0 +1,241 @@
+#include "../src/microcache.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+/* request headers as "Name: value" strings, NULL-terminated */
+static const char *find_header(void *arg, const char *name) {
+    for (const char **h = arg; *h; ++h) {
+        size_t nl = strlen(name);
+        if (strncasecmp(*h, name, nl) == 0 && (*h)[nl] == ':') return *h + nl + 2;
+    }
+    return NULL;
+}
+
+static mc_request_t request(const char *method, const char *path, const char **headers) {
+    mc_request_t req = { method, path, find_header, (void *)headers };
+    return req;
+}
+
+static shared_buf_t *rendered(const char *body) {
+    char text[256];
+    snprintf(text, sizeof(text), "HTTP/1.1 200 OK\r\nContent-Length: %zu\r\n%s", strlen(body), body);
+    return shared_buf_new(text, strlen(text));
+}
+
+static const char *none[] = { NULL };
+
+/* Claim key at now and fill it with body; asserts it was a miss. */
+static void fill_key(microcache_t *mc, const mc_request_t *req, long long now, const char *vary, const char *body) {
+    shared_buf_t *resp = NULL;
+    size_t hl = 0;
+    mc_fill_t *fill = NULL;
+    assert(microcache_lookup(mc, req, now, MC_CLAIM, NULL, &resp, &hl, &fill) == MC_MISS && fill);
+    shared_buf_t *b = rendered(body);
+    microcache_fill(mc, fill, req, vary, b, b->len - strlen(body), now);
+    shared_buf_unref(b);
+}
+
+/* The body of a hit, or "" for anything else. */
+static const char *lookup_body(microcache_t *mc, const mc_request_t *req, long long now, int *rc) {
+    static char body[256];
+    shared_buf_t *resp = NULL;
+    size_t hl = 0;
+    mc_fill_t *fill = NULL;
+    *rc = microcache_lookup(mc, req, now, 0, NULL, &resp, &hl, &fill);
+    body[0] = '\0';
+    if (resp) {
+        snprintf(body, sizeof(body), "%.*s", (int)(resp->len - hl), resp->data + hl);
+        shared_buf_unref(resp);
+    }
+    if (fill) microcache_fill(mc, fill, NULL, NULL, NULL, 0, now);
+    return body;
+}
+
+void test_hit_and_expiry() {
+    microcache_t *mc = microcache_new(16, 100, 0);
+    mc_request_t req = request("GET", "/a", none);
+    int rc;
+    lookup_body(mc, &req, 1000, &rc);
+    assert(rc == MC_MISS); /* a lookup without MC_CLAIM changes nothing */
+    fill_key(mc, &req, 1000, NULL, "one");
+    assert(strcmp(lookup_body(mc, &req, 1050, &rc), "one") == 0 && rc == MC_HIT);
+    lookup_body(mc, &req, 1100, &rc);
+    assert(rc == MC_MISS);
+    fill_key(mc, &req, 1100, NULL, "two");
+    assert(strcmp(lookup_body(mc, &req, 1150, &rc), "two") == 0 && rc == MC_HIT);
+    mc_stats_t st;
+    microcache_stats(mc, &st);
+    assert(st.hits == 2 && st.misses == 2 && st.coalesced == 0);
+    microcache_free(mc);
+    printf("test_hit_and_expiry passed\n");
+}
+
+void test_key() {
+    microcache_t *mc = microcache_new(16, 1000, 0);
+    mc_request_t a = request("GET", "/x/../b", none);
+    fill_key(mc, &a, 0, NULL, "b");
+    int rc;
+    mc_request_t same = request("GET", "/%62", none);
+    assert(strcmp(lookup_body(mc, &same, 1, &rc), "b") == 0 && rc == MC_HIT);
+    mc_request_t query = request("GET", "/b?page=2", none);
+    lookup_body(mc, &query, 1, &rc);
+    assert(rc == MC_MISS);
+    mc_request_t post = request("POST", "/b", none);
+    lookup_body(mc, &post, 1, &rc);
+    assert(rc == MC_MISS);
+    mc_request_t out = request("GET", "/../etc/passwd", none);
+    lookup_body(mc, &out, 1, &rc);
+    assert(rc == MC_UNCACHEABLE);
+    /* "/" is "/index.html", as for files */
+    mc_request_t root = request("GET", "/", none);
+    fill_key(mc, &root, 0, NULL, "index");
+    mc_request_t index = request("GET", "/index.html", none);
+    assert(strcmp(lookup_body(mc, &index, 1, &rc), "index") == 0);
+    microcache_free(mc);
+    printf("test_key passed\n");
+}
+
+void test_vary() {
+    microcache_t *mc = microcache_new(16, 1000, 0);
+    const char *en[] = { "Accept-Language: en", "User-Agent: a", NULL };
+    const char *en2[] = { "User-Agent: b", "accept-language: en", NULL };
+    const char *de[] = { "Accept-Language: de", NULL };
+    mc_request_t req_en = request("GET", "/v", en);
+    mc_request_t req_en2 = request("GET", "/v", en2);
+    mc_request_t req_de = request("GET", "/v", de);
+    mc_request_t req_none = request("GET", "/v", none);
+    fill_key(mc, &req_en, 0, "Accept-Language", "hello");
+    int rc;
+    /* other headers do not matter */
+    assert(strcmp(lookup_body(mc, &req_en2, 1, &rc), "hello") == 0 && rc == MC_HIT);
+    lookup_body(mc, &req_de, 1, &rc);
+    assert(rc == MC_MISS);
+    fill_key(mc, &req_de, 1, " accept-language ,", "hallo");
+    assert(strcmp(lookup_body(mc, &req_de, 2, &rc), "hallo") == 0);
+    assert(strcmp(lookup_body(mc, &req_en, 2, &rc), "hello") == 0);
+    lookup_body(mc, &req_none, 2, &rc);
+    assert(rc == MC_MISS);
+    /* Vary: * is never stored */
+    mc_request_t star = request("GET", "/star", none);
+    fill_key(mc, &star, 0, "*", "x");
+    lookup_body(mc, &star, 1, &rc);
+    assert(rc == MC_MISS);
+    microcache_free(mc);
+    printf("test_vary passed\n");
+}
+
+typedef struct test_waiter_s {
+    mc_waiter_t waiter;
+    int woken;
+} test_waiter_t;
+
+static void wake(mc_waiter_t *waiter) {
+    ((test_waiter_t *)waiter)->woken++;
+}
+
+void test_coalescing() {
+    microcache_t *mc = microcache_new(16, 1000, 0);
+    mc_request_t req = request("GET", "/slow", none);
+    shared_buf_t *resp = NULL;
+    size_t hl = 0;
+    mc_fill_t *fill = NULL, *other = NULL;
+    assert(microcache_lookup(mc, &req, 0, MC_CLAIM, NULL, &resp, &hl, &fill) == MC_MISS && fill);
+    /* everyone else waits for the first fill, claiming or not */
+    test_waiter_t waiters[8];
+    for (int i = 0; i < 8; ++i) {
+        waiters[i].waiter.wake = wake;
+        waiters[i].woken = 0;
+        assert(microcache_lookup(mc, &req, 1, MC_CLAIM, NULL, &resp, &hl, &other) == MC_PENDING);
+        assert(microcache_lookup(mc, &req, 1, i & 1 ? MC_CLAIM : 0, &waiters[i].waiter, &resp, &hl, &other) ==
+               MC_PENDING);
+    }
+    assert(!other);
+    shared_buf_t *b = rendered("done");
+    microcache_fill(mc, fill, &req, NULL, b, b->len - 4, 2);
+    shared_buf_unref(b);
+    int rc;
+    for (int i = 0; i < 8; ++i) {
+        assert(waiters[i].woken == 1);
+        /* woken waiters look up again, and are not counted as hits */
+        resp = NULL;
+        assert(microcache_lookup(mc, &req, 3, MC_WOKEN, NULL, &resp, &hl, &other) == MC_HIT);
+        shared_buf_unref(resp);
+    }
+    assert(strcmp(lookup_body(mc, &req, 3, &rc), "done") == 0);
+    mc_stats_t st;
+    microcache_stats(mc, &st);
+    assert(st.misses == 1 && st.coalesced == 8 && st.hits == 1);
+
+    /* a failed fill stores nothing; its waiters retry */
+    mc_request_t req2 = request("GET", "/fails", none);
+    assert(microcache_lookup(mc, &req2, 0, MC_CLAIM, NULL, &resp, &hl, &fill) == MC_MISS);
+    waiters[0].woken = 0;
+    assert(microcache_lookup(mc, &req2, 0, 0, &waiters[0].waiter, &resp, &hl, &other) == MC_PENDING);
+    microcache_fill(mc, fill, &req2, NULL, NULL, 0, 1);
+    assert(waiters[0].woken == 1);
+    fill = NULL;
+    assert(microcache_lookup(mc, &req2, 2, MC_CLAIM, NULL, &resp, &hl, &fill) == MC_MISS && fill);
+    microcache_fill(mc, fill, NULL, NULL, NULL, 0, 2);
+    microcache_free(mc);
+    printf("test_coalescing passed\n");
+}
+
+void test_stale_while_revalidate() {
+    microcache_t *mc = microcache_new(16, 100, 500);
+    mc_request_t req = request("GET", "/s", none);
+    fill_key(mc, &req, 0, NULL, "old");
+    shared_buf_t *resp = NULL;
+    size_t hl = 0;
+    mc_fill_t *refresh = NULL, *other = NULL;
+    /* the first stale lookup refreshes, the others just get the stale copy */
+    assert(microcache_lookup(mc, &req, 150, 0, NULL, &resp, &hl, &refresh) == MC_STALE && refresh);
+    shared_buf_unref(resp);
+    assert(microcache_lookup(mc, &req, 160, MC_CLAIM, NULL, &resp, &hl, &other) == MC_STALE && !other);
+    shared_buf_unref(resp);
+    /* a failed refresh keeps serving the stale copy and may be retried */
+    microcache_fill(mc, refresh, NULL, NULL, NULL, 0, 170);
+    refresh = NULL;
+    assert(microcache_lookup(mc, &req, 180, 0, NULL, &resp, &hl, &refresh) == MC_STALE && refresh);
+    shared_buf_unref(resp);
+    shared_buf_t *b = rendered("new");
+    microcache_fill(mc, refresh, NULL, NULL, b, b->len - 3, 200);
+    shared_buf_unref(b);
+    int rc;
+    assert(strcmp(lookup_body(mc, &req, 250, &rc), "new") == 0 && rc == MC_HIT);
+    /* past the stale window it is a plain miss */
+    lookup_body(mc, &req, 800, &rc);
+    assert(rc == MC_MISS);
+    mc_stats_t st;
+    microcache_stats(mc, &st);
+    assert(st.stale == 3 && st.refreshes == 2);
+    microcache_free(mc);
+    printf("test_stale_while_revalidate passed\n");
+}
+
+void test_capacity() {
+    microcache_t *mc = microcache_new(2, 1000, 0);
+    mc_request_t a = request("GET", "/a", none), b = request("GET", "/b", none), c = request("GET", "/c", none);
+    fill_key(mc, &a, 0, NULL, "a");
+    fill_key(mc, &b, 1, NULL, "b");
+    fill_key(mc, &c, 2, NULL, "c");
+    int rc;
+    lookup_body(mc, &a, 3, &rc);
+    assert(rc == MC_MISS); /* oldest fill went first */
+    assert(strcmp(lookup_body(mc, &b, 3, &rc), "b") == 0);
+    assert(strcmp(lookup_body(mc, &c, 3, &rc), "c") == 0);
+    microcache_free(mc);
+    printf("test_capacity passed\n");
+}
+
+int main(void) {
+    test_hit_and_expiry();
+    test_key();
+    test_vary();
+    test_coalescing();
+    test_stale_while_revalidate();
+    test_capacity();
+    printf("ALL MICROCACHE TESTS PASSED\n");
+    return 0;
+}
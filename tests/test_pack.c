@@ -0,0 +1,86 @@
+#define _GNU_SOURCE
+#include "../src/pack.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static char root[64], archive[96];
+
+static void put(const char *rel, const char *text) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", root, rel);
+    FILE *f = fopen(path, "w");
+    assert(f);
+    fputs(text, f);
+    fclose(f);
+}
+
+static const pack_entry_t *get(const pack_t *p, const char *key) {
+    return pack_lookup(p, key, strlen(key));
+}
+
+void test_build_and_lookup() {
+    char sub[128];
+    snprintf(sub, sizeof(sub), "%s/css", root);
+    assert(mkdir(sub, 0755) == 0);
+    put("index.html", "<h1>hi</h1>\n");
+    put("css/site.css", "body{}\n");
+    put("empty.txt", "");
+    FILE *null = fopen("/dev/null", "w");
+    assert(pack_build(root, archive, null) == 3);
+
+    pack_t p;
+    assert(pack_open(&p, archive) == 0);
+    assert(p.hdr->nfiles == 3);
+    const pack_entry_t *e = get(&p, "/css/site.css");
+    assert(e && e->body_len == 7);
+    assert(memcmp(pack_ptr(&p, e->body_off), "body{}\n", 7) == 0);
+    assert(e->body_off % PACK_ALIGN == 0);
+    const char *head = pack_ptr(&p, e->head_off);
+    const char *want = "HTTP/1.1 200 OK\r\nContent-Type: text/css";
+    assert(strncmp(head, want, strlen(want)) == 0);
+    assert(memmem(head, e->head_len, "Content-Length: 7\r\n", 19));
+    assert(pack_ptr(&p, e->etag_off)[0] == '"' && e->etag_len == 18);
+    assert(get(&p, "/empty.txt")->body_len == 0);
+    assert(get(&p, "/index.html"));
+    assert(!get(&p, "/css"));
+    assert(!get(&p, "/missing.html"));
+    assert(pack_verify(&p, root, null) == 0);
+
+    /* a changed, an added and a removed file are all reported */
+    put("index.html", "<h1>changed</h1>\n");
+    put("new.txt", "x");
+    snprintf(sub, sizeof(sub), "%s/empty.txt", root);
+    unlink(sub);
+    assert(pack_verify(&p, root, null) == 3);
+    pack_close(&p);
+    fclose(null);
+    printf("test_build_and_lookup passed\n");
+}
+
+void test_rejects_garbage() {
+    pack_t p;
+    FILE *f = fopen(archive, "w");
+    fputs("this is not an archive, just some text that is long enough for a header", f);
+    fclose(f);
+    assert(pack_open(&p, archive) == -1 && errno == EINVAL);
+    assert(pack_open(&p, "/nonexistent.pack") == -1 && errno == ENOENT);
+    printf("test_rejects_garbage passed\n");
+}
+
+int main(void) {
+    strcpy(root, "/tmp/test_pack_XXXXXX");
+    assert(mkdtemp(root));
+    snprintf(archive, sizeof(archive), "%s.pack", root);
+    test_build_and_lookup();
+    test_rejects_garbage();
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s %s", root, archive);
+    assert(system(cmd) == 0);
+    printf("ALL PACK TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,100 @@
+#include "../src/proxy.h"
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+static int rewrite(const char *head, int head_request, int client_close, proxy_resp_head_t *info, char *out, size_t outlen) {
+    return proxy_rewrite_response_head(head, strlen(head), head_request, client_close, info, out, outlen);
+}
+
+void test_response_length() {
+    proxy_resp_head_t info;
+    char out[512];
+    const char *h = "HTTP/1.1 200 OK\r\nContent-Length: 12\r\nConnection: keep-alive\r\nX-A: b\r\n\r\n";
+    int n = rewrite(h, 0, 0, &info, out, sizeof(out));
+    assert(n > 0);
+    out[n] = '\0';
+    assert(info.status == 200);
+    assert(info.mode == PROXY_RESP_LENGTH);
+    assert(info.content_length == 12);
+    assert(!info.upstream_close);
+    assert(strcmp(out, "HTTP/1.1 200 OK\r\nContent-Length: 12\r\nX-A: b\r\nConnection: keep-alive\r\n\r\n") == 0);
+    n = rewrite(h, 0, 1, &info, out, sizeof(out));
+    out[n] = '\0';
+    assert(strstr(out, "Connection: close\r\n\r\n"));
+    printf("test_response_length passed\n");
+}
+
+void test_response_framing() {
+    proxy_resp_head_t info;
+    char out[512];
+    int n = rewrite("HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n", 0, 0, &info, out, sizeof(out));
+    assert(n > 0);
+    out[n] = '\0';
+    assert(info.mode == PROXY_RESP_CHUNKED);
+    assert(strstr(out, "Transfer-Encoding: chunked\r\n"));
+    /* no framing: read until the upstream closes, client must be closed too */
+    n = rewrite("HTTP/1.0 200 OK\r\nServer: x\r\n\r\n", 0, 0, &info, out, sizeof(out));
+    out[n] = '\0';
+    assert(info.mode == PROXY_RESP_EOF);
+    assert(info.upstream_close);
+    assert(strncmp(out, "HTTP/1.1 200 OK\r\n", 17) == 0);
+    assert(strstr(out, "Connection: close\r\n"));
+    /* bodiless responses */
+    rewrite("HTTP/1.1 204 No Content\r\n\r\n", 0, 0, &info, out, sizeof(out));
+    assert(info.mode == PROXY_RESP_NONE);
+    rewrite("HTTP/1.1 200 OK\r\nContent-Length: 99\r\n\r\n", 1, 0, &info, out, sizeof(out));
+    assert(info.mode == PROXY_RESP_NONE);
+    n = rewrite("HTTP/1.1 100 Continue\r\n\r\n", 0, 0, &info, out, sizeof(out));
+    out[n] = '\0';
+    assert(info.status == 100);
+    assert(strcmp(out, "HTTP/1.1 100 Continue\r\n\r\n") == 0);
+    printf("test_response_framing passed\n");
+}
+
+void test_response_invalid() {
+    proxy_resp_head_t info;
+    char out[512];
+    assert(rewrite("garbage\r\n\r\n", 0, 0, &info, out, sizeof(out)) == -1);
+    assert(rewrite("HTTP/1.1 200 OK\r\nContent-Length: -1\r\n\r\n", 0, 0, &info, out, sizeof(out)) == -1);
+    assert(rewrite("HTTP/1.1 200 OK\r\nno colon\r\n\r\n", 0, 0, &info, out, sizeof(out)) == -1);
+    assert(rewrite("HTTP/1.1 200 OK\r\nX: y\r\n\r\n", 0, 0, &info, out, 20) == -1);
+    printf("test_response_invalid passed\n");
+}
+
+void test_chunk_size() {
+    size_t sz = 0;
+    assert(proxy_parse_chunk_size("1a\r\n", 4, &sz) == 0 && sz == 26);
+    assert(proxy_parse_chunk_size("0\r\n", 3, &sz) == 0 && sz == 0);
+    assert(proxy_parse_chunk_size("FF;name=val\r\n", 13, &sz) == 0 && sz == 255);
+    assert(proxy_parse_chunk_size("\r\n", 2, &sz) == -1);
+    assert(proxy_parse_chunk_size("zz\r\n", 4, &sz) == -1);
+    assert(proxy_parse_chunk_size("10 x\r\n", 6, &sz) == -1);
+    printf("test_chunk_size passed\n");
+}
+
+void test_request_head() {
+    http_parser_t p;
+    http_parser_init(&p);
+    const char *req = "POST /api/items HTTP/1.0\r\nHost: example.com\r\nConnection: close\r\nContent-Length: 3\r\nExpect: 100-continue\r\n\r\n";
+    size_t consumed = 0;
+    assert(http_parser_execute(&p, req, strlen(req), &consumed) == 1);
+    char out[512];
+    int n = proxy_build_request_head(&p, out, sizeof(out));
+    assert(n > 0);
+    out[n] = '\0';
+    assert(strcmp(out, "POST /api/items HTTP/1.1\r\nHost: example.com\r\nContent-Length: 3\r\nConnection: keep-alive\r\n\r\n") == 0);
+    assert(proxy_build_request_head(&p, out, 16) == -1);
+    http_parser_destroy(&p);
+    printf("test_request_head passed\n");
+}
+
+int main(void) {
+    test_response_length();
+    test_response_framing();
+    test_response_invalid();
+    test_chunk_size();
+    test_request_head();
+    printf("ALL PROXY TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,101 @@
+#include "../src/ratelimit.h"
+#include <assert.h>
+#include <stdio.h>
+
+void test_burst_then_refill() {
+    ratelimit_t *rl = ratelimit_new(1024, 10, 5); /* 10/s, burst 5 */
+    assert(rl);
+    uint32_t ip = 0x7f000001;
+    for (int i = 0; i < 5; ++i) assert(ratelimit_allow(rl, ip, 1000));
+    assert(!ratelimit_allow(rl, ip, 1000));
+    assert(!ratelimit_allow(rl, ip, 1050));
+    /* one token every 100ms */
+    assert(ratelimit_allow(rl, ip, 1100));
+    assert(!ratelimit_allow(rl, ip, 1100));
+    /* never more than the burst */
+    for (int i = 0; i < 5; ++i) assert(ratelimit_allow(rl, ip, 100000));
+    assert(!ratelimit_allow(rl, ip, 100000));
+    ratelimit_free(rl);
+    printf("test_burst_then_refill passed\n");
+}
+
+void test_keys_independent() {
+    ratelimit_t *rl = ratelimit_new(1024, 1, 1);
+    assert(ratelimit_allow(rl, 1, 500));
+    assert(!ratelimit_allow(rl, 1, 500));
+    assert(ratelimit_allow(rl, 2, 500));
+    assert(ratelimit_allow(rl, 0, 500));
+    assert(!ratelimit_allow(rl, 2, 600));
+    ratelimit_free(rl);
+    printf("test_keys_independent passed\n");
+}
+
+void test_table_full() {
+    /* a single group: more active keys than slots */
+    ratelimit_t *rl = ratelimit_new(1, 1, 1);
+    for (uint32_t k = 1; k <= RATELIMIT_GROUP; ++k) assert(ratelimit_allow(rl, k, 1000 + k));
+    /* every slot holds an empty bucket: a newcomer evicts the oldest */
+    assert(ratelimit_allow(rl, 100, 1100));
+    assert(!ratelimit_allow(rl, 100, 1100));
+    /* key 1 was evicted and starts over with a full bucket */
+    assert(ratelimit_allow(rl, 1, 1100));
+    /* key 8 still has its state */
+    assert(!ratelimit_allow(rl, RATELIMIT_GROUP, 1100));
+    /* after a full refill every slot is reusable without evicting anyone */
+    assert(ratelimit_allow(rl, 200, 5000));
+    assert(!ratelimit_allow(rl, 200, 5000));
+    ratelimit_free(rl);
+    printf("test_table_full passed\n");
+}
+
+void test_fractional_rate() {
+    /* 0.2/s: one token every 5s, not one a second */
+    ratelimit_t *rl = ratelimit_new(1024, 0.2, 1);
+    assert(ratelimit_allow(rl, 1, 1000));
+    assert(!ratelimit_allow(rl, 1, 2000));
+    assert(!ratelimit_allow(rl, 1, 5999));
+    assert(ratelimit_allow(rl, 1, 6000));
+    ratelimit_free(rl);
+    /* 2.5/s: one token every 400ms, not every 500ms */
+    rl = ratelimit_new(1024, 2.5, 1);
+    assert(ratelimit_allow(rl, 1, 1000));
+    assert(!ratelimit_allow(rl, 1, 1399));
+    assert(ratelimit_allow(rl, 1, 1400));
+    assert(!ratelimit_allow(rl, 1, 1799));
+    assert(ratelimit_allow(rl, 1, 1800));
+    ratelimit_free(rl);
+    /* a fractional burst keeps its remainder */
+    rl = ratelimit_new(1024, 1, 1.5);
+    assert(ratelimit_allow(rl, 1, 1000));
+    assert(!ratelimit_allow(rl, 1, 1000));
+    assert(!ratelimit_allow(rl, 1, 1499));
+    assert(ratelimit_allow(rl, 1, 1500));
+    ratelimit_free(rl);
+    printf("test_fractional_rate passed\n");
+}
+
+void test_large_rate_long_idle() {
+    /* the largest refill after the longest gap saturates instead of overflowing */
+    ratelimit_t *rl = ratelimit_new(1024, 1e12, 1e12);
+    assert(ratelimit_allow(rl, 1, 1000));
+    assert(ratelimit_allow(rl, 1, 1000 + 0xfffffff0u));
+    ratelimit_free(rl);
+    printf("test_large_rate_long_idle passed\n");
+}
+
+void test_invalid() {
+    assert(ratelimit_new(1024, 0, 5) == NULL);
+    assert(ratelimit_new(1024, 5, 0) == NULL);
+    printf("test_invalid passed\n");
+}
+
+int main(void) {
+    test_burst_then_refill();
+    test_keys_independent();
+    test_table_full();
+    test_fractional_rate();
+    test_large_rate_long_idle();
+    test_invalid();
+    printf("ALL RATELIMIT TESTS PASSED\n");
+    return 0;
+}
@@ -1,8 +1,12 @@
+#define _GNU_SOURCE
 #include "../src/fsutils.h"
 #include <limits.h>
 #include <assert.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 int main(void) {
     char out[4096];
@@ -20,6 +24,29 @@ int main(void) {
     // encoded traversal attempt
     r = safe_resolve_path("www", "/%2e%2e/%2e%2e/etc/passwd", out, sizeof(out));
     assert(r == -1);
+    // upload targets need not exist, but their directory must
+    r = safe_resolve_new_path("www", "/new-file.bin", out, sizeof(out));
+    assert(r == 0);
+    assert(strcmp(out + strlen(out) - 17, "/www/new-file.bin") == 0);
+    assert(safe_resolve_new_path("www", "/missing-dir/f", out, sizeof(out)) == -1);
+    assert(safe_resolve_new_path("www", "/", out, sizeof(out)) == -1);
+    assert(safe_resolve_new_path("www", "/dir/", out, sizeof(out)) == -1);
+    assert(safe_resolve_new_path("www", "/a/..", out, sizeof(out)) == -1);
+    assert(safe_resolve_new_path("www", "/../f", out, sizeof(out)) == -1);
+    // a symlink to a sibling sharing the base's name as a prefix stays outside
+    char tmpl[] = "/tmp/fsutils-XXXXXX";
+    assert(mkdtemp(tmpl));
+    char base[PATH_MAX], sib[PATH_MAX], link[PATH_MAX];
+    snprintf(base, sizeof(base), "%s/up", tmpl);
+    snprintf(sib, sizeof(sib), "%s/up2", tmpl);
+    snprintf(link, sizeof(link), "%s/up/out", tmpl);
+    assert(mkdir(base, 0700) == 0 && mkdir(sib, 0700) == 0 && symlink("../up2", link) == 0);
+    assert(safe_resolve_new_path(base, "/out/f", out, sizeof(out)) == -1);
+    assert(safe_resolve_new_path(base, "/f", out, sizeof(out)) == 0);
+    unlink(link);
+    rmdir(sib);
+    rmdir(base);
+    rmdir(tmpl);
     printf("ALL FSUTILS TESTS PASSED\n");
     return 0;
 }
@@ -0,0 +1,55 @@
+#include "../src/sse.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void expect(uint64_t id, const char *event, const char *data, const char *want) {
+    char out[256];
+    size_t n = sse_format(out, sizeof(out), id, event, data, strlen(data));
+    assert(n == strlen(want));
+    assert(memcmp(out, want, n) == 0);
+    /* the length alone, for sizing */
+    assert(sse_format(NULL, 0, id, event, data, strlen(data)) == n);
+}
+
+void test_format() {
+    expect(1, NULL, "hello", "id: 1\ndata: hello\n\n");
+    expect(42, "tick", "x", "id: 42\nevent: tick\ndata: x\n\n");
+    expect(7, "", "", "id: 7\ndata: \n\n");
+    /* every line break style splits into data fields */
+    expect(3, NULL, "a\nb\r\nc\rd", "id: 3\ndata: a\ndata: b\ndata: c\ndata: d\n\n");
+    /* a trailing newline survives the client joining the fields */
+    expect(4, NULL, "a\n", "id: 4\ndata: a\ndata: \n\n");
+    expect(5, NULL, "\n\n", "id: 5\ndata: \ndata: \ndata: \n\n");
+    printf("test_format passed\n");
+}
+
+void test_format_truncated() {
+    const char *want = "id: 18446744073709551615\nevent: e\ndata: abc\n\n";
+    char out[16];
+    memset(out, 'x', sizeof(out));
+    size_t n = sse_format(out, 10, UINT64_MAX, "e", "abc", 3);
+    assert(n == strlen(want));
+    assert(memcmp(out, want, 10) == 0);
+    assert(out[10] == 'x');
+    printf("test_format_truncated passed\n");
+}
+
+void test_hub() {
+    sse_hub_t *hub = sse_hub_new(4);
+    assert(hub);
+    sse_hub_free(hub);
+    hub = sse_hub_new(0);
+    assert(hub);
+    sse_hub_free(hub);
+    printf("test_hub passed\n");
+}
+
+int main(void) {
+    test_format();
+    test_format_truncated();
+    test_hub();
+    printf("ALL SSE TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,52 @@
+#define _GNU_SOURCE
+#include "../src/trace.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void test_format() {
+    trace_rec_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.fd = 7;
+    strcpy(rec.method, "GET");
+    strcpy(rec.path, "/a");
+    rec.t[TRACE_FIRST_BYTE] = 1000000;
+    rec.t[TRACE_PARSED] = 1005000;
+    rec.t[TRACE_FLUSHED] = 1250000;
+    char buf[256];
+    trace_format(&rec, buf, sizeof(buf));
+    assert(strcmp(buf, "fd=7 GET /a first_byte=+0us parsed=+5us flushed=+250us") == 0);
+    printf("test_format passed\n");
+}
+
+void test_ring_wraps() {
+    trace_ring_t r;
+    assert(trace_ring_init(&r, 4) == 0);
+    trace_rec_t rec;
+    memset(&rec, 0, sizeof(rec));
+    for (int i = 0; i < 10; ++i) {
+        rec.fd = i;
+        rec.t[TRACE_ACCEPT] = 1;
+        trace_ring_push(&r, &rec);
+    }
+    char *out = NULL;
+    size_t len = 0;
+    FILE *f = open_memstream(&out, &len);
+    assert(trace_ring_dump(&r, 3, f) == 4);
+    fclose(f);
+    /* the four newest, oldest first */
+    assert(strncmp(out, "worker=3 fd=6 ", 14) == 0);
+    assert(strstr(out, "worker=3 fd=9 "));
+    assert(!strstr(out, "fd=5 "));
+    free(out);
+    trace_ring_free(&r);
+    printf("test_ring_wraps passed\n");
+}
+
+int main(void) {
+    test_format();
+    test_ring_wraps();
+    printf("ALL TRACE TESTS PASSED\n");
+    return 0;
+}
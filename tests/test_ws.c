@@ -0,0 +1,140 @@
+#include "../src/ws.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void test_accept_key() {
+    char out[WS_ACCEPT_LEN + 1];
+    /* the example from RFC 6455 section 1.3 */
+    ws_accept_key("dGhlIHNhbXBsZSBub25jZQ==", out);
+    assert(strcmp(out, "s3pPLMBiTxaQ9kYGzzhZRbK+xOo=") == 0);
+    ws_accept_key("x3JJHMbDL1EzLkh9GBhXDw==", out);
+    assert(strcmp(out, "HSmrc0sMlYUkAGmm5OPpG2HaGWk=") == 0);
+    printf("test_accept_key passed\n");
+}
+
+void test_parse_header() {
+    ws_frame_t f;
+    /* masked "Hello" from the RFC */
+    const uint8_t hello[] = { 0x81, 0x85, 0x37, 0xfa, 0x21, 0x3d, 0x7f, 0x9f, 0x4d, 0x51, 0x58 };
+    assert(ws_parse_header(hello, 1, &f) == 0);
+    assert(ws_parse_header(hello, 5, &f) == 0);
+    assert(ws_parse_header(hello, sizeof(hello), &f) == 1);
+    assert(f.fin && f.opcode == WS_OP_TEXT && f.masked && f.len == 5 && f.hlen == 6);
+    uint8_t payload[5];
+    memcpy(payload, hello + f.hlen, 5);
+    ws_mask(payload, 5, f.mask, 0);
+    assert(memcmp(payload, "Hello", 5) == 0);
+
+    const uint8_t len16[] = { 0x02, 0xfe, 0x01, 0x00, 1, 2, 3, 4 };
+    assert(ws_parse_header(len16, 3, &f) == 0);
+    assert(ws_parse_header(len16, sizeof(len16), &f) == 1);
+    assert(!f.fin && f.opcode == WS_OP_BINARY && f.len == 256 && f.hlen == 8);
+    const uint8_t len64[] = { 0x82, 0x7f, 0, 0, 0, 0, 0, 1, 0, 0 };
+    assert(ws_parse_header(len64, sizeof(len64), &f) == 1);
+    assert(!f.masked && f.len == 65536 && f.hlen == 10);
+
+    const uint8_t rsv[] = { 0xc1, 0x80, 0, 0, 0, 0 };
+    assert(ws_parse_header(rsv, sizeof(rsv), &f) == -1);
+    const uint8_t opcode[] = { 0x83, 0x80, 0, 0, 0, 0 };
+    assert(ws_parse_header(opcode, sizeof(opcode), &f) == -1);
+    const uint8_t frag_ping[] = { 0x09, 0x80, 0, 0, 0, 0 };
+    assert(ws_parse_header(frag_ping, sizeof(frag_ping), &f) == -1);
+    const uint8_t long_close[] = { 0x88, 0xfe, 0, 126 };
+    assert(ws_parse_header(long_close, sizeof(long_close), &f) == -1);
+    const uint8_t huge[] = { 0x82, 0x7f, 0x80, 0, 0, 0, 0, 0, 0, 0 };
+    assert(ws_parse_header(huge, sizeof(huge), &f) == -1);
+    printf("test_parse_header passed\n");
+}
+
+void test_encode_header() {
+    uint8_t h[WS_MAX_HEADER];
+    ws_frame_t f;
+    uint64_t lens[] = { 0, 125, 126, 65535, 65536, 1ULL << 33 };
+    for (size_t i = 0; i < sizeof(lens) / sizeof(lens[0]); ++i) {
+        size_t n = ws_encode_header(h, WS_OP_BINARY, lens[i]);
+        assert(ws_parse_header(h, n, &f) == 1);
+        assert(f.fin && f.opcode == WS_OP_BINARY && !f.masked);
+        assert(f.len == lens[i] && f.hlen == n);
+    }
+    assert(ws_encode_header(h, WS_OP_TEXT, 125) == 2);
+    assert(ws_encode_header(h, WS_OP_TEXT, 126) == 4);
+    assert(ws_encode_header(h, WS_OP_TEXT, 65536) == 10);
+    printf("test_encode_header passed\n");
+}
+
+/* The vector paths must match a byte-at-a-time reference for every length,
+ * alignment and key phase. */
+void test_mask() {
+    const uint8_t key[4] = { 0xde, 0xad, 0xbe, 0xef };
+    uint8_t *buf = malloc(600), *ref = malloc(600);
+    for (size_t len = 0; len < 300; ++len) {
+        for (size_t align = 0; align < 4; ++align) {
+            for (uint64_t pos = 0; pos < 5; ++pos) {
+                for (size_t i = 0; i < len; ++i) buf[align + i] = ref[i] = (uint8_t)(i * 31 + len);
+                ws_mask(buf + align, len, key, pos);
+                for (size_t i = 0; i < len; ++i) assert(buf[align + i] == (ref[i] ^ key[(pos + i) & 3]));
+            }
+        }
+    }
+    /* unmasking in pieces equals unmasking at once */
+    for (size_t i = 0; i < 600; ++i) buf[i] = ref[i] = (uint8_t)i;
+    ws_mask(ref, 600, key, 0);
+    ws_mask(buf, 7, key, 0);
+    ws_mask(buf + 7, 100, key, 7);
+    ws_mask(buf + 107, 493, key, 107);
+    assert(memcmp(buf, ref, 600) == 0);
+    free(buf);
+    free(ref);
+    printf("test_mask passed\n");
+}
+
+void test_utf8() {
+    const struct {
+        const char *s;
+        int valid;
+    } cases[] = {
+        { "", 1 },
+        { "plain ascii, longer than one word", 1 },
+        { "caf\xc3\xa9", 1 },
+        { "\xe2\x82\xac and \xf0\x9f\x98\x80", 1 }, /* U+20AC, U+1F600 */
+        { "\xf4\x8f\xbf\xbf", 1 },                    /* U+10FFFF */
+        { "\xed\x9f\xbf", 1 },                          /* U+D7FF */
+        { "\xff", 0 },
+        { "\x80", 0 },                                    /* lone continuation */
+        { "caf\xc3", 0 },                                 /* truncated */
+        { "\xe2\x82", 0 },
+        { "\xc3\x28", 0 },                               /* bad continuation */
+        { "\xc0\xaf", 0 },                               /* overlong "/" */
+        { "\xe0\x80\xaf", 0 },
+        { "\xf0\x80\x80\xaf", 0 },
+        { "\xed\xa0\x80", 0 },                          /* surrogate U+D800 */
+        { "\xf4\x90\x80\x80", 0 },                    /* U+110000 */
+        { "\xf8\x88\x80\x80\x80", 0 },
+        { "twelve bytes\xff", 0 },                        /* after the word loop */
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        assert(ws_utf8_valid((const uint8_t *)cases[i].s, strlen(cases[i].s)) == cases[i].valid);
+    }
+    /* a NUL is a valid code point */
+    assert(ws_utf8_valid((const uint8_t *)"a\0b", 3));
+    printf("test_utf8 passed\n");
+}
+
+void test_channel() {
+    assert(conn_channel("/ws/room") == conn_channel("/ws/room?x=1"));
+    assert(conn_channel("/ws/room") != conn_channel("/ws/other"));
+    printf("test_channel passed\n");
+}
+
+int main(void) {
+    test_accept_key();
+    test_parse_header();
+    test_encode_header();
+    test_mask();
+    test_utf8();
+    test_channel();
+    printf("ALL WS TESTS PASSED\n");
+    return 0;
+}
@@ -0,0 +1,52 @@
+// Build and check packed docroot archives (see src/pack.h).
+//   docpack build DIR ARCHIVE     pack every file below DIR
+//   docpack verify ARCHIVE DIR    check ARCHIVE against DIR, exit 1 on any difference
+//   docpack list ARCHIVE          print path, size and ETag of each entry
+#define _GNU_SOURCE
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include "../src/pack.h"
+
+static int usage(const char *prog) {
+    fprintf(stderr, "usage: %s build DIR ARCHIVE | verify ARCHIVE DIR | list ARCHIVE\n", prog);
+    return 2;
+}
+
+static int open_archive(pack_t *p, const char *path) {
+    if (pack_open(p, path) == 0) return 0;
+    fprintf(stderr, "%s: %s\n", path, errno == EINVAL ? "not a docroot archive" : strerror(errno));
+    return -1;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) return usage(argv[0]);
+    const char *cmd = argv[1];
+    if (strcmp(cmd, "build") == 0 && argc == 4) {
+        long n = pack_build(argv[2], argv[3], stderr);
+        if (n < 0) return 1;
+        printf("packed %ld files into %s\n", n, argv[3]);
+        return 0;
+    }
+    pack_t p;
+    if (strcmp(cmd, "verify") == 0 && argc == 4) {
+        if (open_archive(&p, argv[2]) != 0) return 1;
+        long bad = pack_verify(&p, argv[3], stderr);
+        if (!bad) printf("%s matches %s (%u files)\n", argv[2], argv[3], p.hdr->nfiles);
+        pack_close(&p);
+        return bad ? 1 : 0;
+    }
+    if (strcmp(cmd, "list") == 0 && argc == 3) {
+        if (open_archive(&p, argv[2]) != 0) return 1;
+        const pack_entry_t *e = (const pack_entry_t *)(p.base + p.hdr->entries_off);
+        for (uint32_t i = 0; i < p.hdr->nfiles; ++i, ++e) {
+            if (pack_lookup(&p, pack_ptr(&p, e->path_off), e->path_len) != e) continue;
+            printf("%.*s %" PRIu64 " %.*s\n", (int)e->path_len, pack_ptr(&p, e->path_off), e->body_len,
+                   (int)e->etag_len, pack_ptr(&p, e->etag_off));
+        }
+        pack_close(&p);
+        return 0;
+    }
+    return usage(argv[0]);
+}